@@ -0,0 +1,59 @@
+/* Acyclic.h - direct minimal DFA construction for string sets - header
+
+   When every pattern added to a Parser is an exact string, without
+   fLooseStart or fLooseEnd, the set of matches is finite and its
+   minimal DFA is acyclic.  AcyclicBuilder makes that DFA straight from
+   the strings, following the 2000 paper by Daciuk, Mihov, Watson and
+   Watson: Incremental Construction of Minimal Acyclic Finite-State
+   Automata.  Link here:
+   https://aclanthology.org/J00-1002.pdf
+   There's no NFA, powerset conversion or minimization, so time and
+   memory grow only with the strings.
+
+   The strings are sorted and then added one at a time.  Only states
+   along the most recently added string can still change.  Once the
+   next string leaves that path, those states are checked against a
+   register of finished states, and each is either replaced by its
+   twin there or registered itself.
+
+   If a string appears more than once, the lowest result wins, just as
+   with end marks.  Empty strings are ignored, as Parser::addExact()
+   ignores them.  With ignoreCase, ASCII letters are folded to lower
+   case before sorting, and each letter transition gets an upper-case
+   twin afterward, as fIgnoreCase does in the NFA.
+
+   The DFA returned has its equivalence map installed and dead ends
+   flagged, so it's ready for Serializer.  compile() takes this path on
+   its own when the Parser holds only such strings.
+
+   Usage is like:
+
+   vector<ExactString> strs = {{"foo", 1}, {"bar", 2}};
+   AcyclicBuilder ab(budget, stats);
+   DfaObj dfa = ab.build(strs, false);
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Budget.h"
+#include "Parser.h"
+#include "Dfa.h"
+
+namespace zezax::red {
+
+class AcyclicBuilder {
+public:
+  explicit AcyclicBuilder(Budget *budget = nullptr, CompStats *stats = nullptr)
+    : budget_(budget), stats_(stats) {}
+
+  // sorts strs in place
+  DfaObj build(std::vector<ExactString> &strs, bool ignoreCase);
+
+private:
+  Budget    *budget_;
+  CompStats *stats_;
+};
+
+} // namespace zezax::red
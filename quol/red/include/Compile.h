@@ -7,7 +7,49 @@
 
    There is no need to call finalize() on the parser.  Any Budget or
    CompStats pointers given to the parser will be propagated through
-   the subsequent compilation stages.
+   the subsequent compilation stages, as will its thread count.
+
+   Options can request companion programs to be built alongside the
+   main DFA and embedded in the same serialized form:
+     cfUnanchored - the DFA for .*(regex), which lets the search, scan
+                    and replace functions reject non-matching input in a
+                    single linear pass instead of restarting at every
+                    position.  Also the DFA for .*(reversed regex),
+                    which marks where matches begin in one backward
+                    pass, should restarting grow costly.  These cost
+                    compile time and space, and in rare cases can be
+                    much larger than the main DFA.
+     cfReverse    - the DFA for the reversed regex, which the match and
+                    search functions run backward from the end of a
+                    match to report its exact leftmost start.
+     cfRefine     - minimize with RefineMinimizer rather than
+                    DfaMinimizer.  Both make the minimal DFA, differing
+                    only in how states are numbered, but big ones are
+                    minimized in less time and memory.
+
+   Regardless of options, if every match must begin with one of a
+   modest number of two- or three-byte literals, those are embedded as
+   a prefilter.  The search, scan and replace functions use it to jump
+   between places where a match may start.  See Prefilter.h.
+   Likewise, if every match must contain some literal of at least three
+   bytes that isn't a prefix, it's embedded.  Every matching function
+   checks for it with one memmem() before touching the DFA.
+
+   If the parser holds only exact strings, and no companion is asked
+   for, the DFA is built directly from them by AcyclicBuilder, skipping
+   the NFA, powerset conversion and minimization.  See Acyclic.h.
+
+   The overloads taking a corpus run the DFA over each of its strings
+   and then lay out the most visited states together, which helps big
+   DFAs on inputs like the corpus.  See Profile.h.
+
+   To add patterns to a big set without compiling all of it again, keep
+   the DfaObj from compileToDfa() and pass it to compileUnion() with a
+   Parser holding just the new patterns.  That DfaObj becomes the union
+   of both, ready for the next addition, and the Executable returned
+   matches as if all were compiled together.  Companion programs and
+   required literals aren't built on this path; a prefilter still is.
+   See Union.h.
 
    Usage is like:
 
@@ -19,14 +61,41 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "Parser.h"
+#include "Dfa.h"
 #include "Serializer.h"
 #include "Executable.h"
 
 namespace zezax::red {
 
-Executable compile(Parser &rp, Format fmt = fmtDirectAuto);
+enum CompileFlagsE : Flags {
+  cfUnanchored = 0x01,
+  cfReverse    = 0x02,
+  cfRefine     = 0x04,
+};
+
+Executable compile(Parser &rp, Format fmt = fmtDirectAuto, Flags opts = 0);
+
+std::string compileToSerialized(Parser &rp,
+                                Format  fmt  = fmtDirectAuto,
+                                Flags   opts = 0);
+
+Executable compile(Parser &rp, const std::vector<std::string> &corpus,
+                   Format fmt = fmtDirectAuto, Flags opts = 0);
+
+std::string compileToSerialized(Parser                         &rp,
+                                const std::vector<std::string> &corpus,
+                                Format fmt  = fmtDirectAuto,
+                                Flags  opts = 0);
+
+// minimized, for compileUnion(); honors cfRefine only
+DfaObj compileToDfa(Parser &rp, Flags opts = 0);
 
-std::string compileToSerialized(Parser &rp, Format fmt = fmtDirectAuto);
+// updates base to include rp's patterns, then serializes that
+Executable compileUnion(DfaObj &base, Parser &rp,
+                        Format fmt = fmtDirectAuto, Flags opts = 0);
 
 } // namespace zezax::red
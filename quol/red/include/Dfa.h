@@ -31,8 +31,10 @@
 #pragma once
 
 #include <deque>
+#include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Consts.h"
@@ -187,6 +189,7 @@ public:
 
   CharIdx installEquivalenceMap(); // returns maxChar
   void copyEquivMap(const DfaObj &src) { equivMap_ = src.equivMap_; }
+  void setEquivMap(std::vector<CharIdx> map) { equivMap_ = std::move(map); }
   const std::vector<CharIdx> &getEquivMap() const { return equivMap_; }
 
   size_t numStates() const { return states_.size(); }
@@ -194,6 +197,7 @@ public:
   std::vector<DfaState> &getMutStates() { return states_; }
 
   std::string fixedPrefix(DfaId &nextId) const;
+  std::vector<std::string> prefixLiterals(size_t maxLen, size_t maxCount) const;
 
   Budget *getBudget() const { return budget_; }
 
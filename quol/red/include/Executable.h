@@ -7,29 +7,79 @@
    large) if they come from, say, a memory-mapped file, a database
    query, or an old C library.
 
+   Big DFAs are best loaded from a file with the PathTag constructor.
+   It maps the file read-only and shared, so loading costs no copy,
+   pages come in as they're touched, and every process mapping the
+   same file shares one set of physical pages.  Options can prefault
+   the mapping, start readahead, or ask for transparent huge pages,
+   which cut TLB misses on big tables; the latter two are only hints.
+   The mapping is removed on destruction.  The file must not be
+   changed in place while mapped, since that changes the DFA out from
+   under the matcher, and truncating it makes touching the lost pages
+   fatal.  Replace it with a new file instead, as writeStringToFile()
+   and hence Red::save() and Serializer::serializeToFile() do; the
+   mapping keeps the old one alive.
+
+   Verifying the checksum reads every byte, so it dominates loading
+   a big DFA.  For a trusted source, mfNoVerify skips it, leaving only
+   the cheap structural checks.  Alternatively, mfLazyVerify does it
+   in a background thread; awaitVerified() waits for that, throwing if
+   the DFA is corrupt, and matching in the meantime is at the caller's
+   risk.  Companion programs are covered by the main checksum, so they
+   aren't verified separately.
+
    Usage can be like:
 
    Executable proc(std::move(dfsStr));
    Result res = check(prog, "foobar", styFull);
 
+   Executable mapped(gPathTag, "/var/lib/big.dfa", mfWillNeed);
+
+   If the serialized DFA carries an unanchored companion section,
+   getUnanchored() exposes it as a nested Executable that shares the
+   same storage.  Otherwise it returns null.  Likewise getReverse()
+   for the reversed companion, and getStarts() for the one that finds
+   where matches begin.  A prefilter section, if any, is loaded
+   into the Prefilter returned by getPrefilter().  A required literal,
+   if any, is copied into the string returned by getRequired().  The
+   escape bytes of accelerated states are loaded into the Accelerator
+   returned by getAccel().
+
+   A version 1 buffer passed as a string is upgraded to the current
+   layout first; see upgradeFromV1() in Serializer.h.  The other
+   constructors use the buffer where it lies, so they reject it.
+
    Executable throws RedExcept if the DFA is null or corrupted.
  */
 
 #pragma once
 
+#include <future>
+#include <memory>
 #include <string>
 #include <string_view>
 
 #include "Types.h"
 #include "Serializer.h"
+#include "Skipper.h"
+#include "Prefilter.h"
 
 namespace zezax::red {
 
+enum MapFlagsE : Flags {
+  mfPopulate   = 0x01, // prefault every page at load, via MAP_POPULATE
+  mfWillNeed   = 0x02, // begin reading the whole file, via MADV_WILLNEED
+  mfHugePages  = 0x04, // prefer transparent huge pages, via MADV_HUGEPAGE
+  mfNoVerify   = 0x08, // skip the checksum
+  mfLazyVerify = 0x10, // check the checksum in a background thread
+};
+
+
 class Executable {
 public:
   Executable()
     : buf_(nullptr), end_(nullptr), equivMap_(nullptr), base_(nullptr),
-      inStr_(false), usedMalloc_(false) {}
+      inStr_(false), usedNew_(false), usedMalloc_(false), usedMmap_(false) {}
   Executable(Executable &&other);
 
   // these take a serialized dfa...
@@ -37,7 +87,11 @@ public:
   Executable(const CopyTag &, std::string_view sv);           // copy
   Executable(const DeleteTag &, const void *ptr, size_t len); // will delete[]
   Executable(const FreeTag &, const void *ptr, size_t len);   // will free()
-  Executable(const UnownedTag &, std::string_view sv);        // no cleanup
+  Executable(const UnownedTag &, std::string_view sv,         // no cleanup
+             Flags mapFlags = 0);
+
+  // ...this maps a file holding one; will munmap()
+  Executable(const PathTag &, const char *path, Flags mapFlags = 0);
 
   ~Executable();
 
@@ -58,21 +112,43 @@ public:
   Format getFormat() const { return fmt_; }
   Byte getLeaderLen() const { return leaderLen_; }
   const Byte *getLeader() const { return leader_; }
+  const Skipper &getSkipper() const { return skipper_; }
+  const LeaderFinder &getLeaderFinder() const { return finder_; }
+  const Prefilter &getPrefilter() const { return prefilter_; }
+  const std::string &getRequired() const { return required_; }
+  const Accelerator &getAccel() const { return accel_; }
+  const Executable *getUnanchored() const { return unanchored_.get(); }
+  const Executable *getReverse() const { return reverse_.get(); }
+  const Executable *getStarts() const { return starts_.get(); }
+
+  // returns once any lazy verification is done; throws RedExcept if bad
+  void awaitVerified() const;
 
 private:
-  void validate();
+  void validate(Flags mapFlags);
+  void release();
 
   std::string  str_; // storage if needed
+  std::unique_ptr<Executable> unanchored_; // companion, if any
+  std::unique_ptr<Executable> reverse_;    // companion, if any
+  std::unique_ptr<Executable> starts_;     // companion, if any
   const char  *buf_;
   const char  *end_;
   const Byte  *equivMap_;
   const Byte  *leader_;
   const char  *base_;
+  Skipper      skipper_; // finds bytes that escape the initial state
+  LeaderFinder finder_;  // finds places the leader may start
+  Prefilter    prefilter_; // finds literals that begin every match
+  std::string  required_;  // every match contains this, if not empty
+  Accelerator  accel_;     // escape bytes of self-looping states
+  std::shared_future<const char *> verdict_; // of lazy verification
   Format       fmt_;
   Byte         leaderLen_;
   bool         inStr_;
   bool         usedNew_;
   bool         usedMalloc_;
+  bool         usedMmap_;
 };
 
 } // namespace zezax::red
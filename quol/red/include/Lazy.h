@@ -0,0 +1,92 @@
+/* Lazy.h - on-demand DFA construction and matching - header
+
+   compile() runs powerset construction over the whole NFA before any
+   matching can happen, which takes a long time and a lot of memory
+   for patterns whose DFA explodes, even if the inputs only ever
+   reach a sliver of it.  LazyDfa instead keeps the NFA and builds DFA
+   states as matching first reaches them, in the manner of RE2's DFA.
+
+   Each DFA state is a set of NFA states.  The first time input takes
+   a state along some byte, the next set is worked out from the NFA,
+   looked up or added, and the transition is remembered.  Bytes that
+   behave the same everywhere in the NFA share a transition, just as
+   equivalence classes do in an Executable.  Results come from the end
+   marks, as in PowersetConverter, with the lowest result winning ties.
+
+   The cache of states is bounded.  When it's full, it's emptied and
+   matching resumes from the state it was in, rebuilding as it goes.
+   Input that wanders widely is then slower, but memory stays put.
+
+   Every thread has its own cache for each LazyDfa, made the first
+   time that thread uses it, so matching takes no locks and threads
+   never wait on one another.  A thread's caches are freed when it
+   exits, or when it next makes a cache after the LazyDfa is gone.
+
+   check(), match() and search() take a LazyDfa in place of an
+   Executable, and give the same results for the same patterns and
+   style.  There's no minimization, leader, prefilter, acceleration or
+   companion program, so start_ is always the escape heuristic; see
+   Outcome.h.
+
+   Like compile(), the constructor finishes the parser and frees its
+   NFA, having copied what it needs.
+
+   Usage is like:
+
+   Parser p;
+   p.add("(a|b)*a(a|b){20}", 1, 0);
+   LazyDfa lazy(p);
+   Outcome out = search(lazy, "abbaabab...", styLast);
+
+   LazyDfa throws RedExceptApi if the cache can't hold a working set.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Parser.h"
+#include "Matcher.h"
+
+namespace zezax::red {
+
+constexpr size_t gLazyMaxStates = 10000;
+
+class LazyCore;  // immutable, shared by all threads
+class LazyCache; // one per thread
+
+class LazyDfa {
+public:
+  explicit LazyDfa(Parser &rp, size_t maxStates = gLazyMaxStates);
+
+  // this thread's cache, made on first use
+  LazyCache &cache() const;
+
+  // for the calling thread
+  size_t cachedStates() const;
+  size_t cacheFlushes() const;
+
+private:
+  std::shared_ptr<const LazyCore> core_;
+};
+
+
+Result check(const LazyDfa &lazy, const void *ptr, size_t len, Style style);
+Result check(const LazyDfa &lazy, const char *str, Style style);
+Result check(const LazyDfa &lazy, const std::string &s, Style style);
+Result check(const LazyDfa &lazy, std::string_view sv, Style style);
+
+Outcome match(const LazyDfa &lazy, const void *ptr, size_t len, Style style);
+Outcome match(const LazyDfa &lazy, const char *str, Style style);
+Outcome match(const LazyDfa &lazy, const std::string &s, Style style);
+Outcome match(const LazyDfa &lazy, std::string_view sv, Style style);
+
+Outcome search(const LazyDfa &lazy, const void *ptr, size_t len,
+               Style style);
+Outcome search(const LazyDfa &lazy, const char *str, Style style);
+Outcome search(const LazyDfa &lazy, const std::string &s, Style style);
+Outcome search(const LazyDfa &lazy, std::string_view sv, Style style);
+
+} // namespace zezax::red
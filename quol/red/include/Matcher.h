@@ -45,6 +45,61 @@
             re('abc' -> 1, 'abcd' -> 2) on 'abcde' fails
             re('new' -> 1, 'new york' -> 2) on 'new york' matches 'new york'
 
+   If the Executable was compiled with cfUnanchored, scan, search and
+   replace first run its unanchored companion over the input.  That is
+   a single linear pass which proves there's no match, in which case
+   the per-position restarts are skipped entirely.  Otherwise they
+   restart as usual, but tally how far the failed attempts go.  Once
+   that's more than twice what's left of the input, the starts
+   companion runs backward once from the end, marking every place a
+   match begins, and attempts are made only there.  So with
+   cfUnanchored these take linear time, except with styFull, which
+   wants matches that reach the end and keeps restarting.  Results are
+   the same either way.
+
+   Before trying the DFA at each position, scan, search and replace
+   skip ahead to the next byte that can take the DFA out of its
+   initial state without failing.  When there's a leader, they instead
+   jump to the next place it may occur, via memmem() or memchr(), and
+   resume the DFA after it from the leader state.  See Skipper.h.
+   Failing that, if there's a prefilter, they jump to the next place
+   one of its literals occurs.  See Prefilter.h.
+
+   Once the DFA reaches a state flagged as accelerated, which loops
+   back to itself on all but a few bytes, the single-input functions
+   jump straight to the next of those escape bytes with a vectorized
+   search.  That suits patterns like "foo.*bar", which otherwise spend
+   most of their time stepping in place.  See Accelerator in Skipper.h.
+
+   If the DFA has a required literal, every function first checks that
+   it occurs in the input with one memmem() or strstr(), which rejects
+   most non-matching input without touching the DFA.
+
+   If the Executable was compiled with cfReverse, match and search run
+   its reversed companion backward from the end of a match, so start_
+   in the Outcome is exact.  See Outcome.h.
+
+   checkBatch and matchBatch take an array of short inputs and give a
+   Result or Outcome for each, as check and match would.  They walk up
+   to eight inputs in lockstep, prefetching each one's next DFA row, so
+   cache misses on a big DFA overlap instead of stalling one by one.
+
+   StreamMatcher accepts input in chunks of any size, for pipes and
+   sockets.  It reports the same matches as calling search() again
+   from the end of each match, with offsets from the start of the
+   stream, including matches that span chunks.  Rather than keeping
+   old bytes, it runs every attempt that's still undecided side by
+   side, one DFA state each.  Attempts in the same state with the same
+   history are merged, and failed ones are dropped at once.  But a
+   match can't be reported while an earlier attempt is undecided,
+   since that one may yet cover it.  So memory grows with the matches
+   held back that way: "x.*y|b" fed "x" and then many "b"s holds them
+   all until a "y" discards them or the stream ends.  Likewise for
+   attempts whose past matches differ, such as "a|a.*q" on many "a"s.
+   Without such patterns, memory is bounded by the DFA, not the input.
+   Zero-length matches are not reported.  Since earlier input is gone,
+   start_ is always the escape heuristic, even with cfReverse.
+
    Usage is like:
 
    Parser p;
@@ -56,7 +111,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <vector>
 
 #include "Executable.h"
 #include "Outcome.h"
@@ -128,6 +186,19 @@ size_t matchAll(const Executable     &exec,
                 std::string_view      sv,
                 std::vector<Outcome> &out);
 
+// these check or match many short inputs, each anchored, interleaved so
+// cache misses overlap; out must have room for count entries
+void checkBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Result                 *out,
+                Style                   style);
+void matchBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Outcome                *out,
+                Style                   style);
+
 // the following variants skip the run-time dispatch based on style
 
 template <Style style, bool doLeader>
@@ -211,6 +282,18 @@ size_t replace(const Executable &exec,
                std::string      &out,
                size_t            max);
 
+template <Style style, bool doLeader>
+void checkBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Result                 *out);
+
+template <Style style, bool doLeader>
+void matchBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Outcome                *out);
+
 // these are the actual core templates
 
 template <Style style, bool doLeader, class InProxyT, class DfaProxyT>
@@ -225,6 +308,13 @@ Result scanCore(const Executable &exec, InProxyT in, DfaProxyT dfap);
 template <Style style, bool doLeader, class InProxyT, class DfaProxyT>
 Outcome searchCore(const Executable &exec, InProxyT in, DfaProxyT dfap);
 
+template <Style style, bool doLeader, class OutT, class DfaProxyT>
+void batchCore(const Executable       &exec,
+               const std::string_view *inputs,
+               size_t                  count,
+               OutT                   *out,
+               DfaProxyT               dfap);
+
 template <Style style, bool doLeader, class InProxyT, class DfaProxyT>
 size_t replaceCore(const Executable &exec,
                    InProxyT          in,
@@ -257,6 +347,18 @@ size_t matchAllCore(const Executable     &exec, // a la RE2::Set::Match()
   case fmtDirect4: {                                       \
     DfaProxy<fmtDirect4> proxy;                            \
     return A_func<A_style, A_lead>(__VA_ARGS__); }         \
+  case fmtDirect8: {                                       \
+    DfaProxy<fmtDirect8> proxy;                            \
+    return A_func<A_style, A_lead>(__VA_ARGS__); }         \
+  case fmtFlat2: {                                         \
+    DfaProxy<fmtFlat2> proxy;                              \
+    return A_func<A_style, A_lead>(__VA_ARGS__); }         \
+  case fmtFlat4: {                                         \
+    DfaProxy<fmtFlat4> proxy;                              \
+    return A_func<A_style, A_lead>(__VA_ARGS__); }         \
+  case fmtComb4: {                                         \
+    DfaProxy<fmtComb4> proxy;                              \
+    return A_func<A_style, A_lead>(__VA_ARGS__); }         \
   default:                                                 \
     throw RedExceptExec("unsupported format");             \
   }
@@ -320,6 +422,25 @@ ZEZAX_RED_FUNC_DEFS(Outcome, search, exec, it, proxy)
 
 ZEZAX_RED_REPL_DEFS(size_t, replace, exec, it, proxy, repl, out, max)
 
+template <Style style, bool doLeader>
+void checkBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Result                 *out) {
+  ZEZAX_RED_FMT_SWITCH(batchCore, style, doLeader,
+                       exec, inputs, count, out, proxy)
+}
+
+
+template <Style style, bool doLeader>
+void matchBatch(const Executable       &exec,
+                const std::string_view *inputs,
+                size_t                  count,
+                Outcome                *out) {
+  ZEZAX_RED_FMT_SWITCH(batchCore, style, doLeader,
+                       exec, inputs, count, out, proxy)
+}
+
 // don't #undef ZEZAX_RED_FMT_SWITCH
 #undef ZEZAX_RED_FUNC_DEFS
 #undef ZEZAX_RED_REPL_DEFS
@@ -360,12 +481,268 @@ bool compareThrough(InProxyT    &inOut, // by reference
 }
 
 
+// True if the loop may pass through plain states unseen.  They never
+// accept, so only styles that stop on leaving a match need to look.
+template <Style style>
+bool mayWalk(Result prevResult) {
+  return (((style != styFirst) && (style != styTangent)) || (prevResult == 0));
+}
+
+
+// Runs an unanchored program once over the input: is there a match anywhere?
+template <Style style, class InProxyT, class DfaProxyT>
+bool unanchoredCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
+  const FileHeader *hdr = exec.getHeader();
+  const char *__restrict__ base = exec.getBase();
+  const Byte *__restrict__ equivMap = exec.getEquivMap();
+
+  dfap.init(base, hdr->initialOff_);
+  Result result = dfap.result();
+
+  for (; in; ++in) {
+    if ((style != styFull) && (result > 0))
+      return true;
+    if (dfap.deadEnd())
+      break;
+    if ((in.walk(dfap, base, equivMap, hdr->plainOff_) > 0) && !in) {
+      result = 0; // plain states never accept
+      break;
+    }
+    Byte byte = dfap.column(equivMap, *in);
+    dfap.next(base, byte);
+    result = dfap.result();
+    if (UNLIKELY(dfap.accel()))
+      in.skipPast(exec.getAccel().find(dfap.state()));
+  }
+
+  return (result > 0);
+}
+
+
+// Returns false if the input lacks the required literal, if any
+template <class InProxyT>
+bool hasRequired(const Executable &exec, const InProxyT &in) {
+  const std::string &req = exec.getRequired();
+  return (req.empty() || in.contains(req));
+}
+
+
+// Returns false only if there's certainly no match starting within input
+template <Style style, class InProxyT>
+bool mayMatch(const Executable &exec, InProxyT in) {
+  if (!hasRequired(exec, in))
+    return false;
+  const Executable *un = exec.getUnanchored();
+  if (!un)
+    return true;
+  switch (un->getFormat()) {
+  case fmtDirect1:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtDirect1>());
+  case fmtDirect2:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtDirect2>());
+  case fmtDirect4:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtDirect4>());
+  case fmtDirect8:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtDirect8>());
+  case fmtFlat2:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtFlat2>());
+  case fmtFlat4:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtFlat4>());
+  case fmtComb4:
+    return unanchoredCore<style>(*un, in, DfaProxy<fmtComb4>());
+  default:
+    throw RedExceptExec("unsupported format");
+  }
+}
+
+
+// Runs a reversed program backward from end to beg, returning the offset
+// from beg of the leftmost place where it accepted, or gNoPos if none.
+template <class DfaProxyT>
+size_t reverseCore(const Executable &exec,
+                   const Byte       *beg,
+                   const Byte       *end,
+                   DfaProxyT         dfap) {
+  const FileHeader *hdr = exec.getHeader();
+  const char *__restrict__ base = exec.getBase();
+  const Byte *__restrict__ equivMap = exec.getEquivMap();
+
+  dfap.init(base, hdr->initialOff_);
+  size_t rv = (dfap.result() > 0) ? static_cast<size_t>(end - beg) : gNoPos;
+
+  for (const Byte *ptr = end; ptr > beg;) {
+    --ptr;
+    Byte byte = dfap.column(equivMap, *ptr);
+    dfap.next(base, byte);
+    if (dfap.result() > 0) {
+      if (dfap.deadEnd())
+        return 0; // accepts all the way back
+      rv = static_cast<size_t>(ptr - beg);
+    }
+    else if (dfap.pureDeadEnd())
+      break;
+  }
+
+  return rv;
+}
+
+
+// Returns exact start offset of match from beg to end, else the estimate
+inline size_t exactStart(const Executable &exec,
+                         const Byte       *beg,
+                         const Byte       *end,
+                         size_t            estimate) {
+  const Executable *rev = exec.getReverse();
+  if (!rev)
+    return estimate;
+  size_t rv;
+  switch (rev->getFormat()) {
+  case fmtDirect1:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtDirect1>());
+    break;
+  case fmtDirect2:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtDirect2>());
+    break;
+  case fmtDirect4:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtDirect4>());
+    break;
+  case fmtDirect8:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtDirect8>());
+    break;
+  case fmtFlat2:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtFlat2>());
+    break;
+  case fmtFlat4:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtFlat4>());
+    break;
+  case fmtComb4:
+    rv = reverseCore(*rev, beg, end, DfaProxy<fmtComb4>());
+    break;
+  default:
+    throw RedExceptExec("unsupported format");
+  }
+  return (rv == gNoPos) ? estimate : rv;
+}
+
+
+// Runs a starts program backward from end to beg, flagging in marks each
+// place from which a non-empty match begins.
+template <class DfaProxyT>
+void startsCore(const Executable  &exec,
+                const Byte        *beg,
+                const Byte        *end,
+                std::vector<bool> &marks,
+                DfaProxyT          dfap) {
+  const FileHeader *hdr = exec.getHeader();
+  const char *__restrict__ base = exec.getBase();
+  const Byte *__restrict__ equivMap = exec.getEquivMap();
+
+  marks.assign(static_cast<size_t>(end - beg), false);
+  dfap.init(base, hdr->initialOff_);
+  for (const Byte *ptr = end; ptr > beg;) {
+    --ptr;
+    Byte byte = dfap.column(equivMap, *ptr);
+    dfap.next(base, byte);
+    if (dfap.result() > 0) {
+      size_t off = static_cast<size_t>(ptr - beg);
+      if (dfap.deadEnd()) { // begins everywhere before here, too
+        std::fill(marks.begin(), marks.begin() + off + 1, true);
+        break;
+      }
+      marks[off] = true;
+    }
+  }
+}
+
+
+inline void findStarts(const Executable  &starts,
+                       const Byte        *beg,
+                       const Byte        *end,
+                       std::vector<bool> &marks) {
+  switch (starts.getFormat()) {
+  case fmtDirect1:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtDirect1>());
+  case fmtDirect2:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtDirect2>());
+  case fmtDirect4:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtDirect4>());
+  case fmtDirect8:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtDirect8>());
+  case fmtFlat2:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtFlat2>());
+  case fmtFlat4:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtFlat4>());
+  case fmtComb4:
+    return startsCore(starts, beg, end, marks, DfaProxy<fmtComb4>());
+  default:
+    throw RedExceptExec("unsupported format");
+  }
+}
+
+
+// Tallies how far failed attempts at successive positions have gone.
+// Once that's more than twice what's left of the input, one backward
+// pass of the starts companion, if any, marks every place a match
+// begins, and from then on attempts are made only there.  styFull
+// wants matches that reach the end, which the marks can't tell, so it
+// goes on restarting everywhere.
+template <Style style>
+class RestartBudget {
+public:
+  explicit RestartBudget(const Executable &exec)
+    : starts_((style == styFull) ? nullptr : exec.getStarts()),
+      beg_(nullptr), end_(nullptr), spent_(0), allowance_(gRestartSlack_) {}
+
+  bool marked() const { return (beg_ != nullptr); }
+
+  // for a failed attempt from in that stopped at upto
+  template <class InProxyT>
+  void charge(const InProxyT &in, const Byte *upto) {
+    if (!starts_ || marked())
+      return;
+    spent_ += static_cast<size_t>(upto - in.ptr());
+    if (spent_ <= allowance_)
+      return;
+    if (!end_) {
+      end_ = in.end();
+      allowance_ += 2 * static_cast<size_t>(end_ - in.ptr());
+      if (spent_ <= allowance_)
+        return;
+    }
+    beg_ = in.ptr();
+    findStarts(*starts_, beg_, end_, marks_);
+  }
+
+  // distance from ptr to where the next match begins, or gNoPos
+  size_t next(const Byte *ptr) const {
+    size_t off = static_cast<size_t>(ptr - beg_);
+    for (size_t ii = off; ii < marks_.size(); ++ii)
+      if (marks_[ii])
+        return ii - off;
+    return gNoPos;
+  }
+
+private:
+  static constexpr size_t gRestartSlack_ = 256; // bytes before looking at end
+
+  const Executable  *starts_;
+  const Byte        *beg_;   // where marks_ begin
+  const Byte        *end_;
+  size_t             spent_;
+  size_t             allowance_;
+  std::vector<bool>  marks_;
+};
+
+
 template <Style style, bool doLeader, class InProxyT, class DfaProxyT>
 Result checkCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   const FileHeader *hdr = exec.getHeader();
   const char *__restrict__ base = exec.getBase();
   const Byte *__restrict__ equivMap = exec.getEquivMap();
 
+  if (!hasRequired(exec, in))
+    return 0;
+
   // if there's a required leader, fail if it's not there
   if (doLeader) {
     const Byte *__restrict__ leader = exec.getLeader();
@@ -378,9 +755,21 @@ Result checkCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
 
   Result result = dfap.result();
   Result prevResult = 0;
+  if (doLeader && (exec.getLeaderLen() > 0) && (result > 0)) {
+    // leader state may already accept
+    if (style == styInstant)
+      return result;
+    prevResult = result;
+  }
 
+  size_t plainOff = hdr->plainOff_;
   for (; in; ++in) {
-    Byte byte = equivMap[*in];
+    if (mayWalk<style>(prevResult) &&
+        (in.walk(dfap, base, equivMap, plainOff) > 0) && !in) {
+      result = 0; // plain states never accept
+      break;
+    }
+    Byte byte = dfap.column(equivMap, *in);
     dfap.next(base, byte);
     result = dfap.result();
     if (UNLIKELY(result > 0)) {
@@ -400,6 +789,9 @@ Result checkCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
       if (dfap.pureDeadEnd())
         break;
     }
+    // bytes that loop back to this state change nothing, so pass them
+    if (UNLIKELY(dfap.accel()))
+      in.skipPast(exec.getAccel().find(dfap.state()));
   }
 
   if (style == styLast)
@@ -420,6 +812,9 @@ Outcome matchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   const char *__restrict__ base = exec.getBase();
   const Byte *__restrict__ equivMap = exec.getEquivMap();
 
+  if (!hasRequired(exec, in))
+    return Outcome::fail();
+
   // if there's a required leader, fail if it's not there
   if (doLeader) {
     const Byte *__restrict__ leader = exec.getLeader();
@@ -432,6 +827,7 @@ Outcome matchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
     }
   }
 
+  const Byte *beg = in.ptr();
   dfap.init(base, hdr->initialOff_);
   const State *__restrict__ init = dfap.state();
   Result result = dfap.result();
@@ -439,9 +835,17 @@ Outcome matchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   size_t idx = 0;
   size_t matchStart = 0;
   size_t matchEnd = 0;
+  size_t plainOff = hdr->plainOff_;
 
   for (; in; ++in, ++idx) {
-    Byte byte = equivMap[*in];
+    if ((dfap.state() != init) && mayWalk<style>(prevResult)) {
+      idx += in.walk(dfap, base, equivMap, plainOff);
+      if (!in) {
+        result = 0; // plain states never accept
+        break;
+      }
+    }
+    Byte byte = dfap.column(equivMap, *in);
 
     if (UNLIKELY(dfap.state() == init)) {
       const State *__restrict__ prevState = dfap.state();
@@ -476,6 +880,12 @@ Outcome matchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
       if (dfap.pureDeadEnd())
         break;
     }
+    // bytes that loop back to this state change nothing but the end
+    if (UNLIKELY(dfap.accel())) {
+      idx += in.skipPast(exec.getAccel().find(dfap.state()));
+      if (result > 0)
+        matchEnd = idx + 1;
+    }
   }
 
   if ((style == styTangent) || (style == styLast))
@@ -488,7 +898,7 @@ Outcome matchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
     rv.end_   = 0;
   }
   else {
-    rv.start_ = matchStart;
+    rv.start_ = exactStart(exec, beg, beg + matchEnd, matchStart);
     rv.end_   = matchEnd;
   }
   return rv;
@@ -503,15 +913,39 @@ Result scanCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   const Byte *__restrict__ leader = exec.getLeader();
   size_t leaderLen = exec.getLeaderLen();
 
+  if (!mayMatch<style>(exec, in))
+    return 0;
+
   dfap.init(base, hdr->initialOff_);
   Result result = dfap.result();
   DfaProxyT leaderp;
   leaderp.init(base, hdr->leaderOff_);
+  const Skipper &skipper = exec.getSkipper();
+  const LeaderFinder &finder = exec.getLeaderFinder();
+  const Prefilter &prefilter = exec.getPrefilter();
+  bool finding = doLeader && finder.active();
+  bool filtering = !finding && prefilter.active();
+  bool skipping = !finding && !filtering && skipper.active();
+  RestartBudget<style> restarts(exec);
 
   for (; in; ++in) {
+    if (restarts.marked()) {
+      size_t dist = restarts.next(in.ptr());
+      if (dist == gNoPos)
+        return 0; // no match begins from here on
+      in = in.ptr() + dist;
+    }
+    else if (finding && (in.skip(finder) > 0) && !in)
+      return 0; // leader appears nowhere
+    else if (filtering && (in.skip(prefilter) > 0) && !in)
+      return 0; // no literal appears
+    else if (skipping && (in.skip(skipper) > 0) && !in)
+      return 0; // nowhere left to start
+
     DfaProxyT dproxy;
+    InProxyT inner(in);
     if (doLeader) {
-      if (!compareThrough(in, equivMap, leader, leaderLen))
+      if (!compareThrough(inner, equivMap, leader, leaderLen))
         continue;
       dproxy = leaderp;
       result = dproxy.result();
@@ -520,8 +954,20 @@ Result scanCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
       dproxy = dfap;
 
     Result prevResult = 0;
-    for (InProxyT inner(in); inner; ++inner) {
-      Byte byte = equivMap[*inner];
+    if (doLeader && (leaderLen > 0) && (result > 0)) {
+      // leader state may already accept
+      if (style == styInstant)
+        return result;
+      prevResult = result;
+    }
+    for (; inner; ++inner) {
+      if (mayWalk<style>(prevResult) &&
+          (inner.walk(dproxy, base, equivMap, hdr->plainOff_) > 0) &&
+          !inner) {
+        result = 0; // plain states never accept
+        break;
+      }
+      Byte byte = dproxy.column(equivMap, *inner);
       dproxy.next(base, byte);
       result = dproxy.result();
       if (UNLIKELY(result > 0)) {
@@ -541,6 +987,8 @@ Result scanCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
         if (dproxy.pureDeadEnd())
           break;
       }
+      if (UNLIKELY(dproxy.accel()))
+        inner.skipPast(exec.getAccel().find(dproxy.state()));
     }
 
     if (style == styLast)
@@ -548,6 +996,7 @@ Result scanCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
         return prevResult;
     if (result > 0)
       return result;
+    restarts.charge(in, inner.ptr());
   }
 
   return result;
@@ -566,24 +1015,77 @@ Outcome searchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   const Byte *__restrict__ leader = exec.getLeader();
   size_t leaderLen = exec.getLeaderLen();
 
+  if (!mayMatch<style>(exec, in))
+    return Outcome::fail();
+
   dfap.init(base, hdr->initialOff_);
   const State *__restrict__ init = dfap.state();
+  const Byte *anchor = nullptr; // where current attempt began
   Result result = dfap.result();
   size_t idx = 0;
   size_t matchStart = 0;
   size_t matchEnd = 0;
+  DfaProxyT leaderp;
+  leaderp.init(base, hdr->leaderOff_);
+  const Skipper &skipper = exec.getSkipper();
+  const LeaderFinder &finder = exec.getLeaderFinder();
+  const Prefilter &prefilter = exec.getPrefilter();
+  bool finding = doLeader && finder.active();
+  bool filtering = !finding && prefilter.active();
+  bool skipping = !finding && !filtering && skipper.active();
+  RestartBudget<style> restarts(exec);
 
   for (; in; ++in, ++idx) {
-    if (doLeader && !lookingAt(in, equivMap, leader, leaderLen))
-      continue;
+    if (restarts.marked()) {
+      size_t dist = restarts.next(in.ptr());
+      if (dist == gNoPos) {
+        result = 0; // no match begins from here on
+        break;
+      }
+      in = in.ptr() + dist;
+      idx += dist;
+    }
+    else if (finding)
+      idx += in.skip(finder);
+    else if (filtering)
+      idx += in.skip(prefilter);
+    else if (skipping)
+      idx += in.skip(skipper);
+    if (!in) {
+      result = 0; // nowhere left to start
+      break;
+    }
 
     DfaProxyT dproxy = dfap;
     Result prevResult = 0;
     size_t innerIdx = idx;
+    InProxyT inner(in);
+    anchor = in.ptr();
     matchStart = idx;
     matchEnd = idx;
-    for (InProxyT inner(in); inner; ++inner, ++innerIdx) {
-      Byte byte = equivMap[*inner];
+    if (doLeader) {
+      if (!compareThrough(inner, equivMap, leader, leaderLen))
+        continue;
+      // resume after the leader, as if the DFA had stepped through it
+      innerIdx += leaderLen;
+      dproxy = leaderp;
+      result = dproxy.result();
+      if ((leaderLen > 0) && (result > 0)) { // leader state may already accept
+        matchEnd = innerIdx;
+        prevResult = result;
+        if (style == styInstant)
+          break;
+      }
+    }
+    for (; inner; ++inner, ++innerIdx) {
+      if ((dproxy.state() != init) && mayWalk<style>(prevResult)) {
+        innerIdx += inner.walk(dproxy, base, equivMap, hdr->plainOff_);
+        if (!inner) {
+          result = 0; // plain states never accept
+          break;
+        }
+      }
+      Byte byte = dproxy.column(equivMap, *inner);
 
       if (UNLIKELY(dproxy.state() == init)) {
         const State *__restrict__ prevState = dproxy.state();
@@ -618,6 +1120,11 @@ Outcome searchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
         if (dproxy.pureDeadEnd())
           break;
       }
+      if (UNLIKELY(dproxy.accel())) {
+        innerIdx += inner.skipPast(exec.getAccel().find(dproxy.state()));
+        if (result > 0)
+          matchEnd = innerIdx + 1;
+      }
     }
 
     if ((style == styTangent) || (style == styLast))
@@ -625,6 +1132,7 @@ Outcome searchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
         result = prevResult;
     if (result > 0)
       break;
+    restarts.charge(in, inner.ptr());
   }
 
   rv.result_ = result;
@@ -635,6 +1143,9 @@ Outcome searchCore(const Executable &exec, InProxyT in, DfaProxyT dfap) {
   else {
     rv.start_ = matchStart;
     rv.end_   = matchEnd;
+    if (anchor)
+      rv.start_ = idx + exactStart(exec, anchor, anchor + (matchEnd - idx),
+                                   matchStart - idx);
   }
   return rv;
 }
@@ -656,19 +1167,61 @@ size_t replaceCore(const Executable &exec,
   dfap.init(base, hdr->initialOff_);
   out.clear();
   size_t cnt = 0;
+  bool probe = true; // at start and after each replacement
+  const Skipper &skipper = exec.getSkipper();
+  const LeaderFinder &finder = exec.getLeaderFinder();
+  const Prefilter &prefilter = exec.getPrefilter();
+  bool finding = doLeader && finder.active();
+  bool filtering = !finding && prefilter.active();
+  bool skipping = !finding && !filtering && skipper.active();
+  RestartBudget<style> restarts(exec);
 
   while (in) {
+    if (probe) {
+      probe = false;
+      if (!mayMatch<style>(exec, in))
+        max = cnt; // copy the rest
+    }
+    if (restarts.marked()) {
+      size_t dist = restarts.next(in.ptr());
+      if (dist == gNoPos)
+        max = cnt; // no match begins from here on
+      else if (dist > 0) {
+        out.append(reinterpret_cast<const char *>(in.ptr()), dist);
+        in = in.ptr() + dist;
+      }
+    }
     if (cnt >= max) {
       for (; in; ++in)
         out += *in;
       break;
     }
+    if (!restarts.marked() && (finding || filtering || skipping)) {
+      const Byte *from = in.ptr();
+      size_t dist = finding   ? in.skip(finder)
+                  : filtering ? in.skip(prefilter)
+                  : in.skip(skipper);
+      if (dist > 0) {
+        out.append(reinterpret_cast<const char *>(from), dist);
+        if (!in)
+          break;
+      }
+    }
     const Byte *__restrict__ found = nullptr;
+    const Byte *upto = in.ptr(); // how far the attempt went
     if (!doLeader || lookingAt(in, equivMap, leader, leaderLen)) {
       DfaProxyT dproxy = dfap;
       Result prevResult = 0;
-      for (InProxyT inner(in); inner; ++inner) {
-        Byte byte = equivMap[*inner];
+      InProxyT inner(in);
+      for (; inner; ++inner) {
+        if ((((style != styFirst) && (style != styTangent)) || !found) &&
+            (inner.walk(dproxy, base, equivMap, hdr->plainOff_) > 0)) {
+          if (style == styFull)
+            found = nullptr; // plain states never accept
+          if (!inner)
+            break;
+        }
+        Byte byte = dproxy.column(equivMap, *inner);
         dproxy.next(base, byte);
         Result result = dproxy.result();
         if (UNLIKELY(result > 0)) {
@@ -688,15 +1241,23 @@ size_t replaceCore(const Executable &exec,
               dproxy.pureDeadEnd())
             break;
         }
+        if (UNLIKELY(dproxy.accel())) {
+          inner.skipPast(exec.getAccel().find(dproxy.state()));
+          if (result > 0)
+            found = inner.ptr();
+        }
       }
+      upto = inner.ptr();
     }
 
     if (found) {
       out += repl;
       in = found + 1;
       ++cnt;
+      probe = true;
     }
     else {
+      restarts.charge(in, upto);
       out += *in;
       ++in;
     }
@@ -735,7 +1296,16 @@ size_t matchAllCore(const Executable     &exec,
   size_t matchStart = 0;
 
   for (; in; ++in, ++idx) {
-    Byte byte = equivMap[*in];
+    if (dfap.state() != init) {
+      size_t dist = in.walk(dfap, base, equivMap, hdr->plainOff_);
+      if (dist > 0) {
+        idx += dist;
+        prevResult = 0; // plain states never accept
+        if (!in)
+          break;
+      }
+    }
+    Byte byte = dfap.column(equivMap, *in);
 
     if (UNLIKELY(dfap.state() == init)) {
       const State *__restrict__ prevState = dfap.state();
@@ -760,12 +1330,220 @@ size_t matchAllCore(const Executable     &exec,
         break;
       prevResult = 0;
     }
+    if (UNLIKELY(dfap.accel())) {
+      idx += in.skipPast(exec.getAccel().find(dfap.state()));
+      if (result > 0)
+        out.back().end_ = idx + 1;
+    }
   }
 
   return out.size();
 }
 
 
+// one of the walks interleaved by batchCore()
+template <class DfaProxyT>
+struct BatchLane {
+  DfaProxyT   dfap_;
+  const Byte *beg_;
+  const Byte *ptr_;        // next byte to step
+  const Byte *end_;
+  size_t      which_;      // index of input
+  size_t      matchStart_;
+  size_t      matchEnd_;
+  Result      result_;
+  Result      prevResult_;
+  bool        stepped_;    // result of current state not yet examined
+};
+
+
+inline void batchStore(const Executable &,
+                       const Byte       *,
+                       size_t,
+                       size_t,
+                       Result            result,
+                       Result           &out) {
+  out = result;
+}
+
+
+inline void batchStore(const Executable &exec,
+                       const Byte       *beg,
+                       size_t            matchStart,
+                       size_t            matchEnd,
+                       Result            result,
+                       Outcome          &out) {
+  out.result_ = result;
+  if (result == 0) {
+    out.start_ = 0;
+    out.end_   = 0;
+  }
+  else {
+    out.start_ = exactStart(exec, beg, beg + matchEnd, matchStart);
+    out.end_   = matchEnd;
+  }
+}
+
+
+// Sets up a lane for an input.  Returns false if already decided.
+template <Style style, bool doLeader, class OutT, class DfaProxyT>
+bool batchStart(const Executable      &exec,
+                std::string_view       sv,
+                BatchLane<DfaProxyT>  &lane,
+                OutT                  &out) {
+  const FileHeader *hdr = exec.getHeader();
+  const char *base = exec.getBase();
+  RangeIter in(sv);
+  lane.beg_ = in.ptr();
+  lane.end_ = lane.beg_ + sv.size();
+  lane.matchStart_ = 0;
+  lane.matchEnd_ = 0;
+  lane.prevResult_ = 0;
+  lane.stepped_ = false;
+
+  if (!hasRequired(exec, in)) {
+    batchStore(exec, lane.beg_, 0, 0, 0, out);
+    return false;
+  }
+  if (doLeader) {
+    if (!compareThrough(in, exec.getEquivMap(),
+                        exec.getLeader(), exec.getLeaderLen())) {
+      batchStore(exec, lane.beg_, 0, 0, 0, out);
+      return false;
+    }
+    lane.dfap_.init(base, hdr->leaderOff_);
+  }
+  else
+    lane.dfap_.init(base, hdr->initialOff_);
+  lane.ptr_ = in.ptr();
+  lane.result_ = lane.dfap_.result();
+  if (doLeader && (exec.getLeaderLen() > 0) && (lane.result_ > 0)) {
+    // leader state may already accept
+    lane.matchEnd_ = static_cast<size_t>(lane.ptr_ - lane.beg_);
+    lane.prevResult_ = lane.result_;
+  }
+
+  if ((lane.ptr_ < lane.end_) &&
+      ((style != styInstant) || (lane.prevResult_ == 0))) {
+    lane.dfap_.prefetch(exec.getEquivMap()[*lane.ptr_]);
+    return true;
+  }
+  batchStore(exec, lane.beg_, lane.matchStart_, lane.matchEnd_,
+             lane.result_, out);
+  return false;
+}
+
+
+// Examines the state reached by the last step, as the loop in matchCore()
+// does, and takes another step unless decided.  Returns true if decided.
+template <Style style, class DfaProxyT>
+bool batchStep(const char                    *base,
+               const Byte                    *equivMap,
+               const typename DfaProxyT::State *init,
+               BatchLane<DfaProxyT>          &lane) {
+  if (lane.stepped_) {
+    Result result = lane.dfap_.result();
+    lane.result_ = result;
+    if (UNLIKELY(result > 0)) {
+      if (style == styFirst) {
+        if (lane.prevResult_ && (result != lane.prevResult_)) {
+          lane.result_ = lane.prevResult_;
+          return true;
+        }
+        lane.prevResult_ = result;
+      }
+      lane.matchEnd_ = static_cast<size_t>(lane.ptr_ - lane.beg_);
+      if (style == styInstant)
+        return true;
+      if ((style == styTangent) || (style == styLast))
+        lane.prevResult_ = result;
+    }
+    else {
+      if (((style == styFirst) || (style == styTangent)) &&
+          (lane.prevResult_ > 0)) {
+        lane.result_ = lane.prevResult_;
+        return true;
+      }
+      if (lane.dfap_.pureDeadEnd())
+        lane.ptr_ = lane.end_;
+    }
+  }
+
+  if (lane.ptr_ >= lane.end_) {
+    if ((style == styTangent) || (style == styLast))
+      if ((lane.result_ == 0) && (lane.prevResult_ > 0))
+        lane.result_ = lane.prevResult_;
+    return true;
+  }
+
+  if (UNLIKELY(lane.dfap_.state() == init)) {
+    lane.dfap_.next(base, lane.dfap_.column(equivMap, *lane.ptr_));
+    if (lane.dfap_.state() != init)
+      lane.matchStart_ = static_cast<size_t>(lane.ptr_ - lane.beg_);
+  }
+  else
+    lane.dfap_.next(base, lane.dfap_.column(equivMap, *lane.ptr_));
+  ++lane.ptr_;
+  lane.stepped_ = true;
+  // the row is examined next round, after the other lanes have stepped
+  lane.dfap_.prefetch((lane.ptr_ < lane.end_)
+                      ? lane.dfap_.column(equivMap, *lane.ptr_) : 0);
+  return false;
+}
+
+
+// Walks up to batchLanes_ inputs in lockstep, one byte each per round.
+// Each DFA step is a load that depends on the previous one, so a single
+// walk over a big DFA waits on one cache miss after another.  Here each
+// lane prefetches the row it will need and the others run meanwhile.
+// A decided lane is refilled with the next input right away.
+template <Style style, bool doLeader, class OutT, class DfaProxyT>
+void batchCore(const Executable       &exec,
+               const std::string_view *inputs,
+               size_t                  count,
+               OutT                   *out,
+               DfaProxyT               dfap) {
+  typedef typename DfaProxyT::State State;
+  constexpr size_t batchLanes_ = 8;
+
+  const char *__restrict__ base = exec.getBase();
+  const Byte *__restrict__ equivMap = exec.getEquivMap();
+  dfap.init(base, exec.getHeader()->initialOff_);
+  const State *init = dfap.state();
+
+  BatchLane<DfaProxyT> lanes[batchLanes_];
+  size_t live = 0;
+  size_t next = 0;
+  for (; (live < batchLanes_) && (next < count); ++next)
+    if (batchStart<style, doLeader>(exec, inputs[next],
+                                    lanes[live], out[next]))
+      lanes[live++].which_ = next;
+
+  while (live > 0) {
+    for (size_t ii = 0; ii < live; ) {
+      BatchLane<DfaProxyT> &lane = lanes[ii];
+      if (!batchStep<style>(base, equivMap, init, lane)) {
+        ++ii;
+        continue;
+      }
+      batchStore(exec, lane.beg_, lane.matchStart_, lane.matchEnd_,
+                 lane.result_, out[lane.which_]);
+      bool refilled = false;
+      for (; !refilled && (next < count); ++next)
+        if (batchStart<style, doLeader>(exec, inputs[next],
+                                        lane, out[next])) {
+          lane.which_ = next;
+          refilled = true;
+        }
+      if (refilled)
+        ++ii;
+      else
+        lane = lanes[--live];
+    }
+  }
+}
+
+
 // this is slower but more flexible than the functions above
 class StatefulMatcher {
 public:
@@ -776,7 +1554,7 @@ public:
 
 private:
   template <class DfaProxyT> Result advanceCore(Byte input, DfaProxyT dfap) {
-    Byte byte = equivMap_[input];
+    Byte byte = dfap.column(equivMap_, input);
     dfap.restore(state_);
     dfap.next(base_, byte);
     state_ = dfap.state();
@@ -791,4 +1569,58 @@ private:
   const Byte       *equivMap_;
 };
 
+
+// finds matches in a stream delivered in arbitrary chunks, like search()
+// repeated from the end of each match, reporting absolute stream offsets
+class StreamMatcher {
+public:
+  // exec must outlive this object
+  StreamMatcher(const Executable &exec, Style style);
+
+  // appends outcomes settled by this chunk and returns how many
+  size_t feed(std::string_view chunk, std::vector<Outcome> &out);
+  size_t feed(const void *ptr, size_t len, std::vector<Outcome> &out);
+
+  // settles the rest at end of stream, then resets
+  size_t finish(std::vector<Outcome> &out);
+
+  void reset();
+
+  size_t offset() const { return pos_; }               // bytes fed so far
+  // undecided attempts and the matches they hold back
+  size_t pending() const { return attempts_.size() + held_.size(); }
+
+private:
+  struct Attempt {
+    const void *state_;
+    size_t      start_;      // where the attempt began
+    size_t      matchStart_; // where it escaped the initial state
+    size_t      matchEnd_;   // after last accepting byte, or gNoPos
+    Result      prevResult_;
+    Result      result_;
+    bool        done_;
+  };
+
+  template <Style style, class DfaProxyT>
+  void feedCore(const Byte *ptr, size_t len, std::vector<Outcome> &out);
+  template <Style style>
+  void feedFormat(const Byte *ptr, size_t len, std::vector<Outcome> &out);
+
+  void retire();
+  bool apart(size_t ii, const Attempt &early, const Attempt &later) const;
+  void merge();
+  void settle(std::vector<Outcome> &out);
+
+  Format              fmt_;
+  Style               style_;
+  const char         *base_;
+  const void         *init_;
+  const Byte         *equivMap_;
+  const Skipper      *skipper_;
+  size_t              pos_;     // absolute offset of next byte
+  size_t              restart_; // no attempts may begin before here
+  std::deque<Attempt> attempts_; // undecided, in order of start
+  std::deque<Attempt> held_;     // decided matches, in order of start
+};
+
 } // namespace zezax::red
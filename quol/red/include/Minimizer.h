@@ -26,6 +26,20 @@
    dm.minimize();
 
    DfaMinimizer will throw RedExcept exceptions for internal errors.
+
+   RefineMinimizer is a drop-in alternative which follows the 2008
+   Valmari and Lehtinen paper: Efficient Minimization of DFAs with
+   Partial Transition Functions.  Link here:
+   https://arxiv.org/abs/0802.2826
+   It refines a partition of the states and another of the transitions
+   against each other, both kept as flat arrays, and runs in
+   O(M log N) where M is the number of transitions other than those to
+   the error state.  All working storage is sized up front, so
+   splitting a block allocates nothing.  compile() uses it when given
+   cfRefine.  Usage is the same:
+
+   RefineMinimizer rm(dfa, stats);
+   rm.minimize();
  */
 
 #pragma once
@@ -152,6 +166,73 @@ private:
 };
 
 
+// Partition-refinement minimizer with the same results as DfaMinimizer
+class RefineMinimizer {
+public:
+  explicit RefineMinimizer(DfaObj &dfa, CompStats *stats = nullptr)
+    : src_(dfa), stats_(stats) {} // dfa will be modified
+
+  void minimize();
+
+private:
+  DfaObj    &src_;
+  CompStats *stats_;
+};
+
+
+// Refinable partition of the integers [0, size).  Each set's members
+// are contiguous in elems_, with marked members moved to its front.
+// split() makes the smaller of each touched set's marked and unmarked
+// parts into a new set, numbered after all the others.  RefineMinimizer
+// and UnionBuilder both refine with it.
+class Refinable {
+public:
+  explicit Refinable(uint32_t size);
+
+  uint32_t numSets() const { return numSets_; }
+  uint32_t setOf(uint32_t elem) const { return sets_[elem]; }
+  const uint32_t *begin(uint32_t set) const {
+    return elems_.data() + firsts_[set];
+  }
+  const uint32_t *end(uint32_t set) const {
+    return elems_.data() + pasts_[set];
+  }
+
+  void mark(uint32_t elem); // at most once between splits
+  void split();
+
+private:
+  uint32_t              numSets_;
+  std::vector<uint32_t> elems_;   // grouped by set
+  std::vector<uint32_t> locs_;    // index of each element in elems_
+  std::vector<uint32_t> sets_;    // set of each element
+  std::vector<uint32_t> firsts_;  // start of each set in elems_
+  std::vector<uint32_t> pasts_;   // end of each set in elems_
+  std::vector<uint32_t> marked_;  // count of marked elements in each set
+  std::vector<uint32_t> touched_; // sets with any marked elements
+};
+
+
+// Marks each run of equal keys but the first, splitting after each
+template <class SameT>
+void splitRuns(Refinable                   &part,
+               const std::vector<uint32_t> &order,
+               SameT                        same) {
+  size_t num = order.size();
+  for (size_t ii = 0; ii < num; ) {
+    size_t jj = ii + 1;
+    while ((jj < num) && same(order[ii], order[jj]))
+      ++jj;
+    if (ii > 0) {
+      for (size_t kk = ii; kk < jj; ++kk)
+        part.mark(order[kk]);
+      part.split();
+    }
+    ii = jj;
+  }
+}
+
+
 // constituent functions, public for unit tests
 DfaEdgeToIds invert(const DfaIdSet              &stateSet,
                     const std::vector<DfaState> &stateVec,
@@ -168,17 +249,13 @@ DfaIdSet locateSplits(const BlockRec                &blockRec,
                         const std::vector<DfaIdSet> &blocks,
                         const DfaEdgeToIds          &inv);
 
-void performSplits(const BlockRec              &blockRec,
-                   const DfaIdSet              &splits,
-                   std::vector<BlockId>        &twins,
-                   PatchSet                    &patches,
-                   const std::vector<DfaState> &stateVec,
-                   std::vector<DfaIdSet>       &blockVec);
+void performSplits(const DfaIdSet        &splits,
+                   std::vector<BlockId>  &twins,
+                   PatchSet              &patches,
+                   std::vector<DfaIdSet> &blockVec);
 
 bool containedIn(BlockId                      needleId,
-                 BlockId                      haystackId,
-                 CharIdx                      ch,
-                 const std::vector<DfaState> &stateVec,
+                 const DfaIdSet              &haystack,
                  const std::vector<DfaIdSet> &blockVec);
 
 void handleTwins(DfaId                  stateId,
@@ -12,6 +12,11 @@
    traversal of the reachable states.  They also maintain a "seen"
    set of NFA state IDs.
 
+   requiredLiteral() finds a string that every match must contain, even
+   if it's not a prefix.  It walks the dominator chain from the initial
+   state to acceptance.  A dominator whose sole transition is on a
+   single byte forces that byte; runs of these form the literal.
+
    In general NfaObj isn't directly useful, but it is used by Parser
    and Powerset.  Small tests can be composed like this:
 
@@ -33,6 +38,7 @@
 #pragma once
 
 #include <deque>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -225,6 +231,8 @@ public:
 
   void dropUselessTransitions();
 
+  std::string requiredLiteral() const; // longest one not at the start
+
   NfaIter iter(NfaId id) { return NfaIter(id, states_); }
   NfaConstIter citer(NfaId id) const { return NfaConstIter(id, states_); }
 
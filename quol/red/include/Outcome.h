@@ -16,7 +16,10 @@
    start_ is the position within the input where the DFA "escaped" its
    initial state.  This is not foolproof, but typically works well if the
    pattern is something like '.*[0-9]+', in which case start_ would indicate
-   the first digit.
+   the first digit.  If the Executable was compiled with cfReverse, start_
+   is exact instead: the leftmost position, at or after where matching
+   began, from which some pattern matches all the way through end_.  Any
+   prefix added by fLooseStart is not part of the pattern for this purpose.
 
    end_ is the last position at which the DFA was in an accepting state.
    This is quite reliable (unlike start_).  It will depend on the match style,
@@ -0,0 +1,68 @@
+/* Parallel.h - multi-threaded matching of one huge input - header
+
+   check() and matchAll() carry DFA state from each byte to the next,
+   so a single input is matched on a single core.  These functions
+   split a big input into contiguous chunks, one per thread.
+
+   Each chunk after the first begins in a state that isn't known until
+   its predecessors are done, so its thread speculates: it runs the
+   chunk from several plausible start states at once, merging walks
+   that converge.  If the DFA is small, every state is tried.
+   Otherwise, it's the error state, the initial state, and the state
+   reached by running from the initial state over the bytes just before
+   the chunk.  DFAs for realistic patterns tend to synchronize quickly,
+   so the walks usually collapse to one or two within a few hundred
+   bytes, and the extra work is small.
+
+   Then the chunk summaries are stitched together in order.  If the
+   true start state of a chunk wasn't among those tried, that chunk is
+   rerun serially, so results are always the same as single-threaded.
+
+   checkParallel() does this for styFull and styLast, which must see
+   all the input.  Other styles usually decide early, so they simply
+   call check().  matchAllParallel() stitches to learn the true start
+   state of each chunk, then reruns the chunks in parallel to collect
+   outcomes, joining any that span chunk boundaries.
+
+   Input too small to give each thread minChunk bytes uses fewer
+   threads, possibly just the caller's.  Threads are created per call.
+   The Executable is only read, so it needs no locking.
+
+   Usage is like:
+
+   Result res = checkParallel(exec, ptr, len, styLast, 8);
+ */
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "Executable.h"
+#include "Matcher.h"
+
+namespace zezax::red {
+
+constexpr size_t gParallelMinChunk = 1 << 20;
+
+// zero threads means one per hardware thread
+Result checkParallel(const Executable &exec,
+                     const void       *ptr,
+                     size_t            len,
+                     Style             style,
+                     unsigned          threads = 0,
+                     size_t            minChunk = gParallelMinChunk);
+
+Result checkParallel(const Executable &exec,
+                     std::string_view  sv,
+                     Style             style,
+                     unsigned          threads = 0,
+                     size_t            minChunk = gParallelMinChunk);
+
+size_t matchAllParallel(const Executable     &exec,
+                        std::string_view      sv,
+                        std::vector<Outcome> &out,
+                        unsigned              threads = 0,
+                        size_t                minChunk = gParallelMinChunk);
+
+} // namespace zezax::red
@@ -16,7 +16,18 @@
    Parsing is done via recursive descent.  A Budget pointer passed to
    the constructor can specify a recursion limit, as well as a limit
    on total automaton states.  A CompStats pointer can also be passed
-   in order to get parsing metrics.
+   in order to get parsing metrics.  Like these, a thread count set
+   via setThreads() is carried on to compile(), which uses that many
+   threads for powerset construction; zero means one per hardware
+   thread.
+
+   Strings given to addExact() without fLooseStart or fLooseEnd are
+   held back from the NFA for as long as nothing else is added.  If
+   the parser holds only those, compile() builds their minimal DFA
+   directly with AcyclicBuilder; otherwise they join the NFA in order
+   at the next add() or addGlob(), or at finish().  Held strings are
+   charged to the Budget as they're added, for the states they'd take
+   in the NFA, so a limit trips just as early either way.
 
    Regular expression syntax and grammar are described in doc/Usage.md
 
@@ -32,7 +43,9 @@
 
 #pragma once
 
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "Scanner.h"
 #include "Budget.h"
@@ -40,6 +53,12 @@
 
 namespace zezax::red {
 
+struct ExactString {
+  std::string str_;
+  Result      result_;
+};
+
+
 enum Language {
   langInvalid   = 0,
   langRegexRaw  = 1,
@@ -51,7 +70,7 @@ enum Language {
 class Parser {
 public:
   explicit Parser(Budget *budget = nullptr, CompStats *stats = nullptr);
-  ~Parser() = default;
+  ~Parser();
 
   // Adds a regular expression to the automaton, to yield the specified
   // positive result.  The following flags are honored:
@@ -90,15 +109,28 @@ public:
   // Must call this after all adds, before conversion to DFA.
   void finish();
 
+  // True if every add so far was an addExact() with no flags but
+  // fIgnoreCase, the same each time, and finish() hasn't been called
+  bool exactOnly() const { return exactOnly_ && !exact_.empty(); }
+  bool exactIgnoreCase() const { return (exactFlags_ & fIgnoreCase) != 0; }
+  std::vector<ExactString> takeExact(); // leaves none behind
+
   void freeAll(); // free parsed nfa
 
   NfaObj &getNfa() { return nfa_; }
   NfaId getInitial() { return nfa_.getInitial(); }
 
+  // where each added pattern begins, not counting any fLooseStart prefix
+  const NfaIdSet &getStarts() const { return starts_; }
+
   Budget    *getBudget() const { return budget_; }
   CompStats *getStats()  const { return stats_; }
 
+  void setThreads(unsigned threads) { threads_ = threads; }
+  unsigned getThreads() const { return threads_; }
+
 private:
+  void refundExact();
   NfaId parseExpr();
   NfaId parsePart();
   NfaId parseMulti();
@@ -106,6 +138,8 @@ private:
   NfaId parseCharBits();
   NfaId parseGlob(const Byte *beg, const Byte *end, size_t &tokens);
   NfaId parseClass(const Byte *&ptr, const Byte *beg, const Byte *end);
+  void buildExact(std::string_view str, Result result, Flags flags);
+  void flushExact();
 
   Flags      flags_;
   int        level_;
@@ -113,8 +147,15 @@ private:
   Token      tok_;
   Scanner    scanner_;
   NfaObj     nfa_;
+  NfaIdSet   starts_;
   Budget    *budget_;
   CompStats *stats_;
+  unsigned   threads_;
+  bool       exactOnly_;
+  Flags      exactFlags_;
+  size_t     exactStates_; // charged to budget_ for exact_
+
+  std::vector<ExactString> exact_; // not yet in the nfa
 };
 
 } // namespace zezax::red
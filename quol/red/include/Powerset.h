@@ -26,9 +26,20 @@
    If a Budget is supplied, it will be honored.  Also, a CompStats
    object can be given, if statistics are desired.
 
+   The DFA is numbered from an NfaSetStore, which holds each set of
+   NFA states found just once, as a compact run of IDs, and lets the
+   rest of the conversion refer to it by a 32-bit number.
+
+   Given more than one thread (zero means one per hardware thread),
+   makeTable() expands rows of the table concurrently.  The rows live
+   in shards, each under its own lock, so interning a new set of NFA
+   states rarely waits.  Each thread keeps a queue of rows to expand
+   and takes work from the others' queues when its own runs dry.  The
+   finished table, and so the DFA, is the same as with one thread.
+
    Usage is like this:
 
-   PowersetConverter power(nfa, budget, stats);
+   PowersetConverter power(nfa, budget, stats, threads);
    DfaObj dfa = power.convert();
 
    PowersetConverter can throw RedExceptCompile for internal errors.
@@ -37,6 +48,8 @@
 #pragma once
 
 #include <map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "Budget.h"
@@ -64,45 +77,84 @@ typedef std::unordered_map<NfaId, size_t> NfaIdToCount;
 typedef std::unordered_map<NfaIdSet, DfaId> NfaStatesToId;
 
 
+// NfaSetStore keeps each distinct set of NFA states just once, as a
+// sorted run of IDs in one arena, and numbers them densely from zero
+// in the order they're first seen.  A bitset spans every ID up to the
+// largest it holds, which for a big NFA is kilobytes per set, but a
+// run only costs what it contains.  Not copyable, as the index points
+// back at the store.
+typedef uint32_t NfaSetId;
+
+class NfaSetStore {
+public:
+  NfaSetStore();
+  NfaSetStore(const NfaSetStore &) = delete;
+  NfaSetStore &operator=(const NfaSetStore &) = delete;
+
+  // returns the number of the set, and whether it's newly added
+  std::pair<NfaSetId, bool> intern(const NfaIdSet &nis);
+
+  size_t size() const { return hashes_.size(); }
+  const NfaId *begin(NfaSetId id) const {
+    return arena_.data() + offsets_[id];
+  }
+  const NfaId *end(NfaSetId id) const {
+    return arena_.data() + offsets_[id + 1];
+  }
+  NfaIdSet get(NfaSetId id) const;
+
+private:
+  struct Hasher {
+    size_t operator()(NfaSetId id) const { return store_->hashes_[id]; }
+    const NfaSetStore *store_;
+  };
+
+  struct Equal {
+    bool operator()(NfaSetId aa, NfaSetId bb) const;
+    const NfaSetStore *store_;
+  };
+
+  std::vector<NfaId>                           arena_;
+  std::vector<size_t>                          offsets_; // one extra
+  std::vector<size_t>                          hashes_;
+  std::unordered_set<NfaSetId, Hasher, Equal>  index_;
+};
+
+
 // Main class that converts NFA to DFA via Rabin-Scott
 class PowersetConverter {
 public:
   explicit PowersetConverter(const NfaObj &input,
-                             Budget       *budget = nullptr,
-                             CompStats    *stats  = nullptr)
-    : nfa_(input), budget_(budget), stats_(stats) {}
+                             Budget       *budget  = nullptr,
+                             CompStats    *stats   = nullptr,
+                             unsigned      threads = 1)
+    : nfa_(input), budget_(budget), stats_(stats), threads_(threads) {}
 
   DfaObj convert();
 
 private:
-  DfaId dfaFromNfa(const std::vector<MultiChar> &multiChars,
-                   const NfaStatesToTransitions &table,
-                   const NfaIdToCount           &counts,
-                   const NfaIdSet               &states,
-                   DfaObj                       &dfa);
-
   const NfaObj &nfa_;
   Budget       *budget_;
   CompStats    *stats_;
+  unsigned      threads_;
 };
 
 
 // constituent functions, public for unit tests
 MultiCharSet basisMultiChars(const MultiCharSet &mcs);
 
+// allMultiChars must be an exact basis for the transitions reachable
+// from initial, as from basisMultiChars(); throws RedExceptCompile if
+// they overlap or such a transition splits one
 NfaStatesToTransitions makeTable(NfaId                         initial,
                                  const NfaObj                 &nfa,
-                                 const std::vector<MultiChar> &allMultiChars);
-
-NfaIdToCount countAcceptingStates(const NfaStatesToTransitions &table,
-                                  const NfaObj                 &nfa);
-
-DfaId dfaFromNfaRecurse(const std::vector<MultiChar> &multiChars,
-                        const NfaStatesToTransitions &table,
-                        const NfaIdToCount           &counts,
-                        const NfaIdSet               &stateSet,
-                        NfaStatesToId                &map,
-                        const NfaObj                 &nfa,
-                        DfaObj                       &dfa);
+                                 const std::vector<MultiChar> &allMultiChars,
+                                 unsigned                      threads = 1);
+
+DfaId dfaFromTable(const std::vector<MultiChar> &multiChars,
+                   NfaStatesToTransitions       &table,
+                   NfaId                         initial,
+                   const NfaObj                 &nfa,
+                   DfaObj                       &dfa);
 
 } // namespace zezax::red
@@ -0,0 +1,74 @@
+/* Prefilter.h - multi-literal prefilter for pattern sets - header
+
+   A set of patterns with different literal prefixes has no leader,
+   since DfaObj::fixedPrefix() only finds a single shared prefix.  But
+   every match must still begin with one of a small set of short
+   literals: the first two or three bytes of each pattern.  At compile
+   time, DfaObj::prefixLiterals() enumerates those, and they are saved
+   in the serialized program as the secPrefilter section.
+
+   Prefilter finds the next position where one of those literals
+   occurs.  It's the Teddy approach from Hyperscan: literals are sorted
+   and divided among eight buckets.  For each byte position within the
+   literals, two 16-entry tables indexed by low and high nibble give
+   a bit per bucket that has a literal with that nibble there.  Looking
+   up each input byte and ANDing across positions leaves a bit set only
+   where some bucket may match.  With AVX2 or SSSE3 that's done 32 or
+   16 positions at a time by byte shuffles.  Hits are verified exactly
+   against the sorted literals, so find() never returns a false
+   positive, and the DFA only runs where a match may start.
+
+   The section payload is a 32-bit width, a 32-bit count, and the
+   literals, each exactly width bytes, in sorted order.
+
+   Usage is like:
+
+   Prefilter pf(findSection(ptr, len, secPrefilter));
+   if (pf.active())
+     ptr = pf.find(ptr, end);
+
+   Prefilter throws RedExceptApi if the section is corrupted.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+
+namespace zezax::red {
+
+class Prefilter {
+public:
+  Prefilter(); // inactive, never skips
+  explicit Prefilter(std::string_view section); // empty means inactive
+
+  // builds section payload; literals must be unique and of equal length
+  static std::string encode(const std::vector<std::string> &literals);
+
+  bool active() const { return (width_ > 0); }
+  size_t width() const { return width_; }
+  size_t size() const { return keys_.size(); }
+
+  // returns first position in [ptr, end) where a literal occurs, or end
+  const Byte *find(const Byte *ptr, const Byte *end) const;
+
+  // as above, for null-terminated input, returning the terminator if none
+  const Byte *find(const Byte *ptr) const;
+
+private:
+  static constexpr size_t maxWidth_ = 3;
+  static constexpr size_t buckets_ = 8;
+
+  uint8_t candidates(const Byte *ptr) const; // bucket bits, scalar
+  bool verify(const Byte *ptr) const;
+
+  uint8_t               lo_[maxWidth_][16]; // bucket bits by low nibble
+  uint8_t               hi_[maxWidth_][16]; // bucket bits by high nibble
+  std::vector<uint32_t> keys_;              // sorted, little-endian packed
+  size_t                width_;
+};
+
+} // namespace zezax::red
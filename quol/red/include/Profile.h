@@ -0,0 +1,52 @@
+/* Profile.h - counts DFA state visits over a corpus - header
+
+   A big DFA spends most of its time in a small fraction of its
+   states, but Serializer lays states out by id, so the hot ones are
+   scattered through the table and each step may touch a new cache
+   line.  Profiler runs an Executable over sample input, the way
+   check() does, counting how often each state is visited.
+
+   The counts are per state, in the order the states are laid out in
+   the Executable.  Handing them back to the Serializer that produced
+   that layout, via Serializer::setVisits(), makes its next
+   serialization pack the hot states together; see Serializer.h.  The
+   compile() overload taking a corpus in Compile.h does all this.
+
+   Usage is like:
+
+   Profiler prof(exec);
+   for (const std::string &line : corpus)
+     prof.run(line);
+   ser.setVisits(prof.visits());
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Executable.h"
+
+namespace zezax::red {
+
+class Profiler {
+public:
+  explicit Profiler(const Executable &exec);
+
+  // steps from the initial state through the input, up to a dead end
+  void run(const void *ptr, size_t len);
+  void run(std::string_view sv) { run(sv.data(), sv.size()); }
+
+  // per state, in serialized order
+  const std::vector<uint64_t> &visits() const { return visits_; }
+
+private:
+  template <Format fmt> void runCore(const Byte *ptr, const Byte *end);
+
+  const Executable      &exec_;
+  std::vector<uint64_t>  visits_;
+  size_t                 stateSize_;
+};
+
+} // namespace zezax::red
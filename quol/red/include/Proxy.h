@@ -9,6 +9,12 @@
    Serializer also uses DfaProxy to emit multiple formats from one
    piece of code.
 
+   Serializer puts the special states, those that accept, dead-end,
+   accelerate, or are initial, ahead of all the plain ones.  So the
+   transition offset alone tells whether a step lands on a special
+   state, and walk() can run through plain states four bytes per
+   iteration, without reading their result words.
+
    Factoring code this way reduces the number of lines of code
    without sacrificing run-time performace.  It also prevents
    divergence in behavior and provides fewer places where bugs can
@@ -17,12 +23,15 @@
 
 #pragma once
 
+#include <cstring>
 #include <string>
 #include <string_view>
 
 #include "Consts.h"
 #include "Except.h"
 #include "Serializer.h"
+#include "Skipper.h"
+#include "Prefilter.h"
 
 namespace zezax::red {
 
@@ -45,6 +54,64 @@ public:
   const Byte *ptr() const { return ptr_; }
   void operator=(const Byte *p) { ptr_ = p; }
 
+  // where the input ends, found the slow way
+  const Byte *end() const {
+    return ptr_ + strlen(reinterpret_cast<const char *>(ptr_));
+  }
+
+  // true if lit occurs anywhere from here on
+  bool contains(const std::string &lit) const {
+    const char *str = reinterpret_cast<const char *>(ptr_);
+    return (strstr(str, lit.c_str()) != nullptr);
+  }
+
+  // advances to next byte in skipper's set, returns distance moved
+  size_t skip(const Skipper &sk) {
+    if (sk.contains(*ptr_))
+      return 0;
+    const Byte *p = sk.find(ptr_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // moves to just before the next byte after this one in skipper's set,
+  // so ++ lands on it; returns distance moved
+  size_t skipPast(const Skipper &sk) {
+    const Byte *p = sk.find(ptr_ + 1) - 1;
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // steps dfap while it stays among plain states; returns distance moved
+  template <class DfaProxyT>
+  size_t walk(DfaProxyT  &dfap,
+              const char *base,
+              const Byte *equivMap,
+              size_t      plainOff) {
+    const Byte *p = dfap.walk(base, equivMap, ptr_, plainOff);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // advances to next place the leader may start, returns distance moved
+  size_t skip(const LeaderFinder &lf) {
+    const Byte *p = lf.find(ptr_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // advances to next place a prefilter literal occurs, returns distance moved
+  size_t skip(const Prefilter &pf) {
+    const Byte *p = pf.find(ptr_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
 private:
   const Byte *__restrict__ ptr_;
 };
@@ -67,6 +134,61 @@ public:
   const Byte *ptr() const { return ptr_; }
   void operator=(const Byte *p) { ptr_ = p; }
 
+  const Byte *end() const { return end_; }
+
+  // true if lit occurs anywhere from here on
+  bool contains(const std::string &lit) const {
+    return (memmem(ptr_, static_cast<size_t>(end_ - ptr_),
+                   lit.data(), lit.size()) != nullptr);
+  }
+
+  // advances to next byte in skipper's set, returns distance moved
+  size_t skip(const Skipper &sk) {
+    if ((ptr_ >= end_) || sk.contains(*ptr_))
+      return 0;
+    const Byte *p = sk.find(ptr_, end_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // moves to just before the next byte after this one in skipper's set,
+  // so ++ lands on it; returns distance moved
+  size_t skipPast(const Skipper &sk) {
+    const Byte *p = sk.find(ptr_ + 1, end_) - 1;
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // steps dfap while it stays among plain states; returns distance moved
+  template <class DfaProxyT>
+  size_t walk(DfaProxyT  &dfap,
+              const char *base,
+              const Byte *equivMap,
+              size_t      plainOff) {
+    const Byte *p = dfap.walk(base, equivMap, ptr_, end_, plainOff);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // advances to next place the leader may start, returns distance moved
+  size_t skip(const LeaderFinder &lf) {
+    const Byte *p = lf.find(ptr_, end_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
+  // advances to next place a prefilter literal occurs, returns distance moved
+  size_t skip(const Prefilter &pf) {
+    const Byte *p = pf.find(ptr_, end_);
+    size_t rv = static_cast<size_t>(p - ptr_);
+    ptr_ = p;
+    return rv;
+  }
+
 private:
   const Byte *__restrict__ ptr_;
   const Byte *__restrict__ end_;
@@ -84,10 +206,14 @@ template <> struct DfaDefs<fmtDirect1> {
   typedef StateDirect1 State;
   typedef uint8_t      Value;
 
-  static constexpr Value  resultMask_   = 0x7f;
-  static constexpr Result maxResult_    = 0x7f;
+  static constexpr Value  resultMask_   = 0x3f;
+  static constexpr Result maxResult_    = 0x3f;
   static constexpr size_t maxOffset_    = 0xff;
+  static constexpr int    accelShift_   = 6;
   static constexpr int    deadEndShift_ = 7;
+  static constexpr bool   mapped_       = true;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = sizeof(Value);
 };
 
 
@@ -95,10 +221,14 @@ template <> struct DfaDefs<fmtDirect2> {
   typedef StateDirect2 State;
   typedef uint16_t     Value;
 
-  static constexpr Value  resultMask_   = 0x7fff;
-  static constexpr Result maxResult_    = 0x7fff;
+  static constexpr Value  resultMask_   = 0x3fff;
+  static constexpr Result maxResult_    = 0x3fff;
   static constexpr size_t maxOffset_    = 0xffff;
+  static constexpr int    accelShift_   = 14;
   static constexpr int    deadEndShift_ = 15;
+  static constexpr bool   mapped_       = true;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = sizeof(Value);
 };
 
 
@@ -106,13 +236,104 @@ template <> struct DfaDefs<fmtDirect4> {
   typedef StateDirect4 State;
   typedef uint32_t     Value;
 
-  static constexpr Value  resultMask_   = 0x7fffffff;
-  static constexpr Result maxResult_    = 0x7fffffff;
+  static constexpr Value  resultMask_   = 0x3fffffff;
+  static constexpr Result maxResult_    = 0x3fffffff;
+  static constexpr size_t maxOffset_    = 0xffffffff;
+  static constexpr int    accelShift_   = 30;
+  static constexpr int    deadEndShift_ = 31;
+  static constexpr bool   mapped_       = true;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = sizeof(Value);
+};
+
+
+template <> struct DfaDefs<fmtDirect8> {
+  typedef StateDirect8 State;
+  typedef uint64_t     Value;
+
+  static constexpr Value  resultMask_   = 0x3fffffffffffffff;
+  static constexpr Result maxResult_    = 0x7fffffff; // all of Result
+  static constexpr size_t maxOffset_    = 0xffffffffffffffff;
+  static constexpr int    accelShift_   = 62;
+  static constexpr int    deadEndShift_ = 63;
+  static constexpr bool   mapped_       = true;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = sizeof(Value);
+};
+
+
+template <> struct DfaDefs<fmtFlat2> {
+  typedef StateDirect2 State;
+  typedef uint16_t     Value;
+
+  static constexpr Value  resultMask_   = 0x3fff;
+  static constexpr Result maxResult_    = 0x3fff;
+  static constexpr size_t maxOffset_    = 0xffff;
+  static constexpr int    accelShift_   = 14;
+  static constexpr int    deadEndShift_ = 15;
+  static constexpr bool   mapped_       = false;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = 1;
+};
+
+
+template <> struct DfaDefs<fmtFlat4> {
+  typedef StateDirect4 State;
+  typedef uint32_t     Value;
+
+  static constexpr Value  resultMask_   = 0x3fffffff;
+  static constexpr Result maxResult_    = 0x3fffffff;
   static constexpr size_t maxOffset_    = 0xffffffff;
+  static constexpr int    accelShift_   = 30;
   static constexpr int    deadEndShift_ = 31;
+  static constexpr bool   mapped_       = false;
+  static constexpr bool   inline_       = true;
+  static constexpr size_t scale_        = 1;
 };
 
 
+template <> struct DfaDefs<fmtComb4> {
+  typedef StateComb4 State;
+  typedef uint32_t   Value;
+
+  static constexpr Value  resultMask_   = 0x3fffffff;
+  static constexpr Result maxResult_    = 0x3fffffff;
+  static constexpr size_t maxOffset_    = 0xffffffff;
+  static constexpr int    accelShift_   = 30;
+  static constexpr int    deadEndShift_ = 31;
+  static constexpr bool   mapped_       = true;
+  static constexpr bool   inline_       = false; // transitions in the comb
+  static constexpr size_t scale_        = 1;
+};
+
+
+// where the transition on byte is stored: in the row, or in the comb
+template <class StateT>
+const void *transAddr(const StateT *st, size_t byte) {
+  return &st->offsets_[byte];
+}
+
+
+inline const void *transAddr(const StateComb4 *st, size_t byte) {
+  return reinterpret_cast<const char *>(st) + st->row_ +
+    (byte * sizeof(CombEntry));
+}
+
+
+// byte offset from base of the next state
+template <class StateT>
+size_t transOf(const StateT *st, size_t byte, size_t scale) {
+  return st->offsets_[byte] * scale;
+}
+
+
+inline size_t transOf(const StateComb4 *st, size_t byte, size_t) {
+  const CombEntry *ent =
+    static_cast<const CombEntry *>(transAddr(st, byte));
+  return (ent->owner_ == st->self_) ? ent->next_ : st->default_;
+}
+
+
 template <Format fmt>
 class DfaProxy {
 public:
@@ -122,14 +343,23 @@ public:
   static constexpr Value  resultMask_   = DfaDefs<fmt>::resultMask_;
   static constexpr Result maxResult_    = DfaDefs<fmt>::maxResult_;
   static constexpr size_t maxOffset_    = DfaDefs<fmt>::maxOffset_;
+  static constexpr int    accelShift_   = DfaDefs<fmt>::accelShift_;
   static constexpr int    deadEndShift_ = DfaDefs<fmt>::deadEndShift_;
+  static constexpr bool   mapped_       = DfaDefs<fmt>::mapped_;
+  static constexpr bool   inline_       = DfaDefs<fmt>::inline_;
+  static constexpr size_t scale_        = DfaDefs<fmt>::scale_;
+
+  // returns the transition column for an input byte
+  static Byte column(const Byte *equivMap, Byte raw) {
+    return mapped_ ? equivMap[raw] : raw;
+  }
 
   void init(const char *base, size_t offset) {
     state_ = reinterpret_cast<const State *>(base + offset);
   }
 
   Result result() const {
-    return state_->resultAndDeadEnd_ & resultMask_;
+    return static_cast<Result>(state_->resultAndDeadEnd_ & resultMask_);
   }
 
   bool deadEnd() const {
@@ -137,15 +367,69 @@ public:
   }
 
   bool pureDeadEnd() const {
-    return (state_->resultAndDeadEnd_ == (1u << deadEndShift_));
+    return (state_->resultAndDeadEnd_ == (Value{1} << deadEndShift_));
+  }
+
+  // loops back on all but a few bytes; see Accelerator in Skipper.h
+  bool accel() const {
+    return (state_->resultAndDeadEnd_ >> accelShift_) & 1;
   }
 
   size_t trans(size_t byte) const {
-    return state_->offsets_[byte] * sizeof(Value);
+    return transOf(state_, byte, scale_);
   }
 
   void next(const char *base, size_t byte) { init(base, trans(byte)); }
 
+  // steps unless that would land below plainOff, among the special states
+  bool nextPlain(const char *base, size_t byte, size_t plainOff) {
+    size_t off = trans(byte);
+    if (UNLIKELY(off < plainOff))
+      return false;
+    init(base, off);
+    return true;
+  }
+
+  // steps through [ptr, end) until a special state is next, unrolled;
+  // returns the byte that leads to it, or end
+  const Byte *walk(const char *base,
+                   const Byte *equivMap,
+                   const Byte *ptr,
+                   const Byte *end,
+                   size_t      plainOff) {
+    for (; (end - ptr) >= 4; ptr += 4) {
+      if (!nextPlain(base, column(equivMap, ptr[0]), plainOff))
+        return ptr;
+      if (!nextPlain(base, column(equivMap, ptr[1]), plainOff))
+        return ptr + 1;
+      if (!nextPlain(base, column(equivMap, ptr[2]), plainOff))
+        return ptr + 2;
+      if (!nextPlain(base, column(equivMap, ptr[3]), plainOff))
+        return ptr + 3;
+    }
+    for (; ptr < end; ++ptr)
+      if (!nextPlain(base, column(equivMap, *ptr), plainOff))
+        break;
+    return ptr;
+  }
+
+  // as above, for null-terminated input
+  const Byte *walk(const char *base,
+                   const Byte *equivMap,
+                   const Byte *ptr,
+                   size_t      plainOff) {
+    for (; *ptr; ++ptr)
+      if (!nextPlain(base, column(equivMap, *ptr), plainOff))
+        break;
+    return ptr;
+  }
+
+  // hints that result() and then trans(byte) will be needed soon
+  void prefetch(size_t byte) const {
+    __builtin_prefetch(state_);
+    __builtin_prefetch(transAddr(state_, byte));
+  }
+
   const State *state() const { return state_; }
 
   void restore(const void *ptr) { state_ = static_cast<const State *>(ptr); }
@@ -155,8 +439,7 @@ public:
   }
 
   static bool offsetFits(CharIdx maxChar, size_t numStates) {
-    // !!! assume result is same size as transition entries
-    size_t tot = (numStates * maxChar) + numStates + numStates;
+    size_t tot = (numStates * stateSize(maxChar)) / scale_;
     return (tot <= maxOffset_);
   }
 
@@ -167,20 +450,25 @@ public:
       throw RedExceptLimit("dfa too big for format");
   }
 
+  // flat formats have a column for every byte, regardless of maxChar;
+  // comb formats keep transitions apart, so states are all header
   static size_t stateSize(CharIdx maxChar) {
-    return sizeof(State) + (sizeof(Value) * maxChar) + sizeof(Value);
+    size_t cols = mapped_ ? static_cast<size_t>(maxChar) + 1 : gAlphabetSize;
+    return sizeof(State) + (inline_ ? (sizeof(Value) * cols) : 0);
   }
 
   static void appendOffset(std::string &buf, size_t off) {
-    off /= sizeof(Value);
+    off /= scale_;
     if (off > maxOffset_)
       throw RedExceptSerialize("overflow in appendOffset");
     Value raw = static_cast<Value>(off);
     buf.append(reinterpret_cast<const char *>(&raw), sizeof(raw));
   }
 
-  static Value resultAndDeadEnd(Result res, bool de) {
-    return static_cast<Value>((res & resultMask_) | (de << deadEndShift_));
+  static Value resultAndDeadEnd(Result res, bool de, bool acc) {
+    return static_cast<Value>((res & resultMask_) |
+                              (static_cast<Value>(acc) << accelShift_) |
+                              (static_cast<Value>(de) << deadEndShift_));
   }
 
 private:
@@ -20,6 +20,12 @@
      Red re("[0-9]+");
      Outcome oc = re.matchFull("0123456789");
 
+   Regexes given as strings are compiled along with an unanchored
+   companion DFA (see Compile.h), so that searching, collecting and
+   replacing reject non-matching text in one linear pass.  Power users
+   passing a Parser get a plain compile; they can call compile() with
+   the options they want and pass the serialized result instead.
+
    Most calls to Red functions may throw RedExcept.
 
    Orthogonal Naming:
@@ -106,7 +112,7 @@ public:
   Red(const FreeTag &, const void *prog, size_t len);
   Red(const UnownedTag &, std::string_view prog);
   Red(const UnownedTag &, const void *prog, size_t len);
-  Red(const PathTag &, const char *path);
+  Red(const PathTag &, const char *path); // maps the file, shared
 
   void save(const char *path) const;
   std::string_view serialized() const { return program_.serialized(); }
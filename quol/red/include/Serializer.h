@@ -7,12 +7,68 @@
    in Matcher.
 
    The DFA passed in should already be minimized and have a map
-   of character equivalence classes.  If fmtDirectAuto is used,
-   the code will use the smallest format that can represent the
-   DFA.
+   of character equivalence classes.  The direct formats have a
+   transition per equivalence class, so each step first looks up the
+   input byte in the map.  The flat formats instead have a transition
+   per raw byte, holding the byte offset of the next state, so a step
+   is just two loads.  Their rows are much bigger.  If fmtDirectAuto
+   is used, the code picks the smallest direct format that can
+   represent the DFA, unless a flat table would fit in gFlatBudget,
+   roughly what stays in cache, and be at most gFlatGrowth times as
+   big.  So flat is chosen only when there are many classes, since
+   for few classes the equivalence map costs less than the bloat.  fmtDirect8
+   exists for tables past 4GB; auto picks it only when nothing else
+   will do.
+
+   The top two bits of each state's result word flag accel and dead
+   ends, so the biggest result is 63 for fmtDirect1, 16383 for the
+   2-byte formats, and 2^30-1 for the 4-byte ones.  A format asked for
+   by name throws RedExceptLimit if a result won't fit, while auto
+   moves on to a wider format.
+
+   The comb format is for DFAs too big for that.  Each state has a
+   fixed-size record with a default next state, typically the error
+   state or itself.  Only transitions that differ from the default
+   are stored, in a single comb of entries shared by all states: the
+   rows are overlaid so that a state's exceptions fill holes left by
+   others, and each entry names its owner so a step can tell whether
+   it belongs.  Space is then bounded by the non-default transitions
+   rather than states times classes, at the cost of one compare and
+   a branch per byte.  Auto picks it only for huge, sparse tables.
 
    Functions are provided to load and validate serialized DFAs.
-   A checksum protects the DFA from corruption.
+   A checksum protects the DFA from corruption.  The header has 64-bit
+   counts and offsets as of major version 2.  upgradeFromV1() rewrites
+   a version 1 buffer in the current layout, as loadFromFile() and the
+   Executable constructors that take a string do on their own.
+   checkHeader() itself rejects version 1, so where the buffer can't
+   be rewritten, as when mapping a file, upgrade the file once and
+   save it again.  As of version 2.1, the checksum is CRC-32C, which
+   is many times faster than the FNV-1a of 2.0; see Crc.h.  Both are
+   still accepted.  checkHeader() can skip the checksum, leaving only
+   the cheap structural checks, for callers who verify it later or
+   trust the source; see Executable.h.
+
+   A serialized DFA may carry companion programs in optional sections
+   appended after its states.  Most sections are complete serialized
+   DFAs in their own right, such as the unanchored (dot-star prefixed)
+   version of the main DFA, which Matcher uses to reject inputs in a
+   single pass, or the reversed DFA, which Matcher runs backward from
+   the end of a match to find its start.  The prefilter section is
+   instead a table of literals; see Prefilter.h.  The required section
+   is just a literal that every match contains.  The accel section
+   lists states that loop back to themselves on all but a few bytes,
+   along with those escape bytes.  Such states are also flagged in
+   their result word, so matching can skip ahead; see Skipper.h.
+   The header's sectionOff_ locates the first section; the rest follow
+   contiguously through the end of the buffer.
+
+   States are laid out by id, special ones first; see Proxy.h.  Given
+   visit counts from Profiler for the previous serialization, the next
+   one instead orders each group hottest first, so the states a
+   workload lives in share cache lines.  States never visited follow
+   in breadth-first order from the initial state, keeping neighbors
+   near each other.  This is profile-guided optimization of the table.
 
    Usage is like:
 
@@ -25,6 +81,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "Types.h"
 #include "Dfa.h"
@@ -36,47 +94,100 @@ enum Format : uint8_t {
   fmtDirect1    = 1,
   fmtDirect2    = 2,
   fmtDirect4    = 4,
+  fmtDirect8    = 8, // for tables beyond 4GB
+  fmtFlat2      = 18, // full rows indexed by raw byte, offsets in bytes
+  fmtFlat4      = 20,
+  fmtComb4      = 36, // fixed-size states, transitions in a shared comb
   fmtDirectAuto = 255,
 };
 
+constexpr uint16_t gFileMajVer = 2; // 64-bit offsets in header and sections
+constexpr uint16_t gFileMinVer = 1; // CRC-32C checksum
+
+constexpr int gMaxEscapes = 16; // most bytes leaving an accelerated state
+constexpr size_t gFlatBudget = 256 << 10; // biggest flat table auto picks
+constexpr size_t gFlatGrowth = 4; // most times bigger than direct it may be
+constexpr size_t gCombMinBytes = 64 << 20; // smallest rows auto compresses
+
+enum Section : uint32_t {
+  secInvalid    = 0,
+  secUnanchored = 1, // dfa for .*(regex), finds earliest match end
+  secReverse    = 2, // dfa for reversed regex, finds exact match start
+  secPrefilter  = 3, // literals that begin every match, see Prefilter.h
+  secRequired   = 4, // raw bytes that every match contains somewhere
+  secAccel      = 5, // escape bytes of self-looping states, see Skipper.h
+  secStarts     = 6, // dfa for .*(reversed regex), finds every match start
+};
+
 struct FileHeader {
   uint8_t  magic_[4]; // "REDA"
   uint16_t majVer_;
   uint16_t minVer_;
-  uint32_t checksum_; // FNV-1a of all that follows
+  uint32_t checksum_; // CRC-32C of all that follows, FNV-1a before 2.1
   uint8_t  format_;
   uint8_t  maxChar_;
   uint8_t  leaderLen_; // leader is a fixed prefix required by the dfa
   uint8_t  pad0_;
-  uint32_t stateCnt_;
-  uint32_t initialOff_;
-  uint32_t leaderOff_; // state after leader match
-  uint32_t pad1_;
+  uint64_t stateCnt_;
+  uint64_t initialOff_;
+  uint64_t leaderOff_; // state after leader match
+  uint64_t sectionOff_; // first section from start of header, or zero
+  uint64_t plainOff_; // states before this offset are special, see Proxy.h
   uint8_t  equivMap_[256];
+  uint8_t  startSet_[32]; // bitmap of bytes that escape initial state alive
   uint8_t  bytes_[0]; // gcc-ism; offsets start after leader
   // leader, if any, goes first, padded to 8-byte alignment
   // next, all the states in id order, as per format
+  // finally, any sections, each padded to 8-byte alignment
+};
+
+
+struct SectionHeader {
+  uint32_t kind_; // from Section enum
+  uint32_t pad_;
+  uint64_t len_;  // of the embedded serialized dfa, before padding
+  uint8_t  bytes_[0]; // gcc-ism; embedded serialized dfa follows
 };
 
 
 struct StateDirect1 {
-  uint8_t resultAndDeadEnd_; // low 7 bits are result
+  uint8_t resultAndDeadEnd_; // low 6 bits are result, then accel, dead end
   uint8_t offsets_[0]; // gcc-ism
 };
 
 
 struct StateDirect2 {
-  uint16_t resultAndDeadEnd_; // low 15 bits are result
+  uint16_t resultAndDeadEnd_; // low 14 bits result, then accel, dead end
   uint16_t offsets_[0]; // gcc-ism
 };
 
 
 struct StateDirect4 {
-  uint32_t resultAndDeadEnd_; // low 31 bits are result
+  uint32_t resultAndDeadEnd_; // low 30 bits result, then accel, dead end
   uint32_t offsets_[0]; // gcc-ism
 };
 
 
+struct StateDirect8 {
+  uint64_t resultAndDeadEnd_; // low 62 bits result, then accel, dead end
+  uint64_t offsets_[0]; // gcc-ism
+};
+
+
+struct StateComb4 {
+  uint32_t resultAndDeadEnd_; // low 30 bits result, then accel, dead end
+  uint32_t default_; // offset of next state for bytes without an entry
+  uint32_t row_;     // distance from here to the comb entry for byte zero
+  uint32_t self_;    // own offset, which marks entries as belonging here
+};
+
+
+struct CombEntry {
+  uint32_t owner_; // offset of state whose row has this entry, else ~0
+  uint32_t next_;  // offset of next state
+};
+
+
 class Serializer {
 public:
   explicit Serializer(const DfaObj &dfa, CompStats *stats = nullptr);
@@ -84,14 +195,27 @@ public:
   std::string serializeToString(Format fmt);
   void serializeToFile(Format fmt, const char *path);
 
+  // per state, in the order of the last serialization; see Profile.h
+  void setVisits(const std::vector<uint64_t> &visits);
+
 private:
   void prepareToSerialize();
   Format validatedFormat(Format fmt);
   Format optimalFormat();
   std::string serialize(Format fmt);
   void populateHeader(FileHeader &hdr, Format fmt);
-  void appendState(Format fmt, std::string &buf, const DfaState &ds);
+  void appendState(Format          fmt,
+                   std::string    &buf,
+                   const DfaState &ds,
+                   bool            accel);
+  bool findEscapes(DfaId id, uint8_t *bitmap) const;
+  void findDefaults(std::vector<std::vector<CharIdx>> *exceptions);
+  size_t countExceptions();
+  void packComb();
+  void appendCombState(std::string &buf, DfaId id, bool accel);
   void tabulateOffsets(Format fmt);
+  void orderByVisits(size_t numSpecial);
+  bool isSpecial(DfaId id) const;
   size_t measureState(Format fmt, const DfaState &ds) const;
   void findMaxChar();
 
@@ -101,12 +225,24 @@ private:
   DfaId                leaderNext_;
   std::string          leader_;
   std::vector<size_t>  offsets_;
+  std::vector<DfaId>   order_; // of states in the serialized form
+  std::vector<DfaId>   combDefault_; // per state, most common target
+  std::vector<size_t>  combBase_;    // per state, comb index of byte zero
+  std::vector<CombEntry> comb_;
+  std::vector<uint64_t> visits_; // per state id, empty if no profile
+  size_t               plainOff_;
   CompStats           *stats_;
 };
 
 
-std::string loadFromFile(const char *path);
-const char *checkHeader(const void *ptr, size_t len); // returns msg if bad
-uint32_t calcChecksum(const void *ptr, size_t len);
+std::string loadFromFile(const char *path); // upgrades version 1
+bool isVersion1(const void *ptr, size_t len);
+std::string upgradeFromV1(std::string_view buf); // to the current version
+void appendSection(std::string &prog, Section kind, const std::string &sub);
+std::string_view findSection(const void *ptr, size_t len, Section kind);
+// these return a message if bad, else null
+const char *checkHeader(const void *ptr, size_t len, bool sum = true);
+const char *checkChecksum(const void *ptr, size_t len);
+uint32_t calcChecksum(const void *ptr, size_t len); // as per header version
 
 } // namespace zezax::red
@@ -0,0 +1,119 @@
+/* Skipper.h - fast skipping over uninteresting bytes - header
+
+   Most positions tried by a sliding-window search fail on the very
+   first byte, because it leads from the initial DFA state straight to
+   the error state.  Serializer records the set of bytes that do not
+   do that in FileHeader::startSet_.  Skipper uses that set to find
+   the next position worth trying without stepping the DFA at all.
+
+   When built with -march=native (as the optimized modes are), the
+   search is vectorized.  AVX2 handles any set via nibble lookup
+   tables, 32 bytes at a time.  Failing that, SSE4.2 handles sets of
+   up to 16 bytes via PCMPESTRI.  Otherwise, a scalar loop is used.
+   Null-terminated input is always scanned by the scalar loop, since
+   vector loads could stray past the terminator.
+
+   LeaderFinder does a similar job when the DFA has a leader, i.e. a
+   fixed prefix.  The leader is stored as equivalence classes, so it's
+   first translated back to raw bytes.  If that's unambiguous, memmem()
+   or strstr() finds candidate offsets; these are vectorized in glibc.
+   Otherwise, the rarest leader byte that is unambiguous is sought via
+   memchr() or strchr().  Candidates must still be verified.
+
+   Accelerator applies Skipper to states other than the initial one.
+   DFAs from fLooseStart or fLooseEnd patterns spend most of their time
+   in states that loop back to themselves on nearly every byte.  For
+   each state whose few "escape" bytes lead elsewhere, Serializer sets
+   an accel flag in the state and records the escape bytes in the
+   secAccel section.  On reaching a flagged state, Matcher looks up its
+   Skipper here and jumps to the next escape byte, since the bytes in
+   between would leave the state, and so the outcome, unchanged.  The
+   payload is a sequence of records, each a 64-bit state offset from
+   the first state and a 32-byte bitmap, in order of offset.
+
+   Usage is like:
+
+   Skipper skip(hdr->startSet_);
+   if (skip.active())
+     ptr = skip.find(ptr, end);
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Types.h"
+
+namespace zezax::red {
+
+class Skipper {
+public:
+  Skipper(); // inactive, never skips
+  explicit Skipper(const uint8_t *bitmap); // 32 bytes, bit per byte value
+
+  // false if every byte is a member, so skipping is pointless
+  bool active() const { return active_; }
+
+  bool contains(Byte b) const { return (bitmap_[b >> 3] >> (b & 7)) & 1; }
+
+  // returns first position in [ptr, end) holding a member, or end
+  const Byte *find(const Byte *ptr, const Byte *end) const;
+
+  // as above, for null-terminated input; the terminator is a member
+  const Byte *find(const Byte *ptr) const;
+
+private:
+  uint8_t bitmap_[32];
+  uint8_t loTab_[16];  // bit h of [lo] set if (h << 4 | lo) is a member
+  uint8_t hiTab_[16];  // same, for h + 8
+  uint8_t needle_[16]; // members, if there are few enough
+  int     needleLen_;  // zero if too many
+  bool    active_;
+};
+
+
+class LeaderFinder {
+public:
+  LeaderFinder(); // inactive, never skips
+  LeaderFinder(const Byte *equivMap, const Byte *leader, size_t leaderLen);
+
+  bool active() const { return active_; }
+
+  // returns first position in [ptr, end) where the leader may start, or end
+  const Byte *find(const Byte *ptr, const Byte *end) const;
+
+  // as above, for null-terminated input, returning the terminator if none
+  const Byte *find(const Byte *ptr) const;
+
+private:
+  std::string raw_;     // entire leader in raw bytes, if unambiguous
+  size_t      rareOff_; // otherwise, offset of a byte that is
+  Byte        rare_;
+  bool        active_;
+};
+
+
+class Accelerator {
+public:
+  Accelerator(); // no states, never skips
+  Accelerator(std::string_view section, const char *base, size_t limit);
+
+  static constexpr size_t recordLen_ = sizeof(uint64_t) + 32;
+
+  // builds one record of the section payload
+  static std::string record(uint64_t offset, const uint8_t *bitmap);
+
+  size_t size() const { return states_.size(); }
+
+  // returns the escape bytes of a flagged state; never skips if unknown
+  const Skipper &find(const void *state) const;
+
+private:
+  std::vector<const char *> states_; // in ascending order
+  std::vector<Skipper>      skippers_;
+  Skipper                   none_;
+};
+
+} // namespace zezax::red
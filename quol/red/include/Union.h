@@ -0,0 +1,56 @@
+/* Union.h - merges a small DFA into a big one - header
+
+   Recompiling every pattern to add a few more repeats the powerset
+   conversion and minimization of all of them.  UnionBuilder instead
+   takes the minimized DFA of the existing patterns and that of the
+   new ones, and makes the DFA of their union by product construction:
+   each state is a pair of states, one from each DFA, and the pairs
+   are found breadth first from the two initial states.  Where they
+   disagree, the lowest positive result wins, as with end marks.
+
+   The bytes of the union are grouped by the pair of equivalence
+   classes they have in the two DFAs.  A pair whose second member is
+   dead behaves just like its first member, so it's never made: it's
+   the base state, by its own id, carried over unchanged and already
+   minimal.  Only the pairs that involve the new DFA are expanded and
+   minimized again.  Each such pair is first checked against the base
+   state it's paired with, as a new pattern often matches nothing that
+   wasn't already matched there.  What's left is refined against
+   itself, with the base states held fixed.  So the costly part of the
+   work grows with the new patterns; the rest is a linear copy of the
+   base DFA.
+
+   The result is equivalent to compiling all the patterns together.
+   It can have a few more states than that would, where a new pair
+   happens to match some unrelated base state.  As with minimization,
+   the result has an equivalence map and its dead ends flagged.
+
+   Usage is like:
+
+   UnionBuilder ub(base, more, budget);
+   DfaObj both = ub.build();
+
+   See also compileUnion() in Compile.h.
+ */
+
+#pragma once
+
+#include "Budget.h"
+#include "Dfa.h"
+
+namespace zezax::red {
+
+class UnionBuilder {
+public:
+  UnionBuilder(const DfaObj &base, const DfaObj &more, Budget *budget = nullptr)
+    : base_(base), more_(more), budget_(budget) {}
+
+  DfaObj build();
+
+private:
+  const DfaObj &base_;
+  const DfaObj &more_;
+  Budget       *budget_;
+};
+
+} // namespace zezax::red
@@ -18,6 +18,7 @@ namespace zezax::red {
 
 char fromHexDigit(Byte x);
 
+// replaces the file whole, by way of a temporary beside it
 void writeStringToFile(std::string_view str, const char *path);
 std::string readFileToString(const char *path);
 std::vector<std::string> sampleLines(const std::string &buf, size_t n);
@@ -0,0 +1,231 @@
+/* Acyclic.cpp - direct minimal DFA construction for string sets - impl
+
+   See general description in Acyclic.h
+
+   Working states are Nodes, numbered from zero, which is the root.
+   Their transitions are appended in byte order, as the strings are
+   sorted, so two Nodes are equivalent just when their results and
+   transition lists are equal.  The register is a hash set of Node
+   numbers, keyed by their contents.  A Node replaced by its twin goes
+   on a free list for reuse.  At the end, the Nodes reachable from the
+   root are copied into a DfaObj in breadth-first order.
+ */
+
+#include "Acyclic.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <unordered_set>
+#include <utility>
+
+#include "Except.h"
+#include "Fnv.h"
+
+namespace zezax::red {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef uint32_t NodeId;
+
+constexpr NodeId gNoNode = std::numeric_limits<NodeId>::max();
+
+struct Node {
+  Result                          result_;
+  vector<std::pair<Byte, NodeId>> trans_;
+};
+
+
+class Daciuk {
+public:
+  Daciuk()
+    : register_(0, Hasher{this}, Equal{this}) {
+    path_.push_back(newNode()); // the root
+  }
+
+  void add(const string &str, Result result);
+  void finish() { settle(0); }
+  DfaObj toDfa(Budget *budget, bool ignoreCase) const;
+
+private:
+  struct Hasher {
+    size_t operator()(NodeId id) const;
+    const Daciuk *owner_;
+  };
+
+  struct Equal {
+    bool operator()(NodeId aa, NodeId bb) const;
+    const Daciuk *owner_;
+  };
+
+  NodeId newNode();
+  void settle(size_t keep);
+
+  vector<Node>                                nodes_;
+  vector<NodeId>                              free_;
+  vector<NodeId>                              path_; // along last string
+  string                                      last_;
+  std::unordered_set<NodeId, Hasher, Equal>   register_;
+};
+
+
+void Daciuk::add(const string &str, Result result) {
+  size_t common = 0;
+  size_t lim = std::min(str.size(), last_.size());
+  while ((common < lim) && (str[common] == last_[common]))
+    ++common;
+
+  settle(common);
+  for (size_t ii = common; ii < str.size(); ++ii) {
+    NodeId next = newNode();
+    nodes_[path_.back()].trans_.emplace_back(static_cast<Byte>(str[ii]), next);
+    path_.push_back(next);
+  }
+  nodes_[path_.back()].result_ = result;
+  last_ = str;
+}
+
+
+// Registers or replaces the path's Nodes deeper than keep, deepest first
+void Daciuk::settle(size_t keep) {
+  while (path_.size() > keep + 1) {
+    NodeId child = path_.back();
+    path_.pop_back();
+    auto [it, novel] = register_.insert(child);
+    if (!novel) {
+      nodes_[path_.back()].trans_.back().second = *it;
+      nodes_[child].trans_.clear();
+      nodes_[child].trans_.shrink_to_fit();
+      free_.push_back(child);
+    }
+  }
+}
+
+
+NodeId Daciuk::newNode() {
+  NodeId rv;
+  if (free_.empty()) {
+    if (nodes_.size() >= gNoNode)
+      throw RedExceptLimit("too many states for exact strings");
+    rv = static_cast<NodeId>(nodes_.size());
+    nodes_.emplace_back();
+  }
+  else {
+    rv = free_.back();
+    free_.pop_back();
+  }
+  nodes_[rv].result_ = 0;
+  return rv;
+}
+
+
+DfaObj Daciuk::toDfa(Budget *budget, bool ignoreCase) const {
+  DfaObj dfa(budget);
+  DfaId errId = dfa.newState();
+  if (errId != gDfaErrorId)
+    throw RedExceptCompile("dfa error state must be zero");
+
+  vector<DfaId> ids(nodes_.size(), gDfaErrorId);
+  std::deque<NodeId> todo;
+  ids[0] = dfa.newState();
+  todo.push_back(0);
+  while (!todo.empty()) {
+    NodeId cur = todo.front();
+    todo.pop_front();
+    for (const auto &[_, next] : nodes_[cur].trans_)
+      if (ids[next] == gDfaErrorId) {
+        ids[next] = dfa.newState(); // no references across this
+        todo.push_back(next);
+      }
+
+    DfaState &ds = dfa[ids[cur]];
+    ds.result_ = nodes_[cur].result_;
+    for (const auto &[ch, next] : nodes_[cur].trans_) {
+      ds.transitions_.set(ch, ids[next]);
+      if (ignoreCase && (ch >= 'a') && (ch <= 'z')) // upper-case in ascii
+        ds.transitions_.set(static_cast<CharIdx>(ch - 32), ids[next]);
+    }
+  }
+  return dfa;
+}
+
+
+size_t Daciuk::Hasher::operator()(NodeId id) const {
+  const Node &node = owner_->nodes_[id];
+  size_t rv = fnv1a<size_t>(&node.result_, sizeof(node.result_));
+  for (const auto &[ch, next] : node.trans_) {
+    rv = fnv1aInc<size_t>(rv, &ch, sizeof(ch));
+    rv = fnv1aInc<size_t>(rv, &next, sizeof(next));
+  }
+  return rv;
+}
+
+
+bool Daciuk::Equal::operator()(NodeId aa, NodeId bb) const {
+  const Node &na = owner_->nodes_[aa];
+  const Node &nb = owner_->nodes_[bb];
+  return ((na.result_ == nb.result_) && (na.trans_ == nb.trans_));
+}
+
+} // anonymous
+
+///////////////////////////////////////////////////////////////////////////////
+
+DfaObj AcyclicBuilder::build(vector<ExactString> &strs, bool ignoreCase) {
+  if (stats_) {
+    stats_->preDfa_ = std::chrono::steady_clock::now();
+    if (stats_->postNfa_.time_since_epoch().count() == 0)
+      stats_->postNfa_ = stats_->preDfa_; // no nfa, so no finish()
+  }
+
+  if (ignoreCase)
+    for (ExactString &es : strs)
+      for (char &ch : es.str_)
+        if ((ch >= 'A') && (ch <= 'Z'))
+          ch = static_cast<char>(ch + 32); // lower-case in ascii
+
+  // lowest result first among equal strings, so it's the one kept
+  std::sort(strs.begin(), strs.end(),
+            [](const ExactString &aa, const ExactString &bb) {
+              int cmp = aa.str_.compare(bb.str_);
+              return (cmp < 0) || ((cmp == 0) && (aa.result_ < bb.result_));
+            });
+
+  DfaObj dfa(budget_);
+  {
+    Daciuk dac;
+    const string *prev = nullptr;
+    for (const ExactString &es : strs) {
+      if (es.str_.empty() || (prev && (*prev == es.str_)))
+        continue;
+      dac.add(es.str_, es.result_);
+      prev = &es.str_;
+    }
+    dac.finish();
+    dfa = dac.toDfa(budget_, ignoreCase);
+  }
+
+  if (stats_) {
+    stats_->postBasisChars_ = stats_->postMakeTable_ = stats_->postDfa_ =
+      stats_->preMinimize_ = std::chrono::steady_clock::now();
+    stats_->origDfaStates_       = dfa.numStates();
+    stats_->transitionTableRows_ = 0;
+  }
+
+  CharIdx maxChar = dfa.installEquivalenceMap();
+  flagDeadEnds(dfa.getMutStates(), maxChar);
+
+  if (stats_) {
+    stats_->postEquivMap_ = stats_->postInvert_ = stats_->postPartition_ =
+      stats_->postMakeList_ = stats_->postMinimize_ =
+      std::chrono::steady_clock::now();
+    stats_->minimizedDfaStates_      = dfa.numStates();
+    stats_->numDistinguishedSymbols_ = maxChar + 1;
+  }
+  return dfa;
+}
+
+} // namespace zezax::red
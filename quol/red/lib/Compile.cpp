@@ -5,43 +5,281 @@
 
 #include "Compile.h"
 
+#include "Acyclic.h"
 #include "Powerset.h"
 #include "Minimizer.h"
+#include "Prefilter.h"
+#include "Profile.h"
+#include "Union.h"
 
 namespace zezax::red {
 
 using std::string;
+using std::vector;
 
+namespace {
 
-Executable compile(Parser &rp, Format fmt) {
-  string buf = compileToSerialized(rp, fmt);
-  return Executable(std::move(buf));
+constexpr size_t gPrefilterWidth = 3;   // bytes per literal, at most
+constexpr size_t gPrefilterMax   = 256; // literals, beyond which it's moot
+constexpr size_t gRequiredMin    = 3;   // shorter literals reject too little
+
+// Minimizes with whichever minimizer the options call for
+void minimize(DfaObj &dfa, CompStats *stats, Flags opts) {
+  if (opts & cfRefine) {
+    RefineMinimizer rm(dfa, stats);
+    rm.minimize();
+  }
+  else {
+    DfaMinimizer dm(dfa, stats);
+    dm.minimize();
+  }
 }
 
 
-string compileToSerialized(Parser &rp, Format fmt) {
-  string buf;
+// Builds the serialized dfa for .*(regex) by temporarily giving the nfa
+// a new initial state that loops on every byte.
+string serializeUnanchored(NfaObj   &nfa,
+                           Budget   *budget,
+                           unsigned  threads,
+                           Flags     opts) {
+  NfaId init = nfa.getInitial();
+  NfaId loopy = nfa.newState(nfa[init].result_);
+  nfa[loopy].transitions_ = nfa[init].transitions_;
+  NfaTransition tr;
+  tr.next_ = loopy;
+  tr.multiChar_.resize(gAlphabetSize);
+  tr.multiChar_.setAll();
+  nfa[loopy].transitions_.emplace_back(std::move(tr));
+
+  DfaObj dfa(budget);
+  nfa.setInitial(loopy);
+  {
+    PowersetConverter psc(nfa, budget, nullptr, threads);
+    dfa = psc.convert();
+  }
+  nfa.setInitial(init);
+  minimize(dfa, nullptr, opts);
+  Serializer ser(dfa);
+  return ser.serializeToString(fmtDirectAuto);
+}
+
+
+// Builds the serialized dfa for the reversed regex.  Its initial state
+// stands for all the states that lead to end marks; it accepts upon
+// reaching any place where an added regex begins.  If loose, that state
+// also loops on every byte but never accepts itself, so that, run back
+// from the end of the input, it accepts wherever a non-empty match
+// begins: the dfa for .*(reversed regex) less the empty match.
+string serializeReverse(const NfaObj   &nfa,
+                        const NfaIdSet &starts,
+                        Budget         *budget,
+                        unsigned        threads,
+                        Flags           opts,
+                        bool            loose) {
+  NfaObj rev(budget);
+  NfaId num = static_cast<NfaId>(nfa.numStates());
+  for (NfaId id = 1; id < num; ++id)
+    rev.newState(0); // same ids as forward
+
+  rev.setGoal(1);
+  NfaId goal = rev.newGoalState();
+  NfaIdSet ends;
+  for (NfaId id = 1; id < num; ++id)
+    for (const NfaTransition &tr : nfa[id].transitions_) {
+      NfaTransition back;
+      back.next_ = id;
+      for (CharIdx ch : tr.multiChar_) {
+        if (ch < gAlphabetSize)
+          back.multiChar_.insert(ch);
+        else
+          ends.insert(id);
+      }
+      if (!back.multiChar_.empty())
+        rev[tr.next_].transitions_.emplace_back(std::move(back));
+    }
+
+  for (NfaId id : starts) {
+    NfaTransition tr;
+    tr.next_ = goal;
+    tr.multiChar_.insert(1 + gAlphabetSize); // end mark
+    rev[id].transitions_.emplace_back(std::move(tr));
+  }
+
+  NfaId init = rev.newState(0);
+  for (NfaId id : ends)
+    rev.stateUnion(init, id);
+  if (loose) {
+    vector<NfaTransition> &trans = rev[init].transitions_;
+    std::erase_if(trans, [goal](const NfaTransition &tr) {
+      return (tr.next_ == goal); // only end marks lead there
+    });
+    NfaTransition tr;
+    tr.next_ = init;
+    tr.multiChar_.resize(gAlphabetSize);
+    tr.multiChar_.setAll();
+    trans.emplace_back(std::move(tr));
+  }
+  rev.setInitial(init);
+  rev.dropUselessTransitions();
+
+  DfaObj dfa(budget);
+  {
+    PowersetConverter psc(rev, budget, nullptr, threads);
+    dfa = psc.convert();
+  }
+  minimize(dfa, nullptr, opts);
+  Serializer ser(dfa);
+  return ser.serializeToString(fmtDirectAuto);
+}
+
+
+// Serialized companions and literals embedded after the main dfa
+struct Sections {
+  string unanchored_;
+  string starts_;
+  string reverse_;
+  string required_;
+};
+
+
+// Builds the minimized dfa, along with the sections asked for, if any
+DfaObj buildDfa(Parser &rp, Flags opts, Sections *secs) {
   Budget *budget   = rp.getBudget();
   CompStats *stats = rp.getStats();
+  unsigned threads = rp.getThreads();
+  DfaObj dfa(budget);
+  if (rp.exactOnly() && !(secs && (opts & (cfUnanchored | cfReverse)))) {
+    bool ignoreCase = rp.exactIgnoreCase();
+    vector<ExactString> strs = rp.takeExact();
+    AcyclicBuilder ab(budget, stats);
+    dfa = ab.build(strs, ignoreCase); // already minimal
+    rp.freeAll();
+    return dfa;
+  }
+
   rp.finish(); // idempotent
   {
-    DfaObj dfa(budget);
-    {
-      PowersetConverter psc(rp.getNfa(), budget, stats);
-      dfa = psc.convert();
-      rp.freeAll();
-    }
-    {
-      DfaMinimizer dm(dfa, stats);
-      dm.minimize();
+    PowersetConverter psc(rp.getNfa(), budget, stats, threads);
+    dfa = psc.convert();
+  }
+  if (secs) {
+    secs->required_ = rp.getNfa().requiredLiteral();
+    if (secs->required_.size() < gRequiredMin)
+      secs->required_.clear();
+    if ((opts & cfReverse) && !rp.getStarts().empty())
+      secs->reverse_ = serializeReverse(rp.getNfa(), rp.getStarts(), budget,
+                                        threads, opts, false);
+    if (opts & cfUnanchored) {
+      secs->unanchored_ = serializeUnanchored(rp.getNfa(), budget, threads,
+                                              opts);
+      if (!rp.getStarts().empty())
+        secs->starts_ = serializeReverse(rp.getNfa(), rp.getStarts(), budget,
+                                         threads, opts, true);
     }
-    {
-      Serializer ser(dfa, stats);
-      buf = ser.serializeToString(fmt);
+  }
+  rp.freeAll();
+  minimize(dfa, stats, opts);
+  return dfa;
+}
+
+
+// Serializes the dfa with its prefilter and the given sections
+string serializeAll(const DfaObj         &dfa,
+                    const Sections       &secs,
+                    CompStats            *stats,
+                    const vector<string> *corpus,
+                    Format                fmt) {
+  string buf;
+  string prefilter;
+  {
+    // a single literal would just be the leader
+    auto lits = dfa.prefixLiterals(gPrefilterWidth, gPrefilterMax);
+    if (lits.size() > 1)
+      prefilter = Prefilter::encode(lits);
+  }
+  {
+    Serializer ser(dfa, stats);
+    buf = ser.serializeToString(fmt);
+    if (corpus) { // profile this layout, then redo it
+      Executable exec(gUnownedTag, buf);
+      Profiler prof(exec);
+      for (const string &text : *corpus)
+        prof.run(text);
+      ser.setVisits(prof.visits());
+      buf = ser.serializeToString(exec.getFormat());
     }
   }
 
+  if (!secs.unanchored_.empty())
+    appendSection(buf, secUnanchored, secs.unanchored_);
+  if (!secs.starts_.empty())
+    appendSection(buf, secStarts, secs.starts_);
+  if (!secs.reverse_.empty())
+    appendSection(buf, secReverse, secs.reverse_);
+  if (!prefilter.empty())
+    appendSection(buf, secPrefilter, prefilter);
+  if (!secs.required_.empty())
+    appendSection(buf, secRequired, secs.required_);
+  if (stats && (buf.size() > stats->serializedBytes_))
+    stats->serializedBytes_ = buf.size();
+
   return buf;
 }
 
+
+string compileImpl(Parser               &rp,
+                   const vector<string> *corpus,
+                   Format                fmt,
+                   Flags                 opts) {
+  Sections secs;
+  DfaObj dfa = buildDfa(rp, opts, &secs);
+  return serializeAll(dfa, secs, rp.getStats(), corpus, fmt);
+}
+
+} // anonymous
+
+
+Executable compile(Parser &rp, Format fmt, Flags opts) {
+  string buf = compileToSerialized(rp, fmt, opts);
+  return Executable(std::move(buf));
+}
+
+
+string compileToSerialized(Parser &rp, Format fmt, Flags opts) {
+  return compileImpl(rp, nullptr, fmt, opts);
+}
+
+
+Executable compile(Parser &rp, const vector<string> &corpus,
+                   Format fmt, Flags opts) {
+  string buf = compileToSerialized(rp, corpus, fmt, opts);
+  return Executable(std::move(buf));
+}
+
+
+string compileToSerialized(Parser               &rp,
+                           const vector<string> &corpus,
+                           Format                fmt,
+                           Flags                 opts) {
+  return compileImpl(rp, &corpus, fmt, opts);
+}
+
+
+DfaObj compileToDfa(Parser &rp, Flags opts) {
+  return buildDfa(rp, opts, nullptr);
+}
+
+
+Executable compileUnion(DfaObj &base, Parser &rp, Format fmt, Flags opts) {
+  Budget *budget = rp.getBudget();
+  CompStats *stats = rp.getStats();
+  {
+    DfaObj more = buildDfa(rp, opts, nullptr);
+    UnionBuilder ub(base, more, budget);
+    base = ub.build();
+  }
+  string buf = serializeAll(base, Sections{}, stats, nullptr, fmt);
+  return Executable(std::move(buf));
+}
+
 } // namespace zezax::red
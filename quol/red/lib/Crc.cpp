@@ -0,0 +1,88 @@
+/* Crc.cpp - CRC-32C checksum implementation
+
+   See general description in Crc.h
+
+   Slicing-by-8 is described by Kounavis and Berry in "Novel Table
+   Lookup-Based Algorithms for High-Performance CRC Generation".
+   Each of the eight tables advances the CRC over one more zero byte,
+   so eight input bytes are folded in with eight independent lookups.
+ */
+
+#include "Crc.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace zezax::red {
+
+#if defined(__SSE4_2__)
+
+uint32_t crc32cInc(uint32_t crc, const void *ptr, size_t nbytes) {
+  const uint8_t *bytep = static_cast<const uint8_t *>(ptr);
+  const uint8_t *end = bytep + nbytes;
+  uint64_t acc = ~crc;
+  for (; (bytep < end) && (reinterpret_cast<uintptr_t>(bytep) & 7); ++bytep)
+    acc = _mm_crc32_u8(static_cast<uint32_t>(acc), *bytep);
+  for (; (end - bytep) >= 8; bytep += 8) {
+    uint64_t word;
+    memcpy(&word, bytep, sizeof(word));
+    acc = _mm_crc32_u64(acc, word);
+  }
+  for (; bytep < end; ++bytep)
+    acc = _mm_crc32_u8(static_cast<uint32_t>(acc), *bytep);
+  return ~static_cast<uint32_t>(acc);
+}
+
+#else
+
+namespace {
+
+constexpr uint32_t gPoly = 0x82f63b78; // Castagnoli, bit-reversed
+
+typedef std::array<std::array<uint32_t, 256>, 8> Tables;
+
+constexpr Tables makeTables() {
+  Tables rv{};
+  for (uint32_t ii = 0; ii < 256; ++ii) {
+    uint32_t crc = ii;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ ((crc & 1) ? gPoly : 0);
+    rv[0][ii] = crc;
+  }
+  for (size_t ii = 0; ii < 256; ++ii)
+    for (size_t tt = 1; tt < 8; ++tt)
+      rv[tt][ii] = (rv[tt - 1][ii] >> 8) ^ rv[0][rv[tt - 1][ii] & 0xff];
+  return rv;
+}
+
+constexpr Tables gTables = makeTables();
+
+} // anonymous
+
+uint32_t crc32cInc(uint32_t crc, const void *ptr, size_t nbytes) {
+  const uint8_t *bytep = static_cast<const uint8_t *>(ptr);
+  const uint8_t *end = bytep + nbytes;
+  crc = ~crc;
+  for (; (end - bytep) >= 8; bytep += 8) {
+    uint32_t lo;
+    uint32_t hi;
+    memcpy(&lo, bytep, sizeof(lo)); // little-endian assumed, as elsewhere
+    memcpy(&hi, bytep + 4, sizeof(hi));
+    lo ^= crc;
+    crc = gTables[7][lo & 0xff] ^ gTables[6][(lo >> 8) & 0xff] ^
+      gTables[5][(lo >> 16) & 0xff] ^ gTables[4][lo >> 24] ^
+      gTables[3][hi & 0xff] ^ gTables[2][(hi >> 8) & 0xff] ^
+      gTables[1][(hi >> 16) & 0xff] ^ gTables[0][hi >> 24];
+  }
+  for (; bytep < end; ++bytep)
+    crc = (crc >> 8) ^ gTables[0][(crc ^ *bytep) & 0xff];
+  return ~crc;
+}
+
+#endif
+
+} // namespace zezax::red
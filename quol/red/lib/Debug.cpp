@@ -8,6 +8,7 @@
 #include "Debug.h"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <set>
 #include <ratio>
@@ -25,6 +26,7 @@ using chrono::steady_clock;
 using std::numeric_limits;
 using std::ostream;
 using std::string;
+using std::string_view;
 using std::to_string;
 using std::vector;
 
@@ -76,7 +78,10 @@ void appendSerializedState(string     &buf,
   buf += '$' + toHexString(off) + " -> " + to_string(result) + '\n';
   if (deadEnd)
     buf += "  DeadEnd\n";
-  for (size_t ii = 0; ii <= maxChar; ++ii) {
+  if (proxy.accel())
+    buf += "  Accel\n";
+  size_t maxCol = proxy.mapped_ ? maxChar : gAlphabetSize - 1;
+  for (size_t ii = 0; ii <= maxCol; ++ii) {
     buf += "  " + to_string(ii) + " -> $" +
       toHexString(proxy.trans(ii)) + '\n';
   }
@@ -195,7 +200,9 @@ void toStringAppend(string &out, const FileHeader &hdr) {
     " leaderLen=" + to_string(static_cast<unsigned>(hdr.leaderLen_)) + '\n';
   out += "states=" + to_string(hdr.stateCnt_) +
     " init=$" + toHexString(hdr.initialOff_) +
-    " lead=$" + toHexString(hdr.leaderOff_) + '\n';
+    " lead=$" + toHexString(hdr.leaderOff_) +
+    " sect=$" + toHexString(hdr.sectionOff_) +
+    " plain=$" + toHexString(hdr.plainOff_) + '\n';
 }
 
 } // anonymous
@@ -525,6 +532,10 @@ string toString(const char *buf, size_t len) {
   case fmtDirect1:
   case fmtDirect2:
   case fmtDirect4:
+  case fmtDirect8:
+  case fmtFlat2:
+  case fmtFlat4:
+  case fmtComb4:
     break;
   default:
     rv = "format not recognized";
@@ -546,10 +557,26 @@ string toString(const char *buf, size_t len) {
   case fmtDirect4:
     inc = DfaProxy<fmtDirect4>::stateSize(maxChar);
     break;
+  case fmtDirect8:
+    inc = DfaProxy<fmtDirect8>::stateSize(maxChar);
+    break;
+  case fmtFlat2:
+    inc = DfaProxy<fmtFlat2>::stateSize(maxChar);
+    break;
+  case fmtFlat4:
+    inc = DfaProxy<fmtFlat4>::stateSize(maxChar);
+    break;
+  case fmtComb4:
+    inc = DfaProxy<fmtComb4>::stateSize(maxChar);
+    break;
   default:
     throw RedExceptInternal("corrupted format");
   }
 
+  if (hdr->sectionOff_ > 0)
+    end = buf + hdr->sectionOff_;
+  const char *combEnd = end;
+  end = std::min(end, base + (hdr->stateCnt_ * inc)); // comb follows
   for (const char *ptr = base; ptr < end; ptr += inc) {
     size_t off = static_cast<size_t>(ptr - base);
     switch (fmt) {
@@ -562,11 +589,60 @@ string toString(const char *buf, size_t len) {
     case fmtDirect4:
       appendSerializedState<fmtDirect4>(rv, ptr, off, maxChar);
       break;
+    case fmtDirect8:
+      appendSerializedState<fmtDirect8>(rv, ptr, off, maxChar);
+      break;
+    case fmtFlat2:
+      appendSerializedState<fmtFlat2>(rv, ptr, off, maxChar);
+      break;
+    case fmtFlat4:
+      appendSerializedState<fmtFlat4>(rv, ptr, off, maxChar);
+      break;
+    case fmtComb4:
+      appendSerializedState<fmtComb4>(rv, ptr, off, maxChar);
+      break;
     default:
       break;
     }
   }
 
+  if (combEnd > end)
+    rv += "comb entries=" +
+      to_string(static_cast<size_t>(combEnd - end) / sizeof(CombEntry)) + '\n';
+
+  size_t off = hdr->sectionOff_;
+  while ((off > 0) && (off < len)) {
+    const SectionHeader *sec =
+      reinterpret_cast<const SectionHeader *>(buf + off);
+    rv += "section kind=" + to_string(sec->kind_) +
+      " len=" + to_string(sec->len_) + '\n';
+    if (sec->kind_ == secPrefilter) {
+      Prefilter pf(string_view(reinterpret_cast<const char *>(sec->bytes_),
+                               sec->len_));
+      rv += "prefilter width=" + to_string(pf.width()) +
+        " literals=" + to_string(pf.size()) + '\n';
+    }
+    else if (sec->kind_ == secAccel) {
+      constexpr size_t recLen = Accelerator::recordLen_;
+      rv += "accel";
+      for (size_t ii = 0; ii + recLen <= sec->len_; ii += recLen) {
+        uint64_t stateOff;
+        memcpy(&stateOff, sec->bytes_ + ii, sizeof(stateOff));
+        rv += " $" + toHexString(stateOff);
+      }
+      rv += '\n';
+    }
+    else if (sec->kind_ == secRequired) {
+      rv += "required ";
+      for (size_t ii = 0; ii < sec->len_; ++ii)
+        rv += visibleChar(sec->bytes_[ii]);
+      rv += '\n';
+    }
+    else
+      rv += toString(reinterpret_cast<const char *>(sec->bytes_), sec->len_);
+    off += (sizeof(SectionHeader) + sec->len_ + 7) & ~7UL;
+  }
+
   return rv + "END\n";
 }
 
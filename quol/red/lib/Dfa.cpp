@@ -27,11 +27,15 @@ namespace {
 bool determineDeadEnd(const DfaState &ds, DfaId id, CharIdx maxChar) {
   // (likely) try sparse first...
   const std::unordered_map<CharIdx, DfaId> &sparse = ds.transitions_.getMap();
-  for (const auto [ch, tid] : sparse)
+  size_t covered = 0; // of the maxChar + 1 classes
+  for (const auto &[ch, tid] : sparse) {
     if ((ch < gAlphabetSize) && (tid != id))
       return false;
+    if (ch <= maxChar)
+      ++covered;
+  }
   // if not in sparse, could be default value
-  if ((sparse.size() < maxChar) && (id != ds.transitions_.getDefault()))
+  if ((covered <= maxChar) && (id != ds.transitions_.getDefault()))
     return false;
   return true;
 }
@@ -168,6 +172,50 @@ string DfaObj::fixedPrefix(DfaId &nextId) const {
 }
 
 
+// Returns the raw byte strings that every match must begin with, all of
+// the same length, at most maxLen.  Fewer bytes are used if some match
+// is shorter, or if more would give over maxCount strings.  Returns
+// empty if fewer than two bytes would be required.
+vector<string> DfaObj::prefixLiterals(size_t maxLen, size_t maxCount) const {
+  typedef std::pair<string, DfaId> Partial;
+  vector<Partial> cur;
+  cur.emplace_back(string(), gDfaInitialId);
+  size_t len = 0;
+  for (; len < maxLen; ++len) {
+    vector<Partial> next;
+    bool ok = true;
+    for (auto it = cur.cbegin(); ok && (it != cur.cend()); ++it) {
+      const DfaState &ds = states_[it->second];
+      if (ds.result_ > 0) { // a match this short needs no more bytes
+        ok = false;
+        break;
+      }
+      for (CharIdx uu = 0; ok && (uu < gAlphabetSize); ++uu) {
+        CharIdx ch = (uu < equivMap_.size()) ? equivMap_[uu] : uu;
+        DfaId nextId = ds.transitions_[ch];
+        if (nextId == gDfaErrorId)
+          continue;
+        if (next.size() >= maxCount)
+          ok = false;
+        else
+          next.emplace_back(it->first + static_cast<char>(uu), nextId);
+      }
+    }
+    if (!ok)
+      break;
+    cur.swap(next);
+  }
+
+  vector<string> rv;
+  if (len < 2)
+    return rv;
+  rv.reserve(cur.size());
+  for (Partial &part : cur)
+    rv.emplace_back(std::move(part.first));
+  return rv;
+}
+
+
 Result DfaObj::matchFull(string_view sv) {
   const DfaState *ds = &states_[gDfaInitialId];
   for (char c : sv) {
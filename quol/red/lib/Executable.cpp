@@ -5,6 +5,12 @@
 
 #include "Executable.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <system_error>
 #include <utility>
 
 #include "Except.h"
@@ -13,22 +19,34 @@
 
 namespace zezax::red {
 
+using std::generic_category;
 using std::string;
 using std::string_view;
+using std::system_error;
 
 
 Executable::Executable(Executable &&other)
   : str_(std::move(other.str_)),
+    unanchored_(std::move(other.unanchored_)),
+    reverse_(std::move(other.reverse_)),
+    starts_(std::move(other.starts_)),
     buf_(std::exchange(other.buf_, nullptr)),
     end_(std::exchange(other.end_, nullptr)),
     equivMap_(std::exchange(other.equivMap_, nullptr)),
     leader_(std::exchange(other.leader_, nullptr)),
     base_(std::exchange(other.base_, nullptr)),
+    skipper_(std::exchange(other.skipper_, Skipper())),
+    finder_(std::exchange(other.finder_, LeaderFinder())),
+    prefilter_(std::exchange(other.prefilter_, Prefilter())),
+    required_(std::move(other.required_)),
+    accel_(std::exchange(other.accel_, Accelerator())),
+    verdict_(std::move(other.verdict_)),
     fmt_(std::exchange(other.fmt_, fmtInvalid)),
     leaderLen_(std::exchange(other.leaderLen_, 0)),
     inStr_(std::exchange(other.inStr_, true)),
     usedNew_(std::exchange(other.usedNew_, false)),
-    usedMalloc_(std::exchange(other.usedMalloc_, false)) {}
+    usedMalloc_(std::exchange(other.usedMalloc_, false)),
+    usedMmap_(std::exchange(other.usedMmap_, false)) {}
 
 
 Executable::Executable(string &&buf)
@@ -42,12 +60,15 @@ Executable::Executable(string &&buf)
     leaderLen_(0),
     inStr_(true),
     usedNew_(false),
-    usedMalloc_(false) {
+    usedMalloc_(false),
+    usedMmap_(false) {
   if (str_.empty())
     throw RedExceptApi("serialized dfa move-string is empty");
+  if (isVersion1(str_.data(), str_.size()))
+    str_ = upgradeFromV1(str_);
   buf_ = str_.data();
   end_ = buf_ + str_.size();
-  validate();
+  validate(0);
 }
 
 
@@ -62,12 +83,15 @@ Executable::Executable(const CopyTag &, string_view sv)
     leaderLen_(0),
     inStr_(true),
     usedNew_(false),
-    usedMalloc_(false) {
+    usedMalloc_(false),
+    usedMmap_(false) {
   if (str_.empty())
     throw RedExceptApi("serialized dfa string_view is empty");
+  if (isVersion1(str_.data(), str_.size()))
+    str_ = upgradeFromV1(str_);
   buf_ = str_.data();
   end_ = buf_ + str_.size();
-  validate();
+  validate(0);
 }
 
 
@@ -81,11 +105,12 @@ Executable::Executable(const DeleteTag &, const void *ptr, size_t len)
     leaderLen_(0),
     inStr_(false),
     usedNew_(true),
-    usedMalloc_(false) {
+    usedMalloc_(false),
+    usedMmap_(false) {
   if (!buf_)
     throw RedExceptApi("serialized dfa new-ptr is empty");
   end_ = buf_ + len;
-  validate();
+  validate(0);
 }
 
 
@@ -99,15 +124,16 @@ Executable::Executable(const FreeTag &, const void *ptr, size_t len)
     leaderLen_(0),
     inStr_(false),
     usedNew_(false),
-    usedMalloc_(true) {
+    usedMalloc_(true),
+    usedMmap_(false) {
   if (!buf_)
     throw RedExceptApi("serialized dfa malloc-ptr is empty");
   end_ = buf_ + len;
-  validate();
+  validate(0);
 }
 
 
-Executable::Executable(const UnownedTag &, string_view sv)
+Executable::Executable(const UnownedTag &, string_view sv, Flags mapFlags)
   : buf_(sv.data()),
     end_(sv.data() + sv.size()),
     equivMap_(nullptr),
@@ -117,49 +143,155 @@ Executable::Executable(const UnownedTag &, string_view sv)
     leaderLen_(0),
     inStr_(false),
     usedNew_(false),
-    usedMalloc_(false) {
+    usedMalloc_(false),
+    usedMmap_(false) {
   if (!buf_)
     throw RedExceptApi("serialized dfa unowned-view is empty");
-  validate();
+  validate(mapFlags);
 }
 
 
-Executable::~Executable() {
-  if (!inStr_) {
-    if (usedNew_)
-      delete[] buf_;
-    else if (usedMalloc_)
-      free(const_cast<char *>(buf_));
+Executable::Executable(const PathTag &, const char *path, Flags mapFlags)
+  : buf_(nullptr),
+    end_(nullptr),
+    equivMap_(nullptr),
+    leader_(nullptr),
+    base_(nullptr),
+    fmt_(fmtInvalid),
+    leaderLen_(0),
+    inStr_(false),
+    usedNew_(false),
+    usedMalloc_(false),
+    usedMmap_(false) {
+  if (!path)
+    throw RedExceptApi("serialized dfa path is null");
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw system_error(errno, generic_category(),
+                       "failed to open file for map");
+
+  struct stat sst;
+  if (fstat(fd, &sst) < 0) {
+    int err = errno;
+    close(fd);
+    throw system_error(err, generic_category(), "failed to fstat map file");
+  }
+  if (sst.st_size <= 0) {
+    close(fd);
+    throw RedExceptApi("serialized dfa file is empty");
+  }
+
+  size_t len = static_cast<size_t>(sst.st_size);
+  int how = MAP_SHARED; // so processes share the page cache
+#ifdef MAP_POPULATE
+  if (mapFlags & mfPopulate)
+    how |= MAP_POPULATE;
+#endif
+  void *ptr = mmap(nullptr, len, PROT_READ, how, fd, 0);
+  int err = errno;
+  close(fd); // mapping persists
+  if (ptr == MAP_FAILED)
+    throw system_error(err, generic_category(), "failed to map file");
+
+  // these are only hints, so failures don't matter
+#ifdef MADV_HUGEPAGE
+  if (mapFlags & mfHugePages)
+    madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+  if (mapFlags & mfWillNeed)
+    madvise(ptr, len, MADV_WILLNEED);
+
+  buf_ = static_cast<const char *>(ptr);
+  end_ = buf_ + len;
+  usedMmap_ = true;
+  try {
+    validate(mapFlags);
+  }
+  catch (...) {
+    if (verdict_.valid())
+      verdict_.wait();
+    munmap(ptr, len); // destructor won't run
+    throw;
   }
-  buf_ = nullptr;
-  end_ = nullptr;
-  equivMap_ = nullptr;
-  leader_ = nullptr;
-  base_ = nullptr;
+}
+
+
+Executable::~Executable() {
+  release();
 }
 
 
 Executable &Executable::operator=(Executable &&rhs) {
+  if (this == &rhs)
+    return *this;
+  release(); // else the old buffer leaks
   str_ = std::move(rhs.str_);
+  unanchored_ = std::move(rhs.unanchored_);
+  reverse_ = std::move(rhs.reverse_);
+  starts_ = std::move(rhs.starts_);
   buf_ = std::exchange(rhs.buf_, nullptr);
   end_ = std::exchange(rhs.end_, nullptr);
   equivMap_ = std::exchange(rhs.equivMap_, nullptr);
   leader_ = std::exchange(rhs.leader_, nullptr);
   base_ = std::exchange(rhs.base_, nullptr);
+  skipper_ = std::exchange(rhs.skipper_, Skipper());
+  finder_ = std::exchange(rhs.finder_, LeaderFinder());
+  prefilter_ = std::exchange(rhs.prefilter_, Prefilter());
+  required_ = std::move(rhs.required_);
+  accel_ = std::exchange(rhs.accel_, Accelerator());
+  verdict_ = std::move(rhs.verdict_);
   fmt_ = std::exchange(rhs.fmt_, fmtInvalid);
   leaderLen_ = std::exchange(rhs.leaderLen_, 0);
   inStr_ = std::exchange(rhs.inStr_, true);
   usedNew_ = std::exchange(rhs.usedNew_, false);
   usedMalloc_ = std::exchange(rhs.usedMalloc_, false);
+  usedMmap_ = std::exchange(rhs.usedMmap_, false);
   return *this;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void Executable::validate() {
-  const char *msg = checkHeader(buf_, end_ - buf_);
+void Executable::release() {
+  unanchored_.reset(); // these refer to our buffer
+  reverse_.reset();
+  starts_.reset();
+  if (verdict_.valid())
+    verdict_.wait(); // so is the verifying thread
+  if (!inStr_) {
+    if (usedNew_)
+      delete[] buf_;
+    else if (usedMalloc_)
+      free(const_cast<char *>(buf_));
+    else if (usedMmap_)
+      munmap(const_cast<char *>(buf_), static_cast<size_t>(end_ - buf_));
+  }
+  inStr_ = true; // nothing left to free
+  buf_ = nullptr;
+  end_ = nullptr;
+  equivMap_ = nullptr;
+  leader_ = nullptr;
+  base_ = nullptr;
+}
+
+
+void Executable::awaitVerified() const {
+  if (!verdict_.valid())
+    return;
+  const char *msg = verdict_.get();
   if (msg)
     throw RedExceptApi(msg);
+}
+
+
+void Executable::validate(Flags mapFlags) {
+  bool now = !(mapFlags & (mfNoVerify | mfLazyVerify));
+  const char *msg = checkHeader(buf_, end_ - buf_, now);
+  if (msg)
+    throw RedExceptApi(msg);
+  if (mapFlags & mfLazyVerify)
+    verdict_ = std::async(std::launch::async, checkChecksum, buf_,
+                          static_cast<size_t>(end_ - buf_)).share();
   const FileHeader *hdr = reinterpret_cast<const FileHeader *>(buf_);
   equivMap_ = reinterpret_cast<const Byte *>(hdr->equivMap_);
   leaderLen_ = hdr->leaderLen_;
@@ -167,6 +299,22 @@ void Executable::validate() {
   leader_ = (leaderLen_ == 0) ? nullptr : hdr->bytes_;
   base_ = reinterpret_cast<const char *>(hdr->bytes_ + pad);
   fmt_ = static_cast<Format>(hdr->format_);
+  skipper_ = Skipper(hdr->startSet_);
+  finder_ = LeaderFinder(equivMap_, hdr->bytes_, leaderLen_);
+
+  string_view sub = findSection(buf_, end_ - buf_, secUnanchored);
+  if (!sub.empty())
+    unanchored_ = std::make_unique<Executable>(gUnownedTag, sub, mfNoVerify);
+  sub = findSection(buf_, end_ - buf_, secReverse);
+  if (!sub.empty())
+    reverse_ = std::make_unique<Executable>(gUnownedTag, sub, mfNoVerify);
+  sub = findSection(buf_, end_ - buf_, secStarts);
+  if (!sub.empty())
+    starts_ = std::make_unique<Executable>(gUnownedTag, sub, mfNoVerify);
+  prefilter_ = Prefilter(findSection(buf_, end_ - buf_, secPrefilter));
+  required_ = findSection(buf_, end_ - buf_, secRequired);
+  accel_ = Accelerator(findSection(buf_, end_ - buf_, secAccel), base_,
+                       static_cast<size_t>(end_ - base_));
 }
 
 } // namespace zezax::red
@@ -0,0 +1,460 @@
+/* Lazy.cpp - on-demand DFA construction and matching - implementation
+
+   See general description in Lazy.h
+
+   LazyCore holds a copy of the NFA states along with the byte
+   columns, worked out once from the basis multi-chars as
+   PowersetConverter does.  It's never modified after construction.
+
+   LazyCache numbers the sets of NFA states it has seen.  The error
+   state (the empty set) is always 0 and the initial state is always
+   1, even after a flush, so the matching loops can compare against
+   them.  Transitions live in one flat array, indexed by state and
+   column, with unknown ones marked until first taken.
+
+   The matching loops follow checkCore(), matchCore() and searchCore()
+   in Matcher.h, minus the optimizations that need a serialized DFA.
+ */
+
+#include "Lazy.h"
+
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "Except.h"
+#include "Powerset.h"
+
+namespace zezax::red {
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+constexpr uint32_t gLazyError   = 0;
+constexpr uint32_t gLazyInitial = 1;
+constexpr uint32_t gLazyUnknown = std::numeric_limits<uint32_t>::max();
+
+} // anonymous
+
+class LazyCore {
+public:
+  LazyCore(const NfaObj &nfa, size_t maxStates);
+
+  size_t numCols() const { return reps_.size(); }
+  size_t column(Byte byte) const { return equivMap_[byte]; }
+  size_t maxStates() const { return maxStates_; }
+  const NfaIdSet &initial() const { return initial_; }
+
+  NfaIdSet step(const NfaIdSet &from, size_t col) const;
+  Result result(const NfaIdSet &nis) const;
+
+private:
+  vector<NfaState> states_;
+  vector<Result>   marks_;    // lowest end mark per NFA state, or zero
+  vector<CharIdx>  reps_;     // one character per column
+  uint32_t         equivMap_[gAlphabetSize];
+  NfaIdSet         initial_;
+  size_t           maxStates_;
+};
+
+
+class LazyCache {
+public:
+  explicit LazyCache(const LazyCore &core);
+
+  uint32_t next(uint32_t st, Byte byte) {
+    size_t col = core_.column(byte);
+    uint32_t nx = next_[st * core_.numCols() + col];
+    if (LIKELY(nx != gLazyUnknown))
+      return nx;
+    return fill(st, col);
+  }
+
+  Result result(uint32_t st) const { return results_[st]; }
+
+  size_t numStates() const { return sets_.size(); }
+  size_t flushes() const { return flushes_; }
+
+private:
+  uint32_t fill(uint32_t st, size_t col);
+  uint32_t intern(NfaIdSet &&nis);
+  void flush();
+
+  typedef std::unordered_map<NfaIdSet, uint32_t> Index;
+
+  const LazyCore         &core_;
+  Index                   index_;
+  vector<const NfaIdSet*> sets_; // keys in index_, by number
+  vector<Result>          results_;
+  vector<uint32_t>        next_;
+  size_t                  flushes_;
+};
+
+namespace {
+
+// one thread's cache for one LazyDfa, forgotten once the LazyDfa is gone
+struct CacheSlot {
+  std::weak_ptr<const LazyCore> core_;
+  std::unique_ptr<LazyCache>    cache_;
+};
+
+thread_local vector<CacheSlot> tSlots;
+
+} // anonymous
+
+///////////////////////////////////////////////////////////////////////////////
+
+LazyCore::LazyCore(const NfaObj &nfa, size_t maxStates)
+  : maxStates_(maxStates) {
+  NfaId initial = nfa.getInitial();
+  initial_.insert(initial);
+
+  size_t num = nfa.numStates();
+  states_.reserve(num);
+  marks_.assign(num, 0);
+  for (size_t ii = 0; ii < num; ++ii) {
+    const NfaState &ns = nfa[static_cast<NfaId>(ii)];
+    states_.push_back(ns);
+    Result low = 0;
+    for (const NfaTransition &trans : ns.transitions_)
+      for (CharIdx ch : trans.multiChar_)
+        if (ch >= gAlphabetSize) {
+          Result res = static_cast<Result>(ch - gAlphabetSize);
+          if ((low == 0) || (res < low))
+            low = res;
+        }
+    marks_[ii] = low;
+  }
+
+  // column zero is for bytes that appear nowhere, so always fail
+  reps_.push_back(gAlphabetSize);
+  for (uint32_t &ref : equivMap_)
+    ref = 0;
+  MultiCharSet basis = basisMultiChars(nfa.allMultiChars(initial));
+  for (const MultiChar &mc : basis) {
+    bool any = false;
+    for (CharIdx ch : mc)
+      if (ch < gAlphabetSize) {
+        if (!any)
+          reps_.push_back(ch);
+        any = true;
+        equivMap_[ch] = static_cast<uint32_t>(reps_.size() - 1);
+      }
+  }
+}
+
+
+// The set of NFA states reachable from the given ones by the column
+NfaIdSet LazyCore::step(const NfaIdSet &from, size_t col) const {
+  NfaIdSet rv;
+  CharIdx rep = reps_[col];
+  if (rep >= gAlphabetSize)
+    return rv;
+  for (NfaId id : from)
+    for (const NfaTransition &trans : states_[id].transitions_)
+      if (trans.multiChar_.get(rep))
+        rv.insert(trans.next_);
+  return rv;
+}
+
+
+// Lowest end mark wins, as in DfaObj::chopEndMarks()
+Result LazyCore::result(const NfaIdSet &nis) const {
+  Result rv = 0;
+  for (NfaId id : nis) {
+    Result mark = marks_[id];
+    if ((mark > 0) && ((rv == 0) || (mark < rv)))
+      rv = mark;
+  }
+  if (rv > 0)
+    return rv;
+  // no end marks happens only for an empty parser
+  for (NfaId id : nis) {
+    Result res = states_[id].result_;
+    if ((res > 0) && ((rv == 0) || (res < rv)))
+      rv = res;
+  }
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+LazyCache::LazyCache(const LazyCore &core)
+  : core_(core), flushes_(0) {
+  flush();
+  flushes_ = 0;
+}
+
+
+uint32_t LazyCache::fill(uint32_t st, size_t col) {
+  NfaIdSet nis = core_.step(*sets_[st], col);
+  auto it = index_.find(nis);
+  if (it == index_.end()) {
+    if (sets_.size() >= core_.maxStates()) {
+      flush(); // st is gone, so its transition can't be kept
+      return intern(std::move(nis));
+    }
+    uint32_t id = intern(std::move(nis));
+    next_[st * core_.numCols() + col] = id;
+    return id;
+  }
+  next_[st * core_.numCols() + col] = it->second;
+  return it->second;
+}
+
+
+uint32_t LazyCache::intern(NfaIdSet &&nis) {
+  uint32_t id = static_cast<uint32_t>(sets_.size());
+  auto [it, novel] = index_.emplace(std::move(nis), id);
+  if (novel) {
+    sets_.push_back(&it->first);
+    results_.push_back(core_.result(it->first));
+    next_.resize(next_.size() + core_.numCols(), gLazyUnknown);
+  }
+  return it->second;
+}
+
+
+// Empties the cache, except for the error and initial states
+void LazyCache::flush() {
+  index_.clear();
+  sets_.clear();
+  results_.clear();
+  next_.clear();
+  ++flushes_;
+  intern(NfaIdSet());
+  intern(NfaIdSet(core_.initial()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+LazyDfa::LazyDfa(Parser &rp, size_t maxStates) {
+  if (maxStates < 3)
+    throw RedExceptApi("lazy cache must hold at least three states");
+  rp.finish(); // idempotent
+  core_ = std::make_shared<const LazyCore>(rp.getNfa(), maxStates);
+  rp.freeAll();
+}
+
+
+LazyCache &LazyDfa::cache() const {
+  for (CacheSlot &slot : tSlots)
+    if (!slot.core_.owner_before(core_) && !core_.owner_before(slot.core_))
+      return *slot.cache_;
+
+  // not seen on this thread yet: drop caches for departed LazyDfas
+  size_t keep = 0;
+  for (size_t ii = 0; ii < tSlots.size(); ++ii)
+    if (!tSlots[ii].core_.expired()) {
+      if (keep != ii)
+        tSlots[keep] = std::move(tSlots[ii]);
+      ++keep;
+    }
+  tSlots.resize(keep);
+
+  CacheSlot slot;
+  slot.core_ = core_;
+  slot.cache_ = std::make_unique<LazyCache>(*core_);
+  tSlots.emplace_back(std::move(slot));
+  return *tSlots.back().cache_;
+}
+
+
+size_t LazyDfa::cachedStates() const {
+  return cache().numStates();
+}
+
+
+size_t LazyDfa::cacheFlushes() const {
+  return cache().flushes();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template <Style style>
+Result checkLazy(LazyCache &lc, const Byte *ptr, const Byte *end) {
+  uint32_t st = gLazyInitial;
+  Result result = lc.result(st);
+  Result prevResult = 0;
+
+  for (; ptr < end; ++ptr) {
+    st = lc.next(st, *ptr);
+    result = lc.result(st);
+    if (result > 0) {
+      if (style == styInstant)
+        return result;
+      if (style == styFirst) {
+        if (prevResult && (result != prevResult))
+          return prevResult;
+        prevResult = result;
+      }
+      if ((style == styTangent) || (style == styLast))
+        prevResult = result;
+    }
+    else {
+      if (((style == styFirst) || (style == styTangent)) && (prevResult > 0))
+        return prevResult;
+      if (st == gLazyError)
+        break;
+    }
+  }
+
+  if (style == styLast)
+    if ((result == 0) && (prevResult > 0))
+      return prevResult;
+
+  return result;
+}
+
+
+// Runs one attempt from the initial state at beg, leaving the match
+// bounds relative to beg.  Shared by match and search.  As in
+// matchCore() and searchCore(), an accepting initial state is no
+// match by itself, so only empty input gets its result.
+template <Style style>
+Result attemptLazy(LazyCache  &lc,
+                   const Byte *beg,
+                   const Byte *end,
+                   size_t     &matchStart,
+                   size_t     &matchEnd) {
+  uint32_t st = gLazyInitial;
+  Result result = lc.result(st);
+  Result prevResult = 0;
+  matchStart = 0;
+  matchEnd = 0;
+
+  size_t idx = 0;
+  for (const Byte *ptr = beg; ptr < end; ++ptr, ++idx) {
+    uint32_t prevSt = st;
+    st = lc.next(st, *ptr);
+    if ((prevSt == gLazyInitial) && (st != gLazyInitial))
+      matchStart = idx;
+    result = lc.result(st);
+    if (result > 0) {
+      if (style == styFirst) {
+        if (prevResult && (result != prevResult)) {
+          result = prevResult;
+          break;
+        }
+        prevResult = result;
+      }
+      matchEnd = idx + 1;
+      if (style == styInstant)
+        break;
+      if ((style == styTangent) || (style == styLast))
+        prevResult = result;
+    }
+    else {
+      if ((style == styFirst) && (prevResult > 0)) {
+        result = prevResult;
+        break;
+      }
+      if ((style == styTangent) && (prevResult > 0))
+        break;
+      if (st == gLazyError)
+        break;
+    }
+  }
+
+  if ((style == styTangent) || (style == styLast))
+    if ((result == 0) && (prevResult > 0))
+      result = prevResult;
+  return result;
+}
+
+
+template <Style style>
+Outcome matchLazy(LazyCache &lc, const Byte *beg, const Byte *end) {
+  Outcome rv = Outcome::fail();
+  size_t matchStart;
+  size_t matchEnd;
+  rv.result_ = attemptLazy<style>(lc, beg, end, matchStart, matchEnd);
+  if (rv.result_ > 0) {
+    rv.start_ = matchStart;
+    rv.end_   = matchEnd;
+  }
+  return rv;
+}
+
+
+template <Style style>
+Outcome searchLazy(LazyCache &lc, const Byte *beg, const Byte *end) {
+  Outcome rv = Outcome::fail();
+  if (beg == end) { // as searchCore(), which never starts an attempt
+    rv.result_ = lc.result(gLazyInitial);
+    return rv;
+  }
+  for (const Byte *ptr = beg; ptr < end; ++ptr) {
+    size_t matchStart;
+    size_t matchEnd;
+    Result result = attemptLazy<style>(lc, ptr, end, matchStart, matchEnd);
+    if (result > 0) {
+      size_t idx = static_cast<size_t>(ptr - beg);
+      rv.result_ = result;
+      rv.start_  = idx + matchStart;
+      rv.end_    = idx + matchEnd;
+      break;
+    }
+  }
+  return rv;
+}
+
+
+const Byte *bytes(const void *ptr) {
+  return static_cast<const Byte *>(ptr);
+}
+
+} // anonymous
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define LCASE(A_name, A_style, ...)       \
+  case A_style:                           \
+    return A_name<A_style>(__VA_ARGS__);
+
+
+// runtime dispatch based on match-style
+#define LAZY_SWITCH(A_name, ...)              \
+  switch(style) {                             \
+  LCASE(A_name, styInstant, __VA_ARGS__)      \
+  LCASE(A_name, styFirst,   __VA_ARGS__)      \
+  LCASE(A_name, styTangent, __VA_ARGS__)      \
+  LCASE(A_name, styLast,    __VA_ARGS__)      \
+  LCASE(A_name, styFull,    __VA_ARGS__)      \
+  default:                                    \
+    throw RedExceptExec("unsupported style"); \
+  }
+
+
+// generate check/match/search functions with different prototypes
+#define LAZY_SUITE(A_ret, A_name, A_core)                               \
+  A_ret A_name(const LazyDfa &lazy,                                     \
+               const void *ptr, size_t len, Style style) {              \
+    LAZY_SWITCH(A_core, lazy.cache(), bytes(ptr), bytes(ptr) + len)     \
+  }                                                                     \
+  A_ret A_name(const LazyDfa &lazy, const char *str, Style style) {     \
+    return A_name(lazy, str, strlen(str), style);                       \
+  }                                                                     \
+  A_ret A_name(const LazyDfa &lazy, const string &s, Style style) {     \
+    return A_name(lazy, s.data(), s.size(), style);                     \
+  }                                                                     \
+  A_ret A_name(const LazyDfa &lazy, string_view sv, Style style) {      \
+    return A_name(lazy, sv.data(), sv.size(), style);                   \
+  }
+
+
+LAZY_SUITE(Result, check, checkLazy)
+LAZY_SUITE(Outcome, match, matchLazy)
+LAZY_SUITE(Outcome, search, searchLazy)
+
+#undef LAZY_SUITE
+#undef LAZY_SWITCH
+#undef LCASE
+
+} // namespace zezax::red
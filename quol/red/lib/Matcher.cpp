@@ -101,6 +101,26 @@ size_t matchAll(const Executable &exec,
   ZEZAX_RED_FMT_SWITCH(matchAllCore, styTangent, true, exec, it, proxy, out)
 }
 
+
+// batched versions, for many short inputs
+
+void checkBatch(const Executable  &exec,
+                const string_view *inputs,
+                size_t             count,
+                Result            *out,
+                Style              style) {
+  STYLE_SWITCH(checkBatch, true, exec, inputs, count, out)
+}
+
+
+void matchBatch(const Executable  &exec,
+                const string_view *inputs,
+                size_t             count,
+                Outcome           *out,
+                Style              style) {
+  STYLE_SWITCH(matchBatch, true, exec, inputs, count, out)
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 StatefulMatcher::StatefulMatcher(const Executable &exec)
@@ -132,6 +152,34 @@ StatefulMatcher::StatefulMatcher(const Executable &exec)
     state_ = proxy.state();
     break;
   }
+  case fmtDirect8: {
+    DfaProxy<fmtDirect8> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    result_ = proxy.result();
+    state_ = proxy.state();
+    break;
+  }
+  case fmtFlat2: {
+    DfaProxy<fmtFlat2> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    result_ = proxy.result();
+    state_ = proxy.state();
+    break;
+  }
+  case fmtFlat4: {
+    DfaProxy<fmtFlat4> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    result_ = proxy.result();
+    state_ = proxy.state();
+    break;
+  }
+  case fmtComb4: {
+    DfaProxy<fmtComb4> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    result_ = proxy.result();
+    state_ = proxy.state();
+    break;
+  }
   default:
     throw RedExceptExec("unrecognized format");
   }
@@ -152,9 +200,329 @@ Result StatefulMatcher::advance(Byte input) {
     DfaProxy<fmtDirect4> proxy;
     return advanceCore(input, proxy);
   }
+  case fmtDirect8: {
+    DfaProxy<fmtDirect8> proxy;
+    return advanceCore(input, proxy);
+  }
+  case fmtFlat2: {
+    DfaProxy<fmtFlat2> proxy;
+    return advanceCore(input, proxy);
+  }
+  case fmtFlat4: {
+    DfaProxy<fmtFlat4> proxy;
+    return advanceCore(input, proxy);
+  }
+  case fmtComb4: {
+    DfaProxy<fmtComb4> proxy;
+    return advanceCore(input, proxy);
+  }
   default:
     throw RedExceptExec("unrecognized format");
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+StreamMatcher::StreamMatcher(const Executable &exec, Style style)
+  : fmt_(exec.getFormat()),
+    style_(style),
+    base_(exec.getBase()),
+    init_(nullptr),
+    equivMap_(exec.getEquivMap()),
+    skipper_(&exec.getSkipper()),
+    pos_(0),
+    restart_(0) {
+  if ((style < styInstant) || (style > styFull))
+    throw RedExceptExec("unsupported style");
+  const FileHeader *hdr = exec.getHeader();
+  switch (fmt_) {
+  case fmtDirect1: {
+    DfaProxy<fmtDirect1> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtDirect2: {
+    DfaProxy<fmtDirect2> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtDirect4: {
+    DfaProxy<fmtDirect4> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtDirect8: {
+    DfaProxy<fmtDirect8> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtFlat2: {
+    DfaProxy<fmtFlat2> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtFlat4: {
+    DfaProxy<fmtFlat4> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  case fmtComb4: {
+    DfaProxy<fmtComb4> proxy;
+    proxy.init(base_, hdr->initialOff_);
+    init_ = proxy.state();
+    break;
+  }
+  default:
+    throw RedExceptExec("unrecognized format");
+  }
+}
+
+
+void StreamMatcher::reset() {
+  pos_ = 0;
+  restart_ = 0;
+  attempts_.clear();
+  held_.clear();
+}
+
+
+size_t StreamMatcher::feed(string_view chunk, vector<Outcome> &out) {
+  return feed(chunk.data(), chunk.size(), out);
+}
+
+
+size_t StreamMatcher::feed(const void *ptr, size_t len, vector<Outcome> &out) {
+  size_t before = out.size();
+  const Byte *bp = static_cast<const Byte *>(ptr);
+  switch (style_) {
+  case styInstant: feedFormat<styInstant>(bp, len, out); break;
+  case styFirst:   feedFormat<styFirst>(bp, len, out);   break;
+  case styTangent: feedFormat<styTangent>(bp, len, out); break;
+  case styLast:    feedFormat<styLast>(bp, len, out);    break;
+  case styFull:    feedFormat<styFull>(bp, len, out);    break;
+  default:
+    throw RedExceptExec("unsupported style");
+  }
+  return out.size() - before;
+}
+
+
+size_t StreamMatcher::finish(vector<Outcome> &out) {
+  size_t before = out.size();
+  for (Attempt &at : attempts_) {
+    // same as the end-of-input handling in searchCore()
+    if ((style_ == styTangent) || (style_ == styLast))
+      if ((at.result_ == 0) && (at.prevResult_ > 0))
+        at.result_ = at.prevResult_;
+    at.done_ = true;
+  }
+  retire();
+  settle(out);
+  reset();
+  return out.size() - before;
+}
+
+
+template <Style style>
+void StreamMatcher::feedFormat(const Byte *ptr, size_t len,
+                               vector<Outcome> &out) {
+  switch (fmt_) {
+  case fmtDirect1:
+    feedCore<style, DfaProxy<fmtDirect1>>(ptr, len, out);
+    break;
+  case fmtDirect2:
+    feedCore<style, DfaProxy<fmtDirect2>>(ptr, len, out);
+    break;
+  case fmtDirect4:
+    feedCore<style, DfaProxy<fmtDirect4>>(ptr, len, out);
+    break;
+  case fmtDirect8:
+    feedCore<style, DfaProxy<fmtDirect8>>(ptr, len, out);
+    break;
+  case fmtFlat2:
+    feedCore<style, DfaProxy<fmtFlat2>>(ptr, len, out);
+    break;
+  case fmtFlat4:
+    feedCore<style, DfaProxy<fmtFlat4>>(ptr, len, out);
+    break;
+  case fmtComb4:
+    feedCore<style, DfaProxy<fmtComb4>>(ptr, len, out);
+    break;
+  default:
+    throw RedExceptExec("unrecognized format");
+  }
+}
+
+
+// Steps every undecided attempt through each byte, using the same rules
+// as the inner loop of searchCore(), then settles from the front.
+template <Style style, class DfaProxyT>
+void StreamMatcher::feedCore(const Byte      *ptr,
+                             size_t           len,
+                             vector<Outcome> &out) {
+  typedef typename DfaProxyT::State State;
+  const char *__restrict__ base = base_;
+  const Byte *__restrict__ equivMap = equivMap_;
+  const Skipper &skipper = *skipper_;
+
+  for (const Byte *end = ptr + len; ptr < end; ++ptr, ++pos_) {
+    if (attempts_.empty()) {
+      if (skipper.active() && (pos_ >= restart_))
+        while ((ptr < end) && !skipper.contains(*ptr)) {
+          ++ptr;
+          ++pos_;
+        }
+      if (ptr >= end)
+        break;
+    }
+    if ((pos_ >= restart_) && skipper.contains(*ptr))
+      attempts_.push_back(
+        Attempt{init_, pos_, pos_, gNoPos, 0, 0, false});
+
+    Byte byte = DfaProxyT::column(equivMap, *ptr);
+    bool settled = false;
+    for (Attempt &at : attempts_) {
+      DfaProxyT dproxy;
+      dproxy.restore(at.state_);
+      dproxy.next(base, byte);
+      const State *state = dproxy.state();
+      if ((at.state_ == init_) && (state != init_))
+        at.matchStart_ = pos_;
+      at.state_ = state;
+      Result result = dproxy.result();
+      at.result_ = result;
+      if (UNLIKELY(result > 0)) {
+        if (style == styFirst) {
+          if (at.prevResult_ && (result != at.prevResult_)) {
+            at.result_ = at.prevResult_;
+            at.done_ = true;
+            settled = true;
+            continue;
+          }
+          at.prevResult_ = result;
+        }
+        at.matchEnd_ = pos_ + 1;
+        if (style == styInstant)
+          at.done_ = true;
+        if ((style == styTangent) || (style == styLast))
+          at.prevResult_ = result;
+      }
+      else if (((style == styFirst) || (style == styTangent)) &&
+               (at.prevResult_ > 0)) {
+        at.result_ = at.prevResult_;
+        at.done_ = true;
+      }
+      else if (dproxy.pureDeadEnd()) {
+        if (((style == styTangent) || (style == styLast)) &&
+            (at.prevResult_ > 0))
+          at.result_ = at.prevResult_;
+        at.done_ = true;
+      }
+      settled |= at.done_;
+    }
+
+    if (settled)
+      retire();
+    if (attempts_.size() > 1)
+      merge();
+    settle(out);
+  }
+}
+
+
+// Moves decided attempts out of the way: matches are held back, in
+// order of start, and failures are dropped, since they can't be reported.
+void StreamMatcher::retire() {
+  for (const Attempt &at : attempts_) {
+    if (!at.done_ || (at.result_ <= 0) || (at.matchEnd_ == gNoPos))
+      continue;
+    auto it = std::upper_bound(held_.begin(), held_.end(), at.start_,
+                               [](size_t start, const Attempt &other) {
+                                 return (start < other.start_);
+                               });
+    held_.insert(it, at); // usually at the back
+  }
+  std::erase_if(attempts_, [](const Attempt &at) { return at.done_; });
+}
+
+
+// True if a match, undecided or held, begins before early and ends
+// between the starts of early and later.
+bool StreamMatcher::apart(size_t ii, const Attempt &early,
+                          const Attempt &later) const {
+  auto between = [&](const Attempt &other) {
+    return ((other.matchEnd_ != gNoPos) &&
+            (other.matchEnd_ > early.start_) &&
+            (other.matchEnd_ <= later.start_));
+  };
+  for (size_t kk = 0; kk < ii; ++kk)
+    if (between(attempts_[kk]))
+      return true;
+  for (const Attempt &other : held_) {
+    if (other.start_ >= early.start_)
+      break;
+    if (between(other))
+      return true;
+  }
+  return false;
+}
+
+
+// Drops an attempt that matches an earlier one in state and history,
+// since both must end the same way.  That's unsafe only if the earlier
+// attempt could be discarded by a match ending between the two starts,
+// leaving the later one alive, so such pairs are kept apart.
+void StreamMatcher::merge() {
+  size_t num = attempts_.size();
+  for (size_t jj = 1; jj < num; ++jj) {
+    const Attempt &later = attempts_[jj];
+    for (size_t ii = 0; ii < jj; ++ii) {
+      const Attempt &early = attempts_[ii];
+      if ((early.state_ != later.state_) ||
+          (early.prevResult_ != later.prevResult_) ||
+          (early.matchEnd_ != later.matchEnd_))
+        continue;
+      if (!apart(ii, early, later)) {
+        attempts_.erase(attempts_.begin() + static_cast<ptrdiff_t>(jj));
+        --jj;
+        --num;
+        break;
+      }
+    }
+  }
+}
+
+
+// Reports held matches that no undecided attempt precedes, leftmost
+// first, as repeated search() would.  A match discards everything that
+// began within it.  The first undecided attempt, once it has matched,
+// is sure to be reported with at least that much, so what begins
+// within that is discarded already.
+void StreamMatcher::settle(vector<Outcome> &out) {
+  while (!held_.empty() && (attempts_.empty() ||
+                            (held_.front().start_ < attempts_.front().start_))) {
+    const Attempt &at = held_.front();
+    out.push_back(Outcome{at.result_, at.matchStart_, at.matchEnd_});
+    restart_ = at.matchEnd_;
+    held_.pop_front();
+    while (!held_.empty() && (held_.front().start_ < restart_))
+      held_.pop_front();
+    while (!attempts_.empty() && (attempts_.front().start_ < restart_))
+      attempts_.pop_front();
+  }
+  if (attempts_.empty() || (attempts_.front().prevResult_ <= 0))
+    return;
+  size_t covered = attempts_.front().matchEnd_;
+  while (!held_.empty() && (held_.front().start_ < covered))
+    held_.pop_front();
+  while ((attempts_.size() > 1) && (attempts_[1].start_ < covered))
+    attempts_.erase(attempts_.begin() + 1);
+}
+
 } // namespace zezax::red
@@ -21,9 +21,9 @@
    All non-accepting states are one block.  Accepting states are
    in blocks based on the value of their result.
 
-   The algorithm begins with either the accepting or non-accepting
-   preliminary blocks added to a set of blocks to be processed
-   (called the "list").  The main loop runs until the list is empty.
+   The algorithm begins with all the preliminary blocks but the
+   largest added to a set of blocks to be processed (called the
+   "list").  The main loop runs until the list is empty.
    It tries to split each block.  If posible, the resulting blocks
    may be added to the list.  Often only the smaller block must be
    added.  Eventually, all blocks will be handled.
@@ -31,10 +31,22 @@
    After minimization, dead-end states are flagged.  These are states
    which cannot be escaped regardless of input.  Thus the DFA result
    can't change and no further processing of input is warranted.
+
+   RefineMinimizer first drops states that can't reach any accepting
+   state; they're all the same as the error state.  What remains is a
+   partial DFA, and transitions into the error state are left out.
+   Blocks of states and cords of transitions are each a Refinable
+   partition.  Cords start out by character and blocks by result.
+   Marking the tails of a cord's transitions splits blocks, and
+   marking the transitions into a new block splits cords, until
+   neither changes.  Only the smaller part of a split is processed
+   again, and one initial block needn't be processed at all.
  */
 
 #include "Minimizer.h"
 
+#include <algorithm>
+#include <limits>
 #include <map>
 
 #include "Except.h"
@@ -64,10 +76,67 @@ BlockId findInBlock(DfaId id, const vector<DfaIdSet> &blocks) {
   throw RedExceptMinimize("no block containing state");
 }
 
+
+constexpr uint32_t gNoElem = std::numeric_limits<uint32_t>::max();
+
 } // anonymous
 
 ///////////////////////////////////////////////////////////////////////////////
 
+Refinable::Refinable(uint32_t size)
+  : numSets_((size > 0) ? 1 : 0),
+    elems_(size),
+    locs_(size),
+    sets_(size, 0),
+    firsts_(size, 0),
+    pasts_(size, 0),
+    marked_(size, 0) {
+  touched_.reserve(size);
+  for (uint32_t ii = 0; ii < size; ++ii)
+    elems_[ii] = locs_[ii] = ii;
+  if (size > 0)
+    pasts_[0] = size;
+}
+
+
+void Refinable::mark(uint32_t elem) {
+  uint32_t set = sets_[elem];
+  uint32_t ii = locs_[elem];
+  uint32_t jj = firsts_[set] + marked_[set];
+  elems_[ii] = elems_[jj];
+  locs_[elems_[ii]] = ii;
+  elems_[jj] = elem;
+  locs_[elem] = jj;
+  if (marked_[set]++ == 0)
+    touched_.push_back(set);
+}
+
+
+void Refinable::split() {
+  while (!touched_.empty()) {
+    uint32_t set = touched_.back();
+    touched_.pop_back();
+    uint32_t mid = firsts_[set] + marked_[set];
+    marked_[set] = 0;
+    if (mid == pasts_[set])
+      continue; // all marked, so nothing to split off
+
+    uint32_t novel = numSets_++;
+    if (mid - firsts_[set] <= pasts_[set] - mid) {
+      firsts_[novel] = firsts_[set];
+      pasts_[novel] = firsts_[set] = mid;
+    }
+    else {
+      pasts_[novel] = pasts_[set];
+      firsts_[novel] = pasts_[set] = mid;
+    }
+    for (uint32_t ii = firsts_[novel]; ii < pasts_[novel]; ++ii)
+      sets_[elems_[ii]] = novel;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void DfaMinimizer::minimize() {
   if (stats_)
     stats_->preMinimize_ = std::chrono::steady_clock::now();
@@ -120,7 +189,7 @@ void DfaMinimizer::iterate() {
     BlockRec &br = node.value();
     DfaIdSet splits = locateSplits(br, blocks_, inverse_);
     if (!splits.empty()) {
-      performSplits(br, splits, twins, patches, src_.getStates(), blocks_);
+      performSplits(splits, twins, patches, blocks_);
       patchBlocks(patches, list_, maxChar_, blocks_);
     }
   }
@@ -139,6 +208,185 @@ void DfaMinimizer::cleanup(DfaObj &work) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void RefineMinimizer::minimize() {
+  if (stats_)
+    stats_->preMinimize_ = std::chrono::steady_clock::now();
+
+  CharIdx maxChar = src_.installEquivalenceMap();
+  if (stats_)
+    stats_->postEquivMap_ = std::chrono::steady_clock::now();
+
+  const vector<DfaState> &states = src_.getStates();
+  vector<DfaId> reach;
+  for (DfaId id : src_.allStateIds())
+    reach.push_back(id);
+
+  // find states that can reach acceptance by walking edges backward
+  vector<bool> relevant(states.size(), false);
+  {
+    vector<size_t> starts(states.size() + 1, 0);
+    for (DfaId id : reach)
+      for (auto [_, next] : states[id].transitions_.getMap())
+        ++starts[next + 1];
+    for (size_t ii = 1; ii < starts.size(); ++ii)
+      starts[ii] += starts[ii - 1];
+    vector<DfaId> froms(starts.back());
+    {
+      vector<size_t> fill(starts.begin(), starts.end() - 1);
+      for (DfaId id : reach)
+        for (auto [_, next] : states[id].transitions_.getMap())
+          froms[fill[next]++] = id;
+    }
+
+    vector<DfaId> todo;
+    for (DfaId id : reach)
+      if (states[id].result_ != 0) {
+        relevant[id] = true;
+        todo.push_back(id);
+      }
+    while (!todo.empty()) {
+      DfaId id = todo.back();
+      todo.pop_back();
+      for (size_t ii = starts[id]; ii < starts[id + 1]; ++ii)
+        if (!relevant[froms[ii]]) {
+          relevant[froms[ii]] = true;
+          todo.push_back(froms[ii]);
+        }
+    }
+  }
+
+  // number the relevant states densely, and list transitions among them
+  vector<DfaId>    rel;
+  vector<uint32_t> local(states.size(), gNoElem);
+  for (DfaId id : reach)
+    if (relevant[id]) {
+      local[id] = static_cast<uint32_t>(rel.size());
+      rel.push_back(id);
+    }
+  relevant.clear();
+  relevant.shrink_to_fit();
+
+  const uint32_t numStates = static_cast<uint32_t>(rel.size());
+  vector<uint32_t> tails;
+  vector<uint32_t> heads;
+  vector<CharIdx>  chars;
+  for (uint32_t ss = 0; ss < numStates; ++ss)
+    for (auto [ch, next] : states[rel[ss]].transitions_.getMap())
+      if (local[next] != gNoElem) {
+        if (tails.size() >= gNoElem)
+          throw RedExceptMinimize("too many transitions to minimize");
+        tails.push_back(ss);
+        heads.push_back(local[next]);
+        chars.push_back(ch);
+      }
+  const uint32_t numTrans = static_cast<uint32_t>(tails.size());
+
+  // transitions into each state, for splitting cords by block
+  vector<uint32_t> inStarts(numStates + 1, 0);
+  vector<uint32_t> inTrans(numTrans);
+  for (uint32_t tt = 0; tt < numTrans; ++tt)
+    ++inStarts[heads[tt] + 1];
+  for (uint32_t ss = 1; ss <= numStates; ++ss)
+    inStarts[ss] += inStarts[ss - 1];
+  {
+    vector<uint32_t> fill(inStarts.begin(), inStarts.end() - 1);
+    for (uint32_t tt = 0; tt < numTrans; ++tt)
+      inTrans[fill[heads[tt]]++] = tt;
+  }
+  heads.clear();
+  heads.shrink_to_fit();
+  if (stats_)
+    stats_->postInvert_ = std::chrono::steady_clock::now();
+
+  Refinable blocks(numStates);
+  {
+    vector<uint32_t> order(numStates);
+    for (uint32_t ss = 0; ss < numStates; ++ss)
+      order[ss] = ss;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t aa, uint32_t bb) {
+                       return states[rel[aa]].result_ < states[rel[bb]].result_;
+                     });
+    splitRuns(blocks, order, [&](uint32_t aa, uint32_t bb) {
+      return states[rel[aa]].result_ == states[rel[bb]].result_;
+    });
+  }
+
+  Refinable cords(numTrans);
+  {
+    vector<uint32_t> order(numTrans);
+    for (uint32_t tt = 0; tt < numTrans; ++tt)
+      order[tt] = tt;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t aa, uint32_t bb) {
+                       return chars[aa] < chars[bb];
+                     });
+    splitRuns(cords, order, [&](uint32_t aa, uint32_t bb) {
+      return chars[aa] == chars[bb];
+    });
+  }
+  chars.clear();
+  chars.shrink_to_fit();
+  if (stats_) {
+    stats_->postPartition_ = std::chrono::steady_clock::now();
+    stats_->postMakeList_  = stats_->postPartition_;
+  }
+
+  // block zero needn't split anything, as the others already do
+  uint32_t bb = 1;
+  for (uint32_t cc = 0; cc < cords.numSets(); ++cc) {
+    for (const uint32_t *tt = cords.begin(cc); tt != cords.end(cc); ++tt)
+      blocks.mark(tails[*tt]);
+    blocks.split();
+    for (; bb < blocks.numSets(); ++bb) {
+      for (const uint32_t *ss = blocks.begin(bb); ss != blocks.end(bb); ++ss)
+        for (uint32_t ii = inStarts[*ss]; ii < inStarts[*ss + 1]; ++ii)
+          cords.mark(inTrans[ii]);
+      cords.split();
+    }
+  }
+
+  // one state per block, keeping the error and initial ids
+  DfaObj work(src_.getBudget());
+  DfaId errId  = work.newState();
+  DfaId initId = work.newState();
+  if ((errId != gDfaErrorId) || (initId != gDfaInitialId))
+    throw RedExceptMinimize("dfa state ids not what was expected");
+
+  const uint32_t numBlocks = blocks.numSets();
+  vector<DfaId> blockIds(numBlocks, gDfaErrorId);
+  uint32_t initLocal = local[gDfaInitialId];
+  if (initLocal != gNoElem)
+    blockIds[blocks.setOf(initLocal)] = gDfaInitialId;
+  for (uint32_t blk = 0; blk < numBlocks; ++blk)
+    if (blockIds[blk] == gDfaErrorId)
+      blockIds[blk] = work.newState();
+
+  for (uint32_t blk = 0; blk < numBlocks; ++blk) {
+    const DfaState &srcState = states[rel[*blocks.begin(blk)]];
+    DfaState &outState = work[blockIds[blk]];
+    for (auto [ch, next] : srcState.transitions_.getMap()) {
+      uint32_t loc = local[next];
+      if (loc != gNoElem)
+        outState.transitions_.emplace(ch, blockIds[blocks.setOf(loc)]);
+    }
+    outState.result_  = srcState.result_;
+    outState.deadEnd_ = srcState.deadEnd_;
+  }
+
+  work.copyEquivMap(src_);
+  flagDeadEnds(work.getMutStates(), maxChar);
+  src_.swap(work);
+
+  if (stats_) {
+    stats_->minimizedDfaStates_      = src_.numStates();
+    stats_->numDistinguishedSymbols_ = maxChar + 1;
+    stats_->postMinimize_            = std::chrono::steady_clock::now();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 DfaEdgeToIds invert(const DfaIdSet         &stateSet,
                     const vector<DfaState> &stateVec,
                     CharIdx                 maxChar) {
@@ -184,25 +432,21 @@ void partition(const DfaIdSet         &stateSet,
 }
 
 
-// Create the initial work list: either rejecting block or all accepting
+// Create the initial work list: every block but the largest.  Leaving
+// out more than one would miss splits between those left out, as when
+// several accepting blocks share few transitions with the rest.
 BlockRecSet makeList(CharIdx                 maxChar,
                      const vector<DfaIdSet> &blocks) {
-  DfaId zeroSize = blocks[0].size();
-  DfaId restSize = 0;
-
   BlockId num = static_cast<BlockId>(blocks.size());
+  BlockId largest = 0;
   for (BlockId bid = 1; bid < num; ++bid)
-    restSize += blocks[bid].size();
-
-  BlockId start = 0;
-  BlockId end = 1;
-  if ((restSize > 0) && (restSize < zeroSize)) {
-    start = 1;
-    end = num;
-  }
+    if (blocks[bid].size() > blocks[largest].size())
+      largest = bid;
 
   BlockRecSet list;
-  for (BlockId bid = start; bid < end; ++bid) {
+  for (BlockId bid = 0; bid < num; ++bid) {
+    if ((bid == largest) && (num > 1))
+      continue;
     BlockRec br;
     br.block_ = bid;
     for (CharIdx ch = 0; ch <= maxChar; ++ch) {
@@ -231,35 +475,28 @@ DfaIdSet locateSplits(const BlockRec         &blockRec,
 }
 
 
-void performSplits(const BlockRec         &blockRec,
-                   const DfaIdSet         &splits,
-                   vector<BlockId>        &twins,
-                   PatchSet               &patches,
-                   const vector<DfaState> &stateVec,
-                   vector<DfaIdSet>       &blockVec) {
+// Splits off the members of splits from each block they only partly
+// fill.  That's judged against splits, which stays put, rather than
+// the splitter block, which may itself be split along the way.
+void performSplits(const DfaIdSet   &splits,
+                   vector<BlockId>  &twins,
+                   PatchSet         &patches,
+                   vector<DfaIdSet> &blockVec) {
   twins.clear(); // forget old
   for (DfaId splitId : splits) {
     BlockId blockNum = findInBlock(splitId, blockVec);
-    if (!containedIn(blockNum, blockRec.block_, blockRec.char_,
-                     stateVec, blockVec))
+    if (!containedIn(blockNum, splits, blockVec))
       handleTwins(splitId, blockNum, blockVec, twins, patches);
   }
 }
 
 
 bool containedIn(BlockId                 needleId,
-                 BlockId                 haystackId,
-                 CharIdx                 ch,
-                 const vector<DfaState> &stateVec,
+                 const DfaIdSet         &haystack,
                  const vector<DfaIdSet> &blockVec) {
-  const DfaIdSet &needle   = blockVec[needleId];
-  const DfaIdSet &haystack = blockVec[haystackId];
-
-  for (DfaId id : needle) {
-    const DfaState &ds = stateVec[id];
-    if (!haystack.get(ds.transitions_[ch]))
+  for (DfaId id : blockVec[needleId])
+    if (!haystack.get(id))
       return false;
-  }
 
   return true;
 }
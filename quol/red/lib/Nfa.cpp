@@ -5,6 +5,7 @@
 
 #include "Nfa.h"
 
+#include <algorithm>
 #include <limits>
 #include <utility>
 
@@ -326,10 +327,9 @@ NfaId NfaObj::stateEndMark(CharIdx res) {
 
 
 void NfaObj::selfUnion(NfaId id) {
-  if (initId_)
-    initId_ = stateUnion(initId_, id);
-  else
-    initId_ = id;
+  if (!initId_) // keep distinct, else loops back to id would see all others
+    initId_ = newState(0);
+  initId_ = stateUnion(initId_, id);
 }
 
 
@@ -353,6 +353,165 @@ void NfaObj::dropUselessTransitions() { // also de-dup transitions
   }
 }
 
+
+// Returns the longest string that appears within every match, excluding
+// any that begins at the initial state, as the leader covers those.
+// Dominators are per Cooper, Harvey & Kennedy, "A Simple, Fast Dominance
+// Algorithm".  Acceptance is modeled as an extra sink node.
+std::string NfaObj::requiredLiteral() const {
+  std::string rv;
+  NfaId num = static_cast<NfaId>(states_.size());
+  if ((initId_ == gNfaNullId) || (initId_ >= num))
+    return rv;
+
+  // successors of each state; end marks and accepting states lead to sink
+  const NfaId sink = num;
+  auto successors = [this, sink](NfaId id) {
+    vector<NfaId> succ;
+    if (id == sink)
+      return succ;
+    const NfaState &ns = states_[id];
+    if (stateAccepts(ns))
+      succ.push_back(sink);
+    for (const NfaTransition &tr : ns.transitions_) {
+      bool raw = false;
+      bool mark = false;
+      for (CharIdx ch : tr.multiChar_) {
+        if (ch < gAlphabetSize)
+          raw = true;
+        else
+          mark = true;
+      }
+      if (raw)
+        succ.push_back(tr.next_);
+      if (mark)
+        succ.push_back(sink);
+    }
+    return succ;
+  };
+
+  // depth-first postorder numbering, iteratively
+  constexpr uint32_t none = numeric_limits<uint32_t>::max();
+  vector<uint32_t> post(states_.size() + 1, none);
+  vector<NfaId> order; // by postorder number
+  vector<vector<NfaId>> preds(states_.size() + 1);
+  {
+    vector<std::pair<NfaId, vector<NfaId>>> stack;
+    vector<bool> seen(states_.size() + 1, false);
+    seen[initId_] = true;
+    stack.emplace_back(initId_, successors(initId_));
+    while (!stack.empty()) {
+      auto &[id, succ] = stack.back();
+      if (succ.empty()) {
+        post[id] = static_cast<uint32_t>(order.size());
+        order.push_back(id);
+        stack.pop_back();
+        continue;
+      }
+      NfaId next = succ.back();
+      succ.pop_back();
+      preds[next].push_back(id);
+      if (!seen[next]) {
+        seen[next] = true;
+        stack.emplace_back(next, successors(next)); // invalidates id, succ
+      }
+    }
+  }
+  if (post[sink] == none)
+    return rv; // nothing accepts
+
+  // iterate to fixed point in reverse postorder
+  vector<uint32_t> idom(order.size(), none); // by postorder number
+  uint32_t start = post[initId_];
+  idom[start] = start;
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (size_t ii = order.size(); ii-- > 0; ) {
+      if (ii == start)
+        continue;
+      uint32_t best = none;
+      for (NfaId pred : preds[order[ii]]) {
+        uint32_t pp = post[pred];
+        if (idom[pp] == none)
+          continue;
+        if (best == none) {
+          best = pp;
+          continue;
+        }
+        while (pp != best) { // intersect
+          while (pp < best)
+            pp = idom[pp];
+          while (best < pp)
+            best = idom[best];
+        }
+      }
+      if (idom[ii] != best) {
+        idom[ii] = best;
+        changed = true;
+      }
+    }
+  }
+
+  // walk the dominator chain from initial state to sink
+  vector<NfaId> chain;
+  for (uint32_t pp = post[sink]; pp != start; pp = idom[pp])
+    chain.push_back(order[pp]);
+  chain.push_back(initId_);
+  std::reverse(chain.begin(), chain.end());
+  chain.pop_back(); // sink
+
+  // the sole byte on which each state is entered, or exited, if any
+  constexpr int unset = -1;
+  constexpr int mixed = -2;
+  auto label = [](const NfaTransition &tr) {
+    if (tr.multiChar_.population() != 1)
+      return mixed;
+    CharIdx ch = *tr.multiChar_.begin();
+    return (ch < gAlphabetSize) ? static_cast<int>(ch) : mixed;
+  };
+  auto merge = [](int &acc, int lab) {
+    acc = ((acc == unset) || (acc == lab)) ? lab : mixed;
+  };
+  vector<int> entry(states_.size(), unset);
+  for (NfaId id : order)
+    if (id != sink)
+      for (const NfaTransition &tr : states_[id].transitions_)
+        merge(entry[tr.next_], label(tr));
+
+  // A dominator's exit byte is required, and follows immediately after
+  // its entry byte.  Runs continue while exits all lead to the next one.
+  std::string run;
+  bool atStart = false;
+  bool linked = false; // at this state right after the last byte of run
+  for (size_t ii = 0; ii < chain.size(); ++ii) {
+    const NfaState &ns = states_[chain[ii]];
+    int exit = unset;
+    bool toNext = true;
+    if (!stateAccepts(ns))
+      for (const NfaTransition &tr : ns.transitions_) {
+        merge(exit, label(tr));
+        if (((ii + 1) >= chain.size()) || (tr.next_ != chain[ii + 1]))
+          toNext = false;
+      }
+    if (!linked) {
+      if (!atStart && (run.size() > rv.size()))
+        rv = run;
+      run.clear();
+      atStart = (ii == 0);
+      if ((ii > 0) && (entry[chain[ii]] >= 0)) // initial needs no entry
+        run.push_back(static_cast<char>(entry[chain[ii]]));
+    }
+    linked = false;
+    if (exit >= 0) {
+      run.push_back(static_cast<char>(exit));
+      linked = toNext;
+    }
+  }
+  if (!atStart && (run.size() > rv.size()))
+    rv = run;
+  return rv;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 NfaId NfaObj::copyRecurse(unordered_map<NfaId, NfaId> &map, NfaId id) {
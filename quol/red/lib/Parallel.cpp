@@ -0,0 +1,464 @@
+/* Parallel.cpp - multi-threaded matching of one huge input - implementation
+
+   See general description in Parallel.h
+
+   The speculative approach is that of Mytkowicz, Musuvathi and Schulte,
+   "Data-Parallel Finite-State Machines", ASPLOS 2014.  Their key
+   observation is that walks from different start states converge
+   quickly in practice, so tracking one walk per distinct current state
+   costs little more than a single walk.
+ */
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <thread>
+
+#include "Except.h"
+
+namespace zezax::red {
+
+using std::string_view;
+using std::vector;
+
+namespace {
+
+constexpr size_t gAllStatesMax = 64;  // try every state of a DFA this small
+constexpr size_t gLookback     = 64;  // bytes run to guess a start state
+constexpr size_t gMergeBlock   = 256; // bytes between convergence checks
+constexpr size_t gMaxPaths     = 8;   // more than this, keep likely ones
+
+struct Path { // one speculative walk through a chunk
+  const void *state_;
+  Result      last_; // most recent accepting result, or zero
+};
+
+
+struct Chunk {
+  const Byte          *beg_;
+  const Byte          *end_;
+  vector<const void *> starts_; // candidate start states, sorted
+  vector<size_t>       pathOf_; // index into paths_ for each of starts_
+  vector<Path>         paths_;
+};
+
+
+struct Collected { // outcomes found within a chunk
+  vector<Outcome> outs_;   // start_ is gNoPos if carried from before
+  size_t          extend_; // new end for the prior outcome, or zero
+  size_t          escape_; // last place initial state was left, or gNoPos
+};
+
+
+void joinAll(vector<std::thread> &workers) {
+  for (std::thread &th : workers)
+    if (th.joinable())
+      th.join();
+}
+
+
+vector<Chunk> split(const Byte *ptr,
+                    size_t      len,
+                    unsigned    threads,
+                    size_t      minChunk) {
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1U);
+  size_t num = std::min<size_t>(threads, len / std::max<size_t>(minChunk, 1));
+  num = std::max<size_t>(num, 1);
+  vector<Chunk> rv(num);
+  for (size_t ii = 0; ii < num; ++ii) {
+    rv[ii].beg_ = ptr + (len * ii) / num;
+    rv[ii].end_ = ptr + (len * (ii + 1)) / num;
+  }
+  return rv;
+}
+
+
+template <bool track, class DfaProxyT>
+Path walk(const char *base,
+          const Byte *equivMap,
+          Path        path,
+          const Byte *ptr,
+          const Byte *end) {
+  DfaProxyT dfap;
+  dfap.restore(path.state_);
+  for (; ptr < end; ++ptr) {
+    if (dfap.pureDeadEnd())
+      break; // stays put and never accepts
+    dfap.next(base, dfap.column(equivMap, *ptr));
+    if (track) {
+      Result result = dfap.result();
+      if (result > 0)
+        path.last_ = result;
+    }
+  }
+  path.state_ = dfap.state();
+  return path;
+}
+
+
+bool pathLess(const Path &aa, const Path &bb) {
+  if (aa.state_ != bb.state_)
+    return std::less<const void *>()(aa.state_, bb.state_);
+  return (aa.last_ < bb.last_);
+}
+
+
+struct PathIdxLess {
+  const vector<Path> &paths_;
+
+  bool operator()(size_t aa, size_t bb) const {
+    return pathLess(paths_[aa], paths_[bb]);
+  }
+};
+
+
+// combines walks that reached the same state with the same history
+void merge(Chunk &chunk) {
+  vector<Path> &paths = chunk.paths_;
+  vector<size_t> order(paths.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), PathIdxLess{paths});
+
+  vector<size_t> remap(paths.size());
+  vector<Path> merged;
+  for (size_t idx : order) {
+    const Path &path = paths[idx];
+    if (merged.empty() || pathLess(merged.back(), path))
+      merged.push_back(path);
+    remap[idx] = merged.size() - 1;
+  }
+  for (size_t &pp : chunk.pathOf_)
+    pp = remap[pp];
+  paths.swap(merged);
+}
+
+
+// drops walks not begun from a preferred state, in case they never converge
+void prune(Chunk &chunk, const vector<const void *> &preferred) {
+  vector<const void *> starts;
+  vector<size_t> pathOf;
+  vector<size_t> remap(chunk.paths_.size(), gNoPos);
+  vector<Path> paths;
+  for (size_t ii = 0; ii < chunk.starts_.size(); ++ii) {
+    const void *start = chunk.starts_[ii];
+    if (!std::binary_search(preferred.begin(), preferred.end(), start,
+                            std::less<const void *>()))
+      continue;
+    size_t &idx = remap[chunk.pathOf_[ii]];
+    if (idx == gNoPos) {
+      idx = paths.size();
+      paths.push_back(chunk.paths_[chunk.pathOf_[ii]]);
+    }
+    starts.push_back(start);
+    pathOf.push_back(idx);
+  }
+  chunk.starts_.swap(starts);
+  chunk.pathOf_.swap(pathOf);
+  chunk.paths_.swap(paths);
+}
+
+
+template <bool track, class DfaProxyT>
+void speculate(const Executable *exec, const Byte *whole, Chunk *chunk) {
+  const FileHeader *hdr = exec->getHeader();
+  const char *base = exec->getBase();
+  const Byte *equivMap = exec->getEquivMap();
+  DfaProxyT dfap;
+  dfap.init(base, hdr->initialOff_);
+  const void *init = dfap.state();
+
+  // the error state comes first; also guess from the bytes just before
+  vector<const void *> preferred = {base, init};
+  size_t back = std::min(gLookback, static_cast<size_t>(chunk->beg_ - whole));
+  preferred.push_back(walk<false, DfaProxyT>(base, equivMap, Path{init, 0},
+                                             chunk->beg_ - back,
+                                             chunk->beg_).state_);
+  std::sort(preferred.begin(), preferred.end(), std::less<const void *>());
+  preferred.erase(std::unique(preferred.begin(), preferred.end()),
+                  preferred.end());
+
+  vector<const void *> &starts = chunk->starts_;
+  if (chunk->beg_ == whole)
+    starts.push_back(init);
+  else if (hdr->stateCnt_ <= gAllStatesMax) {
+    size_t size = DfaProxyT::stateSize(hdr->maxChar_);
+    for (size_t ii = 0; ii < hdr->stateCnt_; ++ii)
+      starts.push_back(base + (ii * size));
+  }
+  else
+    starts = preferred;
+
+  for (size_t ii = 0; ii < starts.size(); ++ii) {
+    chunk->paths_.push_back(Path{starts[ii], 0});
+    chunk->pathOf_.push_back(ii);
+  }
+
+  for (const Byte *ptr = chunk->beg_; ptr < chunk->end_; ) {
+    size_t left = static_cast<size_t>(chunk->end_ - ptr);
+    const Byte *stop = ptr + std::min(left, gMergeBlock);
+    for (Path &path : chunk->paths_)
+      path = walk<track, DfaProxyT>(base, equivMap, path, ptr, stop);
+    ptr = stop;
+    if (chunk->paths_.size() > 1)
+      merge(*chunk);
+    if (chunk->paths_.size() > gMaxPaths)
+      prune(*chunk, preferred);
+  }
+}
+
+
+template <bool track, class DfaProxyT>
+void speculateAll(const Executable &exec,
+                  const Byte       *whole,
+                  vector<Chunk>    &chunks) {
+  vector<std::thread> workers;
+  try {
+    for (size_t ii = 1; ii < chunks.size(); ++ii)
+      workers.emplace_back(speculate<track, DfaProxyT>,
+                           &exec, whole, &chunks[ii]);
+    speculate<track, DfaProxyT>(&exec, whole, &chunks[0]);
+  }
+  catch (...) {
+    joinAll(workers);
+    throw;
+  }
+  joinAll(workers);
+}
+
+
+// the walk from the true start state, rerun here if it wasn't speculated
+template <bool track, class DfaProxyT>
+Path follow(const Executable &exec, const Chunk &chunk, const void *state) {
+  const vector<const void *> &starts = chunk.starts_;
+  auto it = std::lower_bound(starts.begin(), starts.end(), state,
+                             std::less<const void *>());
+  if ((it != starts.end()) && (*it == state))
+    return chunk.paths_[chunk.pathOf_[static_cast<size_t>(
+      it - starts.begin())]];
+  return walk<track, DfaProxyT>(exec.getBase(), exec.getEquivMap(),
+                                Path{state, 0}, chunk.beg_, chunk.end_);
+}
+
+
+template <bool track, class DfaProxyT>
+Result checkChunks(const Executable &exec,
+                   const Byte       *whole,
+                   vector<Chunk>    &chunks) {
+  speculateAll<track, DfaProxyT>(exec, whole, chunks);
+
+  DfaProxyT dfap;
+  dfap.init(exec.getBase(), exec.getHeader()->initialOff_);
+  const void *state = dfap.state();
+  Result last = 0;
+  for (const Chunk &chunk : chunks) {
+    Path path = follow<track, DfaProxyT>(exec, chunk, state);
+    state = path.state_;
+    if (path.last_ > 0)
+      last = path.last_;
+  }
+  if (track)
+    return last;
+  dfap.restore(state);
+  return dfap.result();
+}
+
+
+template <class DfaProxyT>
+Result checkFormat(const Executable &exec,
+                   const Byte       *whole,
+                   vector<Chunk>    &chunks,
+                   Style             style) {
+  if (style == styLast)
+    return checkChunks<true, DfaProxyT>(exec, whole, chunks);
+  return checkChunks<false, DfaProxyT>(exec, whole, chunks);
+}
+
+
+// same as the loop in matchAllCore(), but from any state
+template <class DfaProxyT>
+void collect(const Executable *exec,
+             const Byte       *whole,
+             const Chunk      *chunk,
+             const void       *start,
+             Collected        *col) {
+  const char *__restrict__ base = exec->getBase();
+  const Byte *__restrict__ equivMap = exec->getEquivMap();
+  DfaProxyT dfap;
+  dfap.init(base, exec->getHeader()->initialOff_);
+  const void *init = dfap.state();
+
+  bool first = (chunk->beg_ == whole);
+  dfap.restore(start);
+  Result prevResult = first ? 0 : dfap.result();
+  size_t matchStart = first ? 0 : gNoPos;
+  col->extend_ = 0;
+  col->escape_ = gNoPos;
+  size_t idx = static_cast<size_t>(chunk->beg_ - whole);
+
+  for (const Byte *ptr = chunk->beg_; ptr < chunk->end_; ++ptr, ++idx) {
+    Byte byte = dfap.column(equivMap, *ptr);
+    if (UNLIKELY(dfap.state() == init)) {
+      dfap.next(base, byte);
+      if (dfap.state() != init) {
+        matchStart = idx;
+        col->escape_ = idx;
+      }
+    }
+    else
+      dfap.next(base, byte);
+    Result result = dfap.result();
+    if (UNLIKELY(result > 0)) {
+      if (result != prevResult) {
+        prevResult = result;
+        col->outs_.emplace_back(Outcome{result, matchStart, idx + 1});
+      }
+      else if (col->outs_.empty())
+        col->extend_ = idx + 1;
+      else
+        col->outs_.back().end_ = idx + 1;
+    }
+    else {
+      if (dfap.pureDeadEnd())
+        break;
+      prevResult = 0;
+    }
+  }
+}
+
+
+template <class DfaProxyT>
+size_t matchAllChunks(const Executable &exec,
+                      const Byte       *whole,
+                      vector<Chunk>    &chunks,
+                      vector<Outcome>  &out) {
+  speculateAll<false, DfaProxyT>(exec, whole, chunks);
+
+  size_t num = chunks.size();
+  vector<const void *> starts(num);
+  DfaProxyT dfap;
+  dfap.init(exec.getBase(), exec.getHeader()->initialOff_);
+  const void *state = dfap.state();
+  for (size_t ii = 0; ii < num; ++ii) {
+    starts[ii] = state;
+    state = follow<false, DfaProxyT>(exec, chunks[ii], state).state_;
+  }
+
+  vector<Collected> cols(num);
+  vector<std::thread> workers;
+  try {
+    for (size_t ii = 1; ii < num; ++ii)
+      workers.emplace_back(collect<DfaProxyT>,
+                           &exec, whole, &chunks[ii], starts[ii], &cols[ii]);
+    collect<DfaProxyT>(&exec, whole, &chunks[0], starts[0], &cols[0]);
+  }
+  catch (...) {
+    joinAll(workers);
+    throw;
+  }
+  joinAll(workers);
+
+  size_t carried = 0; // where the initial state was last left
+  for (const Collected &col : cols) {
+    if ((col.extend_ > 0) && !out.empty())
+      out.back().end_ = col.extend_;
+    for (Outcome oc : col.outs_) {
+      if (oc.start_ == gNoPos)
+        oc.start_ = carried;
+      out.push_back(oc);
+    }
+    if (col.escape_ != gNoPos)
+      carried = col.escape_;
+  }
+  return out.size();
+}
+
+} // anonymous
+
+Result checkParallel(const Executable &exec,
+                     const void       *ptr,
+                     size_t            len,
+                     Style             style,
+                     unsigned          threads,
+                     size_t            minChunk) {
+  if ((style != styFull) && (style != styLast))
+    return check(exec, ptr, len, style);
+  const Byte *whole = static_cast<const Byte *>(ptr);
+  vector<Chunk> chunks = split(whole, len, threads, minChunk);
+  if (chunks.size() <= 1)
+    return check(exec, ptr, len, style);
+
+  RangeIter in(ptr, len);
+  const Byte *equivMap = exec.getEquivMap();
+  if (!lookingAt(in, equivMap, exec.getLeader(), exec.getLeaderLen()))
+    return 0;
+
+  switch (exec.getFormat()) {
+  case fmtDirect1:
+    return checkFormat<DfaProxy<fmtDirect1>>(exec, whole, chunks, style);
+  case fmtDirect2:
+    return checkFormat<DfaProxy<fmtDirect2>>(exec, whole, chunks, style);
+  case fmtDirect4:
+    return checkFormat<DfaProxy<fmtDirect4>>(exec, whole, chunks, style);
+  case fmtDirect8:
+    return checkFormat<DfaProxy<fmtDirect8>>(exec, whole, chunks, style);
+  case fmtFlat2:
+    return checkFormat<DfaProxy<fmtFlat2>>(exec, whole, chunks, style);
+  case fmtFlat4:
+    return checkFormat<DfaProxy<fmtFlat4>>(exec, whole, chunks, style);
+  case fmtComb4:
+    return checkFormat<DfaProxy<fmtComb4>>(exec, whole, chunks, style);
+  default:
+    throw RedExceptExec("unsupported format");
+  }
+}
+
+
+Result checkParallel(const Executable &exec,
+                     string_view       sv,
+                     Style             style,
+                     unsigned          threads,
+                     size_t            minChunk) {
+  return checkParallel(exec, sv.data(), sv.size(), style, threads, minChunk);
+}
+
+
+size_t matchAllParallel(const Executable &exec,
+                        string_view       sv,
+                        vector<Outcome>  &out,
+                        unsigned          threads,
+                        size_t            minChunk) {
+  const Byte *whole = reinterpret_cast<const Byte *>(sv.data());
+  vector<Chunk> chunks = split(whole, sv.size(), threads, minChunk);
+  if (chunks.size() <= 1)
+    return matchAll(exec, sv, out);
+
+  out.clear();
+  RangeIter in(sv);
+  const Byte *equivMap = exec.getEquivMap();
+  if (!lookingAt(in, equivMap, exec.getLeader(), exec.getLeaderLen()))
+    return 0;
+
+  switch (exec.getFormat()) {
+  case fmtDirect1:
+    return matchAllChunks<DfaProxy<fmtDirect1>>(exec, whole, chunks, out);
+  case fmtDirect2:
+    return matchAllChunks<DfaProxy<fmtDirect2>>(exec, whole, chunks, out);
+  case fmtDirect4:
+    return matchAllChunks<DfaProxy<fmtDirect4>>(exec, whole, chunks, out);
+  case fmtDirect8:
+    return matchAllChunks<DfaProxy<fmtDirect8>>(exec, whole, chunks, out);
+  case fmtFlat2:
+    return matchAllChunks<DfaProxy<fmtFlat2>>(exec, whole, chunks, out);
+  case fmtFlat4:
+    return matchAllChunks<DfaProxy<fmtFlat4>>(exec, whole, chunks, out);
+  case fmtComb4:
+    return matchAllChunks<DfaProxy<fmtComb4>>(exec, whole, chunks, out);
+  default:
+    throw RedExceptExec("unsupported format");
+  }
+}
+
+} // namespace zezax::red
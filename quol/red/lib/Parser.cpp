@@ -24,7 +24,9 @@ using namespace std::chrono_literals;
 
 using chrono::steady_clock;
 using std::numeric_limits;
+using std::string;
 using std::string_view;
+using std::vector;
 
 Parser::Parser(Budget *budget, CompStats *stats)
   : flags_(0),
@@ -33,7 +35,11 @@ Parser::Parser(Budget *budget, CompStats *stats)
     tok_(tError, gNoPos),
     nfa_(budget),
     budget_(budget),
-    stats_(stats) {
+    stats_(stats),
+    threads_(1),
+    exactOnly_(true),
+    exactFlags_(0),
+    exactStates_(0) {
   if (stats_) {
     stats_->preNfa_          = steady_clock::now();
     stats_->postNfa_         = steady_clock::time_point(0s);
@@ -52,6 +58,7 @@ void Parser::add(string_view regex, Result result, Flags flags) {
                 static_cast<Result>(gAlphabetSize)))
     throw RedExceptApi("result too large");
 
+  flushExact();
   nfa_.setGoal(result);
   flags_ = flags;
   level_ = 0;
@@ -72,6 +79,7 @@ void Parser::add(string_view regex, Result result, Flags flags) {
   if (flags_ & fIgnoreCase)
     state = nfa_.stateIgnoreCase(state);
 
+  starts_.insert(state);
   if (startWild)
     state = nfa_.stateConcat(startWild, state);
   if (flags_ & fLooseEnd)
@@ -124,6 +132,7 @@ void Parser::addGlob(string_view glob, Result result, Flags flags) {
                 static_cast<Result>(gAlphabetSize)))
     throw RedExceptApi("result too large");
 
+  flushExact();
   nfa_.setGoal(result);
   flags_ = flags;
 
@@ -141,6 +150,7 @@ void Parser::addGlob(string_view glob, Result result, Flags flags) {
   if (flags_ & fIgnoreCase)
     state = nfa_.stateIgnoreCase(state);
 
+  starts_.insert(state);
   if (startWild)
     state = nfa_.stateConcat(startWild, state);
   if (flags_ & fLooseEnd)
@@ -156,6 +166,11 @@ void Parser::addGlob(string_view glob, Result result, Flags flags) {
 }
 
 
+Parser::~Parser() {
+  refundExact();
+}
+
+
 void Parser::addExact(string_view glob, Result result, Flags flags) {
   if (result <= 0)
     throw RedExceptApi("result must be positive");
@@ -163,6 +178,55 @@ void Parser::addExact(string_view glob, Result result, Flags flags) {
                 static_cast<Result>(gAlphabetSize)))
     throw RedExceptApi("result too large");
 
+  if (exactOnly_ && ((flags & ~fIgnoreCase) == 0) &&
+      (exact_.empty() || (flags == exactFlags_))) {
+    size_t states = glob.size() + 2; // as buildExact() will take
+    if (budget_)
+      budget_->takeStates(states);
+    exactStates_ += states;
+    exactFlags_ = flags;
+    exact_.push_back({string(glob), result});
+  }
+  else {
+    flushExact();
+    buildExact(glob, result, flags);
+  }
+
+  if (stats_) {
+    stats_->numTokens_   += glob.size();
+    stats_->numPatterns_ += 1;
+  }
+}
+
+
+vector<ExactString> Parser::takeExact() {
+  refundExact(); // the caller charges for what it builds
+  vector<ExactString> rv;
+  rv.swap(exact_);
+  return rv;
+}
+
+
+// Returns the budget held by strings in exact_, ahead of their removal
+void Parser::refundExact() {
+  if (budget_)
+    budget_->giveStates(exactStates_);
+  exactStates_ = 0;
+}
+
+
+// Puts held-back exact strings into the nfa, in the order added
+void Parser::flushExact() {
+  exactOnly_ = false;
+  refundExact(); // buildExact() charges again
+  for (const ExactString &es : exact_)
+    buildExact(es.str_, es.result_, exactFlags_);
+  exact_.clear();
+  exact_.shrink_to_fit();
+}
+
+
+void Parser::buildExact(string_view glob, Result result, Flags flags) {
   nfa_.setGoal(result);
   flags_ = flags;
 
@@ -199,6 +263,8 @@ void Parser::addExact(string_view glob, Result result, Flags flags) {
   if (flags_ & fIgnoreCase)
     state = nfa_.stateIgnoreCase(state);
 
+  if (state)
+    starts_.insert(state);
   if (startWild)
     state = nfa_.stateConcat(startWild, state);
   if (flags_ & fLooseEnd) {
@@ -206,11 +272,6 @@ void Parser::addExact(string_view glob, Result result, Flags flags) {
     state = nfa_.stateConcat(state, nfa_.stateEndMark(result));
   }
   nfa_.selfUnion(state); // all added regexes are acceptable
-
-  if (stats_) {
-    stats_->numTokens_   += len;
-    stats_->numPatterns_ += 1;
-  }
 }
 
 
@@ -238,6 +299,7 @@ void Parser::addAs(Language    lang,
 
 
 void Parser::finish() {
+  flushExact();
   if (nfa_.numStates() == 0)
     nfa_.setInitial(nfa_.newState(1)); // empty matches empty
 
@@ -256,6 +318,10 @@ void Parser::finish() {
 
 void Parser::freeAll() {
   nfa_.freeAll();
+  starts_.clearAll();
+  refundExact();
+  exact_.clear();
+  exact_.shrink_to_fit();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -11,19 +11,44 @@
    multi-chars.  These partition the set of all in-use characters
    such that within each partition, all characters behave the same
    in the entire NFA.  Each character could be its own partition,
-   but The smallest number of partitions is most efficient.
-
-   The actual conversion happens in dfaFromNfaRecurse() which is
-   relatively straightforward because it relies on the previously-
-   done work represented in the table and the basis set.
+   but the smallest number of partitions is most efficient.  Since
+   every transition's multi-char is a union of basis ones, BasisIndex
+   works out once which basis multi-chars each transition covers, so
+   expanding a row is just a run of inserts.
+
+   The actual conversion happens in Transcriber, which numbers each
+   new set of NFA states as a DFA state as soon as it's found, and
+   fills in that state's transitions when its turn comes.  The sets
+   are kept in an NfaSetStore.  Sets are visited in the order of
+   their numbers, so the store serves as the work list, and there's
+   no recursion for deep automata to overflow the stack.  With one
+   thread, Transcriber expands each row itself and throws it away
+   once transcribed, so the whole table is never held at once.  Each
+   accepting NFA state's count is tallied as sets are found, and the
+   results are settled once all are known.  Until then, the
+   accepting members of each set wait as runs in a single arena too.
 
    The convert() method is the main flow, and removes end marks
    before returning.
+
+   With multiple threads, makeTable() hands off to TableBuilder.  A
+   row's address stays put in its shard's unordered_map however much
+   the map grows, so a thread can fill in a row it claimed without
+   holding the shard's lock.  The count of pending rows reaches zero
+   only once every row has been expanded and nothing new was found.
+   Threads with nothing to take sleep until a row is queued or that
+   count reaches zero.
  */
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <exception>
 #include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <unordered_map>
 
 #include "Except.h"
@@ -39,14 +64,16 @@ using std::vector;
 
 namespace {
 
-// Picks the best from a set of NFA states, or -1 if no acceptances
-Result getResult(const NfaIdSet     &nis,
+// Picks the best from a run of NFA states, or -1 if no acceptances
+Result getResult(const NfaId        *ptr,
+                 const NfaId        *end,
                  const NfaIdToCount &counts,
                  const NfaObj       &nfa) {
   Result rv = -1;
   size_t min = numeric_limits<size_t>::max();
 
-  for (NfaId id : nis) {
+  for (; ptr < end; ++ptr) {
+    NfaId id = *ptr;
     auto it = counts.find(id);
     if (it != counts.end()) {
       size_t num = it->second;
@@ -60,6 +87,387 @@ Result getResult(const NfaIdSet     &nis,
   return rv;
 }
 
+
+// Mixes in a whole ID at a time, as runs can be long and FNV-1a goes
+// byte by byte
+size_t hashRun(const NfaId *ptr, const NfaId *end) {
+  uint64_t rv = 0xcbf29ce484222325ULL;
+  for (; ptr < end; ++ptr) {
+    rv ^= static_cast<uint32_t>(*ptr);
+    rv *= 0x9e3779b97f4a7c15ULL;
+    rv ^= rv >> 29;
+  }
+  return rv;
+}
+
+
+// For each NFA state, lists the basis multi-chars its transitions
+// cover, each with the state reached.  The basis partitions every
+// transition's multi-char exactly, so one member stands for its whole
+// class, and building this costs one bit test per pair, done once per
+// NFA rather than an intersection per pair in every row.
+class BasisIndex {
+public:
+  struct Edge {
+    size_t idx_; // into the basis multi-chars
+    NfaId  next_;
+  };
+
+  BasisIndex(const NfaObj            &nfa,
+             NfaId                    initial,
+             const vector<MultiChar> &allMultiChars);
+
+  const Edge *begin(NfaId id) const { return edges_.data() + offsets_[id]; }
+  const Edge *end(NfaId id) const { return edges_.data() + offsets_[id + 1]; }
+
+private:
+  vector<Edge>   edges_;
+  vector<size_t> offsets_; // one extra
+};
+
+
+// One character stands for each basis multi-char, which is only sound
+// if they're disjoint and no transition splits one of them.  Anything
+// else throws.  The basis comes from the states reachable from initial,
+// so only those are indexed; the rest may split it, but are never seen.
+BasisIndex::BasisIndex(const NfaObj            &nfa,
+                       NfaId                    initial,
+                       const vector<MultiChar> &allMultiChars) {
+  vector<CharIdx> reps;
+  reps.reserve(allMultiChars.size());
+  MultiChar seen;
+  for (const MultiChar &mc : allMultiChars) {
+    if (mc.empty())
+      throw RedExceptCompile("empty basis multi-char");
+    if (seen.hasIntersection(mc))
+      throw RedExceptCompile("basis multi-chars overlap");
+    seen.unionWith(mc);
+    reps.push_back(*mc.begin());
+  }
+
+  const size_t repSize = reps.size();
+  const size_t num = nfa.numStates();
+  vector<bool> reached(num, false);
+  for (NfaConstIter it = nfa.citer(initial); it; ++it)
+    reached[it.id()] = true;
+  offsets_.reserve(num + 1);
+  for (size_t id = 0; id < num; ++id) {
+    offsets_.push_back(edges_.size());
+    if (!reached[id])
+      continue;
+    for (const NfaTransition &trans :
+           nfa[static_cast<NfaId>(id)].transitions_)
+      for (size_t idx = 0; idx < repSize; ++idx)
+        if (trans.multiChar_.hasIntersection(allMultiChars[idx])) {
+          if (!trans.multiChar_.contains(allMultiChars[idx]))
+            throw RedExceptCompile("transition splits a basis multi-char");
+          edges_.push_back({idx, trans.next_});
+        }
+  }
+  offsets_.push_back(edges_.size());
+}
+
+
+// Gathers, by basis multi-char, the NFA states reachable from a set
+template <class IterT>
+void expandRow(IterT             beg,
+               IterT             end,
+               IdxToNfaIdSet    &row,
+               const BasisIndex &index) {
+  // iterate bit-set once, as it's more expensive to do
+  for (; beg != end; ++beg)
+    for (const BasisIndex::Edge *ee = index.begin(*beg);
+         ee != index.end(*beg); ++ee)
+      row[ee->idx_].insert(ee->next_);
+}
+
+
+typedef NfaStatesToTransitions::value_type Row;
+
+constexpr size_t gShards = 256; // enough that threads seldom share one
+
+// Builds the translation table on several threads at once
+class TableBuilder {
+public:
+  TableBuilder(const BasisIndex &index, unsigned threads)
+    : index_(index),
+      shards_(gShards),
+      queues_(threads),
+      pending_(0),
+      queued_(0),
+      waiting_(0),
+      failed_(false) {}
+
+  NfaStatesToTransitions build(NfaId initial);
+
+private:
+  struct Shard {
+    std::mutex             mutex_;
+    NfaStatesToTransitions rows_;
+  };
+
+  struct Queue {
+    std::mutex   mutex_;
+    deque<Row *> rows_; // owner takes from back, thieves from front
+  };
+
+  void work(size_t self);
+  Row *take(size_t self);
+  bool await(); // false once there's nothing left to take
+  void wake(bool all);
+  void expand(Row &row, size_t self);
+  Row *intern(const NfaIdSet &nis); // null if already known
+
+  const BasisIndex        &index_;
+  vector<Shard>            shards_;
+  vector<Queue>            queues_;
+  std::atomic<size_t>      pending_; // rows found but not yet expanded
+  std::atomic<size_t>      queued_;  // rows waiting in queues
+  std::atomic<size_t>      waiting_; // idle threads
+  std::atomic<bool>        failed_;
+  std::mutex               idleMutex_;
+  std::condition_variable  idle_;
+  std::mutex               errorMutex_;
+  std::exception_ptr       error_;
+};
+
+
+NfaStatesToTransitions TableBuilder::build(NfaId initial) {
+  NfaIdSet initialStates;
+  initialStates.insert(initial);
+  queues_[0].rows_.push_back(intern(initialStates));
+  pending_ = 1;
+
+  queued_ = 1;
+
+  vector<std::thread> workers;
+  try {
+    for (size_t ii = 1; ii < queues_.size(); ++ii)
+      workers.emplace_back(&TableBuilder::work, this, ii);
+  }
+  catch (...) { // stop those already started before giving up
+    failed_ = true;
+    wake(true);
+    for (std::thread &th : workers)
+      th.join();
+    throw;
+  }
+  work(0);
+  for (std::thread &th : workers)
+    th.join();
+  if (error_)
+    std::rethrow_exception(error_);
+
+  NfaStatesToTransitions table;
+  size_t total = 0;
+  for (Shard &shard : shards_)
+    total += shard.rows_.size();
+  table.reserve(total);
+  for (Shard &shard : shards_)
+    table.merge(shard.rows_);
+  return table;
+}
+
+
+void TableBuilder::work(size_t self) {
+  try {
+    while (!failed_) {
+      Row *row = take(self);
+      if (row) {
+        expand(*row, self);
+        if (--pending_ == 0)
+          wake(true); // all done
+      }
+      else if (!await())
+        break;
+    }
+  }
+  catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(errorMutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+    failed_ = true;
+    wake(true);
+  }
+}
+
+
+// Sleeps until a row is queued, or all are done, or another thread
+// failed.  Announcing the wait before checking, and queuers checking
+// for waiters after queuing, means no wakeup goes missing.
+bool TableBuilder::await() {
+  std::unique_lock<std::mutex> lock(idleMutex_);
+  ++waiting_;
+  idle_.wait(lock, [this] {
+    return ((queued_ > 0) || (pending_ == 0) || failed_);
+  });
+  --waiting_;
+  return ((pending_ > 0) && !failed_);
+}
+
+
+void TableBuilder::wake(bool all) {
+  if (!all && (waiting_ == 0))
+    return;
+  {
+    std::lock_guard<std::mutex> lock(idleMutex_); // orders against await()
+  }
+  if (all)
+    idle_.notify_all();
+  else
+    idle_.notify_one();
+}
+
+
+Row *TableBuilder::take(size_t self) {
+  {
+    Queue &own = queues_[self];
+    std::lock_guard<std::mutex> lock(own.mutex_);
+    if (!own.rows_.empty()) {
+      Row *rv = own.rows_.back();
+      own.rows_.pop_back();
+      --queued_;
+      return rv;
+    }
+  }
+  size_t num = queues_.size();
+  for (size_t ii = 1; ii < num; ++ii) {
+    Queue &other = queues_[(self + ii) % num];
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    if (!other.rows_.empty()) {
+      Row *rv = other.rows_.front();
+      other.rows_.pop_front();
+      --queued_;
+      return rv;
+    }
+  }
+  return nullptr;
+}
+
+
+void TableBuilder::expand(Row &row, size_t self) {
+  IdxToNfaIdSet trans;
+  expandRow(row.first.begin(), row.first.end(), trans, index_);
+  for (const auto &[_, nis] : trans) {
+    Row *novel = intern(nis);
+    if (novel) {
+      ++pending_; // before it can be taken and finished
+      {
+        Queue &own = queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex_);
+        own.rows_.push_back(novel);
+        ++queued_; // under the lock, so takers never see it negative
+      }
+      wake(false);
+    }
+  }
+  row.second = std::move(trans); // claimed by this thread alone
+}
+
+
+Row *TableBuilder::intern(const NfaIdSet &nis) {
+  Shard &shard = shards_[std::hash<NfaIdSet>()(nis) % shards_.size()];
+  std::lock_guard<std::mutex> lock(shard.mutex_);
+  auto [it, novel] = shard.rows_.try_emplace(nis);
+  return novel ? &*it : nullptr;
+}
+
+
+// Turns sets of NFA states into DFA states, breadth first.  Rows come
+// from the table if given, which is emptied, else from the index.
+// Sets are numbered in the order found, and so are DFA states, so the
+// DFA ID is always one more than the set's, the error state being zero.
+class Transcriber {
+public:
+  Transcriber(const NfaObj            &nfa,
+              const vector<MultiChar> &multiChars,
+              NfaStatesToTransitions  *table,
+              const BasisIndex        *index,
+              DfaObj                  &dfa)
+    : nfa_(nfa),
+      multiChars_(multiChars),
+      table_(table),
+      index_(index),
+      dfa_(dfa) {}
+
+  DfaId run(NfaId initial);
+  size_t numSets() const { return store_.size(); }
+
+private:
+  DfaId intern(const NfaIdSet &nis);
+
+  const NfaObj                       &nfa_;
+  const vector<MultiChar>            &multiChars_;
+  NfaStatesToTransitions             *table_;
+  const BasisIndex                   *index_;
+  DfaObj                             &dfa_;
+  NfaSetStore                         store_;
+  NfaIdToCount                        counts_;
+  vector<NfaId>                       acceptArena_; // accepting members
+  vector<std::pair<DfaId, size_t>>    accepting_; // state, end of its run
+};
+
+
+DfaId Transcriber::run(NfaId initial) {
+  NfaIdSet initialStates;
+  initialStates.insert(initial);
+  DfaId rv = intern(initialStates);
+
+  // the store's size is the end of the work list, and it grows
+  for (NfaSetId cur = 0; cur < store_.size(); ++cur) {
+    IdxToNfaIdSet row;
+    if (table_) {
+      auto it = table_->find(store_.get(cur));
+      if (it == table_->end())
+        throw RedExceptCompile("cannot find nfa states in table");
+      row = std::move(it->second);
+      table_->erase(it); // done with it
+    }
+    else if (index_)
+      expandRow(store_.begin(cur), store_.end(cur), row, *index_);
+    else
+      throw RedExceptCompile("no table or index to transcribe from");
+
+    DfaId from = static_cast<DfaId>(cur) + 1;
+    for (const auto &[ii, nis] : row) {
+      DfaId to = intern(nis); // may grow dfa_, so no references across
+      for (CharIdx ch : multiChars_[ii])
+        dfa_[from].transitions_.set(ch, to);
+    }
+  }
+
+  size_t lo = 0;
+  for (const auto &[id, hi] : accepting_) {
+    dfa_[id].result_ = getResult(acceptArena_.data() + lo,
+                                 acceptArena_.data() + hi, counts_, nfa_);
+    lo = hi;
+  }
+  return rv;
+}
+
+
+DfaId Transcriber::intern(const NfaIdSet &nis) {
+  auto [sid, novel] = store_.intern(nis);
+  DfaId rv = static_cast<DfaId>(sid) + 1;
+  if (!novel)
+    return rv;
+
+  if (dfa_.newState() != rv)
+    throw RedExceptCompile("dfa states out of step with nfa sets");
+
+  size_t lo = acceptArena_.size();
+  for (NfaId id : nis)
+    if (nfa_.accepts(id)) {
+      acceptArena_.push_back(id);
+      ++counts_[id];
+    }
+  if (acceptArena_.size() > lo)
+    accepting_.emplace_back(rv, acceptArena_.size());
+  return rv;
+}
+
 } // anonymous
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -83,49 +491,91 @@ DfaObj PowersetConverter::convert() {
   if (stats_)
     stats_->postBasisChars_ = std::chrono::steady_clock::now();
 
-  NfaStatesToTransitions table = makeTable(initial, nfa_, multiChars);
+  unsigned threads = threads_;
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+  // with threads, build the whole table first; otherwise, stream it
+  NfaStatesToTransitions table;
+  std::optional<BasisIndex> index;
+  if (threads > 1)
+    table = makeTable(initial, nfa_, multiChars, threads);
+  else
+    index.emplace(nfa_, initial, multiChars);
 
   if (stats_)
     stats_->postMakeTable_ = std::chrono::steady_clock::now();
 
-  NfaIdToCount counts = countAcceptingStates(table, nfa_);
-
   DfaObj dfa(budget_);
   DfaId id = dfa.newState();
   if (id != gDfaErrorId)
     throw RedExceptCompile("dfa error state must be zero");
 
-  NfaIdSet states;
-  states.insert(initial);
-  auto it = table.find(states);
-  if (it == table.end())
-    throw RedExceptCompile("cannot find initial nfa states");
-  id = dfaFromNfa(multiChars, table, counts, states, dfa);
+  size_t rows;
+  {
+    Transcriber xcr(nfa_, multiChars, index ? nullptr : &table,
+                    index ? &*index : nullptr, dfa);
+    id = xcr.run(initial);
+    rows = xcr.numSets();
+    if (stats_)
+      stats_->powersetMemUsed_ = bytesUsed();
+  }
   if (id != gDfaInitialId)
     throw RedExceptCompile("dfa initial state must be one");
 
-  if (stats_)
-    stats_->powersetMemUsed_ = bytesUsed();
-
   dfa.chopEndMarks(); // end marks have done their job
 
   if (stats_) {
     stats_->origDfaStates_       = dfa.numStates();
-    stats_->transitionTableRows_ = table.size();
+    stats_->transitionTableRows_ = rows;
     stats_->postDfa_             = std::chrono::steady_clock::now();
   }
   return dfa;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+NfaSetStore::NfaSetStore()
+  : index_(0, Hasher{this}, Equal{this}) {
+  offsets_.push_back(0);
+}
+
+
+std::pair<NfaSetId, bool> NfaSetStore::intern(const NfaIdSet &nis) {
+  size_t num = hashes_.size();
+  if (num >= numeric_limits<NfaSetId>::max())
+    throw RedExceptCompile("too many sets of nfa states");
+
+  // append tentatively, so the index can compare against it in place
+  size_t beg = arena_.size();
+  for (NfaId id : nis)
+    arena_.push_back(id);
+  offsets_.push_back(arena_.size());
+  hashes_.push_back(hashRun(arena_.data() + beg,
+                            arena_.data() + arena_.size()));
+
+  NfaSetId id = static_cast<NfaSetId>(num);
+  auto [it, novel] = index_.insert(id);
+  if (!novel) {
+    arena_.resize(beg);
+    offsets_.pop_back();
+    hashes_.pop_back();
+  }
+  return {*it, novel};
+}
 
-// Doorway function to recursive transcription to final DFA
-DfaId PowersetConverter::dfaFromNfa(const std::vector<MultiChar> &multiChars,
-                                    const NfaStatesToTransitions &table,
-                                    const NfaIdToCount           &counts,
-                                    const NfaIdSet               &states,
-                                    DfaObj                       &dfa) {
-  NfaStatesToId map;
-  return dfaFromNfaRecurse(multiChars, table, counts, states, map, nfa_, dfa);
+
+NfaIdSet NfaSetStore::get(NfaSetId id) const {
+  NfaIdSet rv;
+  for (const NfaId *ptr = begin(id); ptr != end(id); ++ptr)
+    rv.insert(*ptr);
+  return rv;
+}
+
+
+bool NfaSetStore::Equal::operator()(NfaSetId aa, NfaSetId bb) const {
+  return std::equal(store_->begin(aa), store_->end(aa),
+                    store_->begin(bb), store_->end(bb));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -180,12 +630,19 @@ MultiCharSet basisMultiChars(const MultiCharSet &mcs) {
 // This is a performace-critical function.
 NfaStatesToTransitions makeTable(NfaId                    initial,
                                  const NfaObj            &nfa,
-                                 const vector<MultiChar> &allMultiChars) {
+                                 const vector<MultiChar> &allMultiChars,
+                                 unsigned                 threads) {
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1U);
+  BasisIndex index(nfa, initial, allMultiChars);
+  if (threads > 1) {
+    TableBuilder builder(index, threads);
+    return builder.build(initial);
+  }
+
   NfaStatesToTransitions table;
   typedef NfaStatesToTransitions::iterator Placeholder;
 
-  const size_t allSize = allMultiChars.size();
-
   NfaIdSet initialStates;
   initialStates.insert(initial);
   std::pair<NfaIdSet, IdxToNfaIdSet> tableNode;
@@ -198,12 +655,8 @@ NfaStatesToTransitions makeTable(NfaId                    initial,
     Placeholder tableIt = todoList.back();
     todoList.pop_back();
 
-    // iterate bit-set once, as it's more expensive to do
-    for (NfaId id : tableIt->first)
-      for (const NfaTransition &trans : nfa[id].transitions_)
-        for (size_t idx = 0; idx < allSize; ++idx)
-          if (allMultiChars[idx].hasIntersection(trans.multiChar_))
-            tableIt->second[idx].insert(trans.next_);
+    expandRow(tableIt->first.begin(), tableIt->first.end(), tableIt->second,
+              index);
     for (const auto &[_, nis] : tableIt->second) {
       std::pair<NfaIdSet, IdxToNfaIdSet> tNode;
       tNode.first = nis;
@@ -217,54 +670,14 @@ NfaStatesToTransitions makeTable(NfaId                    initial,
 }
 
 
-// Sum all the occurrences of each accepting state in the translation table
-NfaIdToCount countAcceptingStates(const NfaStatesToTransitions &table,
-                                  const NfaObj                 &nfa) {
-  NfaIdToCount rv;
-  for (const auto &[states, _] : table)
-    for (NfaId id : states)
-      if (nfa.accepts(id)) {
-        auto [it, dummy] = rv.emplace(id, 0);
-        ++it->second;
-      }
-  return rv;
-}
-
-
-// The real work of building the DFA from the translation table, counts, etc.
-DfaId dfaFromNfaRecurse(const vector<MultiChar>      &multiChars,
-                        const NfaStatesToTransitions &table,
-                        const NfaIdToCount           &counts,
-                        const NfaIdSet               &stateSet,
-                        NfaStatesToId                &map,
-                        const NfaObj                 &nfa,
-                        DfaObj                       &dfa) {
-  std::pair<NfaIdSet, DfaId> mapNode;
-  mapNode.first = stateSet;
-  auto [mapIter, novel] = map.emplace(std::move(mapNode));
-  if (!novel)
-    return mapIter->second;
-
-  DfaId dfaId = dfa.newState();
-  mapIter->second = dfaId;
-
-  auto tableIter = table.find(stateSet);
-  if (tableIter == table.end())
-    return dfaId; // FIXME: can this happen? is it right?
-
-  for (const auto &[ii, nis] : tableIter->second) {
-    if (!nis.empty()) {
-      DfaId subId = dfaFromNfaRecurse(
-          multiChars, table, counts, nis, map, nfa, dfa);
-      for (CharIdx ch : multiChars[ii]) // FIXME: why is mc[ii] valid?
-        dfa[dfaId].transitions_.set(ch, subId);
-    }
-  }
-
-  if (nfa.hasAccept(stateSet))
-    dfa[dfaId].result_ = getResult(stateSet, counts, nfa);
-
-  return dfaId;
+// Builds the DFA from a finished translation table, emptying the table
+DfaId dfaFromTable(const vector<MultiChar> &multiChars,
+                   NfaStatesToTransitions  &table,
+                   NfaId                    initial,
+                   const NfaObj            &nfa,
+                   DfaObj                  &dfa) {
+  Transcriber xcr(nfa, multiChars, &table, nullptr, dfa);
+  return xcr.run(initial);
 }
 
 } // namespace zezax::red
@@ -0,0 +1,231 @@
+/* Prefilter.cpp - multi-literal prefilter for pattern sets - implementation
+
+   See general description in Prefilter.h
+
+   The nibble-mask approach is the "Teddy" literal matcher from
+   Hyperscan, described here:
+   https://github.com/intel/hyperscan/blob/master/src/fdr/teddy.c
+   Bucket bits that survive the AND across all byte positions mark
+   places where some literal in that bucket may begin.
+ */
+
+#include "Prefilter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Except.h"
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+namespace zezax::red {
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+uint32_t getU32(const char *ptr) {
+  uint32_t rv;
+  memcpy(&rv, ptr, sizeof(rv));
+  return rv;
+}
+
+
+void putU32(string &buf, uint32_t val) {
+  buf.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+
+uint32_t packKey(const Byte *ptr, size_t width) {
+  uint32_t rv = 0;
+  for (size_t ii = 0; ii < width; ++ii)
+    rv |= static_cast<uint32_t>(ptr[ii]) << (8 * ii);
+  return rv;
+}
+
+#if defined(__AVX2__)
+
+// returns bit per position in [ptr, ptr + 32) where some bucket may match
+uint32_t blockAvx2(const uint8_t (*lo)[16],
+                   const uint8_t (*hi)[16],
+                   size_t         width,
+                   const Byte    *ptr) {
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_set1_epi8(-1);
+  for (size_t jj = 0; jj < width; ++jj) {
+    const __m256i loTab = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(lo[jj])));
+    const __m256i hiTab = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi[jj])));
+    __m256i in =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + jj));
+    __m256i lowNib = _mm256_and_si256(in, nibble);
+    __m256i highNib = _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble);
+    __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(loTab, lowNib),
+                                    _mm256_shuffle_epi8(hiTab, highNib));
+    acc = _mm256_and_si256(acc, bits);
+  }
+  return ~static_cast<uint32_t>(
+    _mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, _mm256_setzero_si256())));
+}
+
+#elif defined(__SSSE3__)
+
+// returns bit per position in [ptr, ptr + 16) where some bucket may match
+uint32_t blockSsse3(const uint8_t (*lo)[16],
+                    const uint8_t (*hi)[16],
+                    size_t         width,
+                    const Byte    *ptr) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i acc = _mm_set1_epi8(-1);
+  for (size_t jj = 0; jj < width; ++jj) {
+    const __m128i loTab =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(lo[jj]));
+    const __m128i hiTab =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi[jj]));
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + jj));
+    __m128i lowNib = _mm_and_si128(in, nibble);
+    __m128i highNib = _mm_and_si128(_mm_srli_epi16(in, 4), nibble);
+    acc = _mm_and_si128(acc, _mm_and_si128(_mm_shuffle_epi8(loTab, lowNib),
+                                           _mm_shuffle_epi8(hiTab, highNib)));
+  }
+  return 0xffffU & ~static_cast<uint32_t>(
+    _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())));
+}
+
+#endif
+
+} // anonymous
+
+Prefilter::Prefilter() : width_(0) {
+  memset(lo_, 0, sizeof(lo_));
+  memset(hi_, 0, sizeof(hi_));
+}
+
+
+Prefilter::Prefilter(string_view section) : width_(0) {
+  memset(lo_, 0, sizeof(lo_));
+  memset(hi_, 0, sizeof(hi_));
+  if (section.empty())
+    return;
+
+  if (section.size() < (2 * sizeof(uint32_t)))
+    throw RedExceptApi("prefilter section too short");
+  uint32_t width = getU32(section.data());
+  uint32_t count = getU32(section.data() + sizeof(uint32_t));
+  if ((width == 0) || (width > maxWidth_) || (count == 0))
+    throw RedExceptApi("prefilter section has bad dimensions");
+  if ((section.size() - (2 * sizeof(uint32_t))) !=
+      (static_cast<size_t>(width) * count))
+    throw RedExceptApi("prefilter section has bad length");
+
+  const Byte *lits =
+    reinterpret_cast<const Byte *>(section.data() + 2 * sizeof(uint32_t));
+  keys_.reserve(count);
+  for (uint32_t ii = 0; ii < count; ++ii) {
+    const Byte *lit = lits + static_cast<size_t>(ii) * width;
+    // literals are sorted, so neighbors share buckets and masks stay tight
+    uint8_t bit = static_cast<uint8_t>(1u << ((ii * buckets_) / count));
+    for (size_t jj = 0; jj < width; ++jj) {
+      uint8_t &lo = lo_[jj][lit[jj] & 0x0f];
+      uint8_t &hi = hi_[jj][lit[jj] >> 4];
+      lo = static_cast<uint8_t>(lo | bit);
+      hi = static_cast<uint8_t>(hi | bit);
+    }
+    keys_.push_back(packKey(lit, width));
+  }
+  std::sort(keys_.begin(), keys_.end());
+  width_ = width;
+}
+
+
+string Prefilter::encode(const vector<string> &literals) {
+  if (literals.empty())
+    throw RedExceptSerialize("prefilter needs literals");
+  size_t width = literals[0].size();
+  if ((width == 0) || (width > maxWidth_))
+    throw RedExceptSerialize("prefilter literal has bad width");
+
+  vector<string> sorted(literals);
+  std::sort(sorted.begin(), sorted.end());
+  string rv;
+  putU32(rv, static_cast<uint32_t>(width));
+  putU32(rv, static_cast<uint32_t>(sorted.size()));
+  for (const string &lit : sorted) {
+    if (lit.size() != width)
+      throw RedExceptSerialize("prefilter literals differ in width");
+    rv += lit;
+  }
+  return rv;
+}
+
+
+uint8_t Prefilter::candidates(const Byte *ptr) const {
+  uint8_t rv = 0xff;
+  for (size_t jj = 0; jj < width_; ++jj)
+    rv = static_cast<uint8_t>(rv & lo_[jj][ptr[jj] & 0x0f] &
+                              hi_[jj][ptr[jj] >> 4]);
+  return rv;
+}
+
+
+bool Prefilter::verify(const Byte *ptr) const {
+  return std::binary_search(keys_.begin(), keys_.end(), packKey(ptr, width_));
+}
+
+
+const Byte *Prefilter::find(const Byte *ptr, const Byte *end) const {
+  if (!active())
+    return ptr;
+  if (static_cast<size_t>(end - ptr) < width_)
+    return end;
+  const Byte *stop = end - (width_ - 1); // literals must fit before end
+
+#if defined(__AVX2__)
+  for (; (stop - ptr) >= 32; ptr += 32)
+    for (uint32_t mask = blockAvx2(lo_, hi_, width_, ptr); mask;
+         mask &= mask - 1) {
+      const Byte *hit = ptr + __builtin_ctz(mask);
+      if (verify(hit))
+        return hit;
+    }
+#elif defined(__SSSE3__)
+  for (; (stop - ptr) >= 16; ptr += 16)
+    for (uint32_t mask = blockSsse3(lo_, hi_, width_, ptr); mask;
+         mask &= mask - 1) {
+      const Byte *hit = ptr + __builtin_ctz(mask);
+      if (verify(hit))
+        return hit;
+    }
+#endif
+
+  for (; ptr < stop; ++ptr)
+    if (candidates(ptr) && verify(ptr))
+      return ptr;
+  return end;
+}
+
+
+const Byte *Prefilter::find(const Byte *ptr) const {
+  if (!active())
+    return ptr;
+  for (; *ptr; ++ptr) {
+    uint8_t mask =
+      static_cast<uint8_t>(lo_[0][*ptr & 0x0f] & hi_[0][*ptr >> 4]);
+    for (size_t jj = 1; mask && (jj < width_); ++jj) {
+      Byte b = ptr[jj];
+      if (!b)
+        return ptr + jj; // no room for a literal before the terminator
+      mask = static_cast<uint8_t>(mask & lo_[jj][b & 0x0f] & hi_[jj][b >> 4]);
+    }
+    if (mask && verify(ptr))
+      return ptr;
+  }
+  return ptr;
+}
+
+} // namespace zezax::red
@@ -0,0 +1,95 @@
+/* Profile.cpp - counts DFA state visits over a corpus - implementation
+
+   See general description in Profile.h
+ */
+
+#include "Profile.h"
+
+#include "Except.h"
+#include "Proxy.h"
+
+namespace zezax::red {
+
+using std::vector;
+
+namespace {
+
+size_t stateSizeOf(Format fmt, CharIdx maxChar) {
+  switch (fmt) {
+  case fmtDirect1:
+    return DfaProxy<fmtDirect1>::stateSize(maxChar);
+  case fmtDirect2:
+    return DfaProxy<fmtDirect2>::stateSize(maxChar);
+  case fmtDirect4:
+    return DfaProxy<fmtDirect4>::stateSize(maxChar);
+  case fmtDirect8:
+    return DfaProxy<fmtDirect8>::stateSize(maxChar);
+  case fmtFlat2:
+    return DfaProxy<fmtFlat2>::stateSize(maxChar);
+  case fmtFlat4:
+    return DfaProxy<fmtFlat4>::stateSize(maxChar);
+  case fmtComb4:
+    return DfaProxy<fmtComb4>::stateSize(maxChar);
+  default:
+    throw RedExceptApi("unsupported format for profiling");
+  }
+}
+
+} // anonymous
+
+Profiler::Profiler(const Executable &exec)
+  : exec_(exec),
+    stateSize_(stateSizeOf(exec.getFormat(), exec.getHeader()->maxChar_)) {
+  visits_.assign(exec.getHeader()->stateCnt_, 0);
+}
+
+
+void Profiler::run(const void *ptr, size_t len) {
+  const Byte *beg = static_cast<const Byte *>(ptr);
+  const Byte *end = beg + len;
+  switch (exec_.getFormat()) {
+  case fmtDirect1:
+    runCore<fmtDirect1>(beg, end);
+    break;
+  case fmtDirect2:
+    runCore<fmtDirect2>(beg, end);
+    break;
+  case fmtDirect4:
+    runCore<fmtDirect4>(beg, end);
+    break;
+  case fmtDirect8:
+    runCore<fmtDirect8>(beg, end);
+    break;
+  case fmtFlat2:
+    runCore<fmtFlat2>(beg, end);
+    break;
+  case fmtFlat4:
+    runCore<fmtFlat4>(beg, end);
+    break;
+  case fmtComb4:
+    runCore<fmtComb4>(beg, end);
+    break;
+  default:
+    throw RedExceptApi("unsupported format for profiling");
+  }
+}
+
+
+template <Format fmt>
+void Profiler::runCore(const Byte *ptr, const Byte *end) {
+  const char *base = exec_.getBase();
+  const Byte *equivMap = exec_.getEquivMap();
+  DfaProxy<fmt> dfap;
+  dfap.init(base, exec_.getHeader()->initialOff_);
+  for (;;) {
+    size_t off = static_cast<size_t>(
+      reinterpret_cast<const char *>(dfap.state()) - base);
+    ++visits_[off / stateSize_];
+    if ((ptr >= end) || dfap.deadEnd())
+      break;
+    dfap.next(base, dfap.column(equivMap, *ptr));
+    ++ptr;
+  }
+}
+
+} // namespace zezax::red
@@ -29,28 +29,28 @@ using std::vector;
 Red::Red(const char *regex) {
   Parser p;
   p.add(regex, 1, 0);
-  program_ = compile(p);
+  program_ = compile(p, fmtDirectAuto, cfUnanchored);
 }
 
 
 Red::Red(const string &regex) {
   Parser p;
   p.add(regex, 1, 0);
-  program_ = compile(p);
+  program_ = compile(p, fmtDirectAuto, cfUnanchored);
 }
 
 
 Red::Red(string_view regex) {
   Parser p;
   p.add(regex, 1, 0);
-  program_ = compile(p);
+  program_ = compile(p, fmtDirectAuto, cfUnanchored);
 }
 
 
 Red::Red(string_view regex, Flags flags) {
   Parser p;
   p.add(regex, 1, flags);
-  program_ = compile(p);
+  program_ = compile(p, fmtDirectAuto, cfUnanchored);
 }
 
 
@@ -88,10 +88,8 @@ Red::Red(const UnownedTag &, const void *prog, size_t len)
   : program_(gUnownedTag, string_view(static_cast<const char *>(prog), len)) {}
 
 
-Red::Red(const PathTag &, const char *path) {
-  string buf = readFileToString(path);
-  program_ = Executable(std::move(buf));
-}
+Red::Red(const PathTag &, const char *path)
+  : program_(gPathTag, path) {}
 
 
 void Red::save(const char *path) const {
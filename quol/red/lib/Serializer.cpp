@@ -8,16 +8,20 @@
 
 #include "Serializer.h"
 
+#include <algorithm>
 #include <cstring>
 
+#include "Crc.h"
 #include "Except.h"
 #include "Fnv.h"
 #include "Util.h"
 #include "Proxy.h"
+#include "Skipper.h"
 
 namespace zezax::red {
 
 using std::string;
+using std::string_view;
 using std::vector;
 
 namespace {
@@ -27,35 +31,211 @@ void append(string &s, const void *p, size_t n) {
 }
 
 
-void appendLeader(string &s, const string &leader) {
-  s.append(leader);
-  size_t size = leader.size();
+void appendPadding(string &s) {
+  size_t size = s.size();
   size_t pad = (size + 7) & ~7UL;
   for (size_t ii = size; ii < pad; ++ii) // round up to multiple of 8
     s.push_back(0);
 }
 
 
+void appendLeader(string &s, const string &leader) {
+  s.append(leader);
+  appendPadding(s); // header is a multiple of 8 already
+}
+
+
+// walks the section chain, returning a message if it's malformed
+const char *checkSections(const char *buf, size_t len, size_t off) {
+  if (off == 0)
+    return nullptr;
+  if ((off < sizeof(FileHeader)) || (off > len) || (off & 7))
+    return "Serialized DFA: bad section offset";
+  while (off < len) {
+    if ((len - off) < sizeof(SectionHeader))
+      return "Serialized DFA: section header too short";
+    const SectionHeader *sec =
+      reinterpret_cast<const SectionHeader *>(buf + off);
+    if (sec->len_ > (len - off - sizeof(SectionHeader)))
+      return "Serialized DFA: section too long";
+    off += (sizeof(SectionHeader) + sec->len_ + 7) & ~7UL;
+  }
+  return nullptr;
+}
+
+
 template <Format fmt>
-void appendStateImpl(std::string          &buf,
-                     const DfaState       &ds,
-                     CharIdx               maxChar,
-                     const vector<size_t> &offsets) {
+void appendStateImpl(std::string           &buf,
+                     const DfaState        &ds,
+                     CharIdx                maxChar,
+                     const vector<CharIdx> &equivMap,
+                     const vector<size_t>  &offsets,
+                     bool                   accel) {
   DfaProxy<fmt> proxy;
   typename DfaProxy<fmt>::State rec;
-  rec.resultAndDeadEnd_ = proxy.resultAndDeadEnd(ds.result_, ds.deadEnd_);
+  rec.resultAndDeadEnd_ =
+    proxy.resultAndDeadEnd(ds.result_, ds.deadEnd_, accel);
   append(buf, &rec, sizeof(rec));
-  for (CharIdx ch = 0; ch <= maxChar; ++ch) {
+  // flat formats have a column per raw byte instead of per class
+  CharIdx maxCol = proxy.mapped_ ? maxChar : gAlphabetSize - 1;
+  for (CharIdx col = 0; col <= maxCol; ++col) {
+    CharIdx ch = proxy.mapped_ ? col : equivMap[col];
     DfaId id = ds.transitions_[ch];
     size_t off = offsets[id];
     proxy.appendOffset(buf, off);
   }
 }
 
+
+// numbers states in breadth-first order from the initial one
+vector<size_t> breadthFirstRanks(const DfaObj &dfa, CharIdx maxChar) {
+  size_t num = dfa.numStates();
+  vector<size_t> rv(num, num); // unreachable ones go last
+  vector<DfaId> queue;
+  queue.push_back(gDfaInitialId);
+  rv[gDfaInitialId] = 0;
+  for (size_t ii = 0; ii < queue.size(); ++ii) {
+    const DfaState &ds = dfa[queue[ii]];
+    for (CharIdx ch = 0; ch <= maxChar; ++ch) {
+      DfaId next = ds.transitions_[ch];
+      if (rv[next] == num) {
+        rv[next] = queue.size();
+        queue.push_back(next);
+      }
+    }
+  }
+  return rv;
+}
+
+
+// orders states by descending visits, then breadth-first
+struct Hotter {
+  const vector<uint64_t> &visits_;
+  const vector<size_t>   &ranks_;
+
+  bool operator()(DfaId aa, DfaId bb) const {
+    if (visits_[aa] != visits_[bb])
+      return visits_[aa] > visits_[bb];
+    return ranks_[aa] < ranks_[bb];
+  }
+};
+
+
+// orders states by descending number of comb entries
+struct MoreExceptions {
+  const vector<vector<CharIdx>> &exceptions_;
+
+  bool operator()(DfaId aa, DfaId bb) const {
+    return exceptions_[aa].size() > exceptions_[bb].size();
+  }
+};
+
+
+// The version 1 header, with 32-bit counts and offsets.  It grew with
+// the minor version: 1.1 put sectionOff_ where a pad was, 1.2 added
+// startSet_ after equivMap_, and 1.4 added plainOff_ and a pad before
+// equivMap_.
+struct FileHeaderV1 {
+  uint8_t  magic_[4]; // "REDA"
+  uint16_t majVer_;
+  uint16_t minVer_;
+  uint32_t checksum_; // FNV-1a of all that follows
+  uint8_t  format_;
+  uint8_t  maxChar_;
+  uint8_t  leaderLen_;
+  uint8_t  pad0_;
+  uint32_t stateCnt_;
+  uint32_t initialOff_;
+  uint32_t leaderOff_;
+  uint32_t sectionOff_;
+};
+
+
+uint64_t getWord(const char *ptr, size_t width) {
+  switch (width) {
+  case 1: { uint8_t  val; memcpy(&val, ptr, sizeof(val)); return val; }
+  case 2: { uint16_t val; memcpy(&val, ptr, sizeof(val)); return val; }
+  case 4: { uint32_t val; memcpy(&val, ptr, sizeof(val)); return val; }
+  default: { uint64_t val; memcpy(&val, ptr, sizeof(val)); return val; }
+  }
+}
+
+
+void appendWord(string &s, uint64_t word, size_t width) {
+  uint8_t  v1 = static_cast<uint8_t>(word);
+  uint16_t v2 = static_cast<uint16_t>(word);
+  uint32_t v4 = static_cast<uint32_t>(word);
+  switch (width) {
+  case 1:  append(s, &v1, sizeof(v1));     break;
+  case 2:  append(s, &v2, sizeof(v2));     break;
+  case 4:  append(s, &v4, sizeof(v4));     break;
+  default: append(s, &word, sizeof(word)); break;
+  }
+}
+
+
+// Before 1.3, the bit below the dead-end one was part of the result,
+// where it now flags accel.  If any result needs that bit, the direct
+// format is widened until it fits.  Transitions count words, so they
+// carry over, while byte offsets in the header scale up.
+void widenResults(FileHeader &hdr, string &body) {
+  Format fmt = static_cast<Format>(hdr.format_);
+  if ((fmt != fmtDirect1) && (fmt != fmtDirect2) && (fmt != fmtDirect4))
+    throw RedExceptApi("Serialized DFA: unsupported format");
+  size_t width = fmt; // bytes per word
+  size_t words = static_cast<size_t>(hdr.maxChar_) + 2; // result first
+  size_t lead = (hdr.leaderLen_ + 7U) & ~7U;
+  if (body.size() < lead + (hdr.stateCnt_ * words * width))
+    throw RedExceptApi("Serialized DFA: states cut short");
+
+  uint64_t deadEnd = uint64_t{1} << ((8 * width) - 1);
+  uint64_t maxResult = 0;
+  for (size_t ii = 0; ii < hdr.stateCnt_; ++ii) {
+    const char *ptr = body.data() + lead + (ii * words * width);
+    maxResult = std::max(maxResult, getWord(ptr, width) & (deadEnd - 1));
+  }
+  size_t wide = width;
+  while (maxResult >= (uint64_t{1} << ((8 * wide) - 2)))
+    wide *= 2;
+  if (wide == width)
+    return;
+
+  string out(body, 0, lead);
+  for (size_t ii = 0; ii < hdr.stateCnt_; ++ii) {
+    const char *ptr = body.data() + lead + (ii * words * width);
+    uint64_t res = getWord(ptr, width);
+    if (res & deadEnd)
+      res = (res & (deadEnd - 1)) | (uint64_t{1} << ((8 * wide) - 1));
+    appendWord(out, res, wide);
+    for (size_t jj = 1; jj < words; ++jj)
+      appendWord(out, getWord(ptr + (jj * width), width), wide);
+  }
+  hdr.format_     = static_cast<uint8_t>(wide);
+  hdr.initialOff_ = (hdr.initialOff_ / width) * wide;
+  hdr.leaderOff_  = (hdr.leaderOff_ / width) * wide;
+  body.swap(out);
+}
+
+
+// Version 1 accel records had 32-bit state offsets
+string widenAccel(string_view sec) {
+  constexpr size_t recLen = sizeof(uint32_t) + 32;
+  if ((sec.size() % recLen) != 0)
+    throw RedExceptApi("accel section has bad length");
+  string rv;
+  for (size_t ii = 0; ii < sec.size(); ii += recLen) {
+    uint32_t off;
+    memcpy(&off, sec.data() + ii, sizeof(off));
+    rv += Accelerator::record(
+      off, reinterpret_cast<const uint8_t *>(sec.data() + ii + sizeof(off)));
+  }
+  return rv;
+}
+
 } // anonymous
 
 Serializer::Serializer(const DfaObj &dfa, CompStats *stats)
-  : dfa_(dfa), stats_(stats) {}
+  : dfa_(dfa), plainOff_(0), stats_(stats) {}
 
 
 string Serializer::serializeToString(Format fmt) {
@@ -93,11 +273,18 @@ void Serializer::serializeToFile(Format fmt, const char *path) {
 }
 
 
+// Takes visit counts in the layout of the last serialization, from Profiler
+void Serializer::setVisits(const vector<uint64_t> &visits) {
+  if (order_.empty() || (visits.size() != order_.size()))
+    throw RedExceptApi("visits do not match last serialization");
+  visits_.assign(order_.size(), 0);
+  for (size_t ii = 0; ii < visits.size(); ++ii)
+    visits_[order_[ii]] = visits[ii];
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 void Serializer::prepareToSerialize() {
-  if (dfa_.numStates() > 0xffffffff)
-    throw RedExceptLimit("too many states for serialization format");
   findMaxChar();
   if (maxChar_ >= gAlphabetSize)
     throw RedExceptLimit("maxChar out of range");
@@ -122,6 +309,18 @@ Format Serializer::validatedFormat(Format fmt) {
   case fmtDirect4:
     DfaProxy<fmtDirect4>::checkCapacity(dfa_.numStates(), maxChar_, maxResult_);
     break;
+  case fmtDirect8:
+    DfaProxy<fmtDirect8>::checkCapacity(dfa_.numStates(), maxChar_, maxResult_);
+    break;
+  case fmtFlat2:
+    DfaProxy<fmtFlat2>::checkCapacity(dfa_.numStates(), maxChar_, maxResult_);
+    break;
+  case fmtFlat4:
+    DfaProxy<fmtFlat4>::checkCapacity(dfa_.numStates(), maxChar_, maxResult_);
+    break;
+  case fmtComb4: // the comb itself is checked once it's packed
+    DfaProxy<fmtComb4>::checkCapacity(dfa_.numStates(), maxChar_, maxResult_);
+    break;
   default:
     throw RedExceptSerialize("unsuitable dfa format requested");
   }
@@ -131,10 +330,13 @@ Format Serializer::validatedFormat(Format fmt) {
 
 
 Format Serializer::optimalFormat() {
+  size_t numStates = dfa_.numStates();
   Format res;
-  if (!DfaProxy<fmtDirect4>::resultFits(maxResult_))
+  if (!DfaProxy<fmtDirect8>::resultFits(maxResult_))
     throw RedExceptLimit("max result too big for any format");
-  if (!DfaProxy<fmtDirect2>::resultFits(maxResult_))
+  if (!DfaProxy<fmtDirect4>::resultFits(maxResult_))
+    res = fmtDirect8;
+  else if (!DfaProxy<fmtDirect2>::resultFits(maxResult_))
     res = fmtDirect4;
   else if (!DfaProxy<fmtDirect1>::resultFits(maxResult_))
     res = fmtDirect2;
@@ -143,15 +345,40 @@ Format Serializer::optimalFormat() {
 
   Format dir;
   if (!DfaProxy<fmtDirect4>::offsetFits(maxChar_, dfa_.numStates()))
-    throw RedExceptLimit("num states too many for any format");
-  if (!DfaProxy<fmtDirect2>::offsetFits(maxChar_, dfa_.numStates()))
+    dir = fmtDirect8;
+  else if (!DfaProxy<fmtDirect2>::offsetFits(maxChar_, dfa_.numStates()))
     dir = fmtDirect4;
   else if (!DfaProxy<fmtDirect1>::offsetFits(maxChar_, dfa_.numStates()))
     dir = fmtDirect2;
   else
     dir = fmtDirect1;
+  res = std::max(res, dir);
+
+  // skipping the equivalence map is faster, if the table stays in cache
+  // and isn't blown up much by having a column for every byte
+  if (res != fmtDirect8) {
+    size_t limit = std::min(gFlatBudget,
+                            numStates * measureState(res, dfa_[0]) *
+                            gFlatGrowth);
+    if (DfaProxy<fmtFlat2>::resultFits(maxResult_) &&
+        DfaProxy<fmtFlat2>::offsetFits(maxChar_, numStates) &&
+        ((numStates * DfaProxy<fmtFlat2>::stateSize(maxChar_)) <= limit))
+      return fmtFlat2;
+    if (DfaProxy<fmtFlat4>::resultFits(maxResult_) &&
+        ((numStates * DfaProxy<fmtFlat4>::stateSize(maxChar_)) <= limit))
+      return fmtFlat4;
+  }
+
+  // rows too big for cache are worth compressing, if it pays well
+  size_t rowBytes = numStates * DfaProxy<fmtDirect4>::stateSize(maxChar_);
+  if ((res == fmtDirect4) && (rowBytes > gCombMinBytes)) {
+    size_t combBytes = (numStates * sizeof(StateComb4)) +
+      (countExceptions() * sizeof(CombEntry) * 5 / 4); // some slack
+    if (combBytes < (rowBytes / 2))
+      res = fmtComb4;
+  }
 
-  return std::max(res, dir);
+  return res;
 }
 
 
@@ -167,50 +394,228 @@ string Serializer::serialize(Format fmt) {
 
   appendLeader(buf, leader_);
 
-  for (const DfaState &ds : dfa_.getStates())
-    appendState(fmt, buf, ds);
+  if (fmt == fmtComb4)
+    packComb();
+
+  string accel;
+  for (DfaId id : order_) { // special states first, so offsets ascend
+    uint8_t escapes[32];
+    bool acc = findEscapes(id, escapes);
+    if (acc)
+      accel += Accelerator::record(offsets_[id], escapes);
+    if (fmt == fmtComb4)
+      appendCombState(buf, id, acc);
+    else
+      appendState(fmt, buf, dfa_[id], acc);
+  }
+  if (fmt == fmtComb4) {
+    append(buf, comb_.data(), comb_.size() * sizeof(CombEntry));
+    comb_.clear();
+  }
 
   // patch up checksum
   FileHeader *hdrp = reinterpret_cast<FileHeader *>(buf.data());
   hdrp->checksum_ = calcChecksum(buf.data(), buf.size());
 
+  if (!accel.empty())
+    appendSection(buf, secAccel, accel);
+
   return buf;
 }
 
 
-void Serializer::populateHeader(FileHeader &hdr, Format fmt) {
-  size_t initOff = offsets_[gDfaInitialId];
-  if (initOff > 0xffffffff)
-    throw RedExceptSerialize("initial offset too large");
-  size_t nextOff = offsets_[leaderNext_];
-  if (nextOff > 0xffffffff)
-    throw RedExceptSerialize("leader next offset too large");
+// Fills bitmap with bytes leaving the state; true if it's worth skipping
+bool Serializer::findEscapes(DfaId id, uint8_t *bitmap) const {
+  const DfaState &ds = dfa_[id];
+  memset(bitmap, 0, 32);
+  if (ds.deadEnd_)
+    return false;
+  int cnt = 0;
+  for (size_t ii = 0; ii < gAlphabetSize; ++ii)
+    if (ds.transitions_[dfa_.getEquivMap()[ii]] != id) {
+      bitmap[ii >> 3] |= static_cast<uint8_t>(1u << (ii & 7));
+      ++cnt;
+    }
+  return ((cnt > 0) && (cnt <= gMaxEscapes));
+}
+
+
+// Finds the most common target of each state, and the columns that differ
+void Serializer::findDefaults(vector<vector<CharIdx>> *exceptions) {
+  DfaId num = static_cast<DfaId>(dfa_.numStates());
+  combDefault_.assign(static_cast<size_t>(num), gDfaErrorId);
+  vector<DfaId> row;
+  for (DfaId id = 0; id < num; ++id) {
+    const DfaState &ds = dfa_[id];
+    row.clear();
+    for (CharIdx ch = 0; ch <= maxChar_; ++ch)
+      row.push_back(ds.transitions_[ch]);
+    std::sort(row.begin(), row.end());
+    size_t best = 0;
+    for (size_t ii = 0, jj = 0; ii < row.size(); ii = jj) {
+      for (jj = ii; (jj < row.size()) && (row[jj] == row[ii]); ++jj)
+        ;
+      if ((jj - ii) > best) {
+        best = jj - ii;
+        combDefault_[id] = row[ii];
+      }
+    }
+    if (exceptions) {
+      vector<CharIdx> &cols = (*exceptions)[id];
+      for (CharIdx ch = 0; ch <= maxChar_; ++ch)
+        if (ds.transitions_[ch] != combDefault_[id])
+          cols.push_back(ch);
+    }
+  }
+}
+
+
+size_t Serializer::countExceptions() {
+  DfaId num = static_cast<DfaId>(dfa_.numStates());
+  findDefaults(nullptr);
+  size_t rv = 0;
+  for (DfaId id = 0; id < num; ++id) {
+    const DfaState &ds = dfa_[id];
+    for (CharIdx ch = 0; ch <= maxChar_; ++ch)
+      if (ds.transitions_[ch] != combDefault_[id])
+        ++rv;
+  }
+  return rv;
+}
+
+
+// Overlays the sparse rows into one comb, first fit, biggest rows first
+void Serializer::packComb() {
+  size_t num = dfa_.numStates();
+  vector<vector<CharIdx>> exceptions(num);
+  findDefaults(&exceptions);
+
+  vector<DfaId> bySize(order_);
+  std::stable_sort(bySize.begin(), bySize.end(), MoreExceptions{exceptions});
+
+  // link[slot] is slot if free, else leads toward the next free one;
+  // slots past the end are all free
+  combBase_.assign(num, 0);
+  vector<size_t> link;
+  auto isFree = [&link](size_t slot) {
+    return ((slot >= link.size()) || (link[slot] == slot));
+  };
+  auto nextFree = [&link](size_t slot) {
+    size_t root = slot;
+    while ((root < link.size()) && (link[root] != root))
+      root = link[root];
+    while (slot != root) { // compress the path
+      size_t next = link[slot];
+      link[slot] = root;
+      slot = next;
+    }
+    return root;
+  };
+
+  size_t maxBase = 0;
+  for (DfaId id : bySize) {
+    const vector<CharIdx> &cols = exceptions[id];
+    if (cols.empty())
+      continue;
+    size_t first = static_cast<size_t>(cols[0]);
+    size_t base = 0;
+    for (size_t slot = nextFree(first);; slot = nextFree(slot + 1)) {
+      base = slot - first;
+      bool fits = true;
+      for (size_t ii = 1; ii < cols.size(); ++ii)
+        if (!isFree(base + static_cast<size_t>(cols[ii]))) {
+          fits = false;
+          break;
+        }
+      if (fits)
+        break;
+    }
+    combBase_[id] = base;
+    maxBase = std::max(maxBase, base);
+    for (CharIdx ch : cols) {
+      size_t slot = base + static_cast<size_t>(ch);
+      for (size_t ii = link.size(); ii <= slot + 1; ++ii)
+        link.push_back(ii);
+      link[slot] = slot + 1;
+    }
+  }
+
+  // every state may read maxChar entries past its base
+  size_t entries = maxBase + static_cast<size_t>(maxChar_) + 1;
+  if ((offsets_.back() + (entries * sizeof(CombEntry))) > 0xffffffff)
+    throw RedExceptLimit("dfa too big for comb format");
+  comb_.assign(entries, CombEntry{0xffffffff, 0});
+  for (DfaId id : order_) {
+    const DfaState &ds = dfa_[id];
+    for (CharIdx ch : exceptions[id]) {
+      CombEntry &ent = comb_[combBase_[id] + static_cast<size_t>(ch)];
+      ent.owner_ = static_cast<uint32_t>(offsets_[id]);
+      ent.next_ = static_cast<uint32_t>(offsets_[ds.transitions_[ch]]);
+    }
+  }
+}
 
+
+void Serializer::appendCombState(string &buf, DfaId id, bool accel) {
+  const DfaState &ds = dfa_[id];
+  size_t self = offsets_[id];
+  size_t entry = offsets_.back() + (combBase_[id] * sizeof(CombEntry));
+  StateComb4 rec;
+  rec.resultAndDeadEnd_ =
+    DfaProxy<fmtComb4>::resultAndDeadEnd(ds.result_, ds.deadEnd_, accel);
+  rec.default_ = static_cast<uint32_t>(offsets_[combDefault_[id]]);
+  rec.row_ = static_cast<uint32_t>(entry - self);
+  rec.self_ = static_cast<uint32_t>(self);
+  append(buf, &rec, sizeof(rec));
+}
+
+
+void Serializer::populateHeader(FileHeader &hdr, Format fmt) {
   memset(&hdr, 0, sizeof(hdr));
   memcpy(hdr.magic_, "REDA", 4);
-  hdr.majVer_     = 1;
-  hdr.minVer_     = 0;
+  hdr.majVer_     = gFileMajVer;
+  hdr.minVer_     = gFileMinVer;
   hdr.format_     = fmt;
   hdr.maxChar_    = static_cast<uint8_t>(maxChar_);
   hdr.leaderLen_  = static_cast<uint8_t>(leader_.size());
-  hdr.stateCnt_   = static_cast<uint32_t>(dfa_.numStates());
-  hdr.initialOff_ = static_cast<uint32_t>(initOff);
-  hdr.leaderOff_  = static_cast<uint32_t>(nextOff);
+  hdr.stateCnt_   = dfa_.numStates();
+  hdr.initialOff_ = offsets_[gDfaInitialId];
+  hdr.leaderOff_  = offsets_[leaderNext_];
+  hdr.plainOff_   = plainOff_;
   for (size_t ii = 0; ii < gAlphabetSize; ++ii)
     hdr.equivMap_[ii] = static_cast<uint8_t>(dfa_.getEquivMap()[ii]);
+
+  // bytes that don't go straight to the error state from the initial one
+  const DfaState &init = dfa_[gDfaInitialId];
+  for (size_t ii = 0; ii < gAlphabetSize; ++ii)
+    if (init.transitions_[dfa_.getEquivMap()[ii]] != gDfaErrorId)
+      hdr.startSet_[ii >> 3] |= static_cast<uint8_t>(1u << (ii & 7));
 }
 
 
-void Serializer::appendState(Format fmt, string &buf, const DfaState &ds) {
+void Serializer::appendState(Format          fmt,
+                             string         &buf,
+                             const DfaState &ds,
+                             bool            accel) {
+  const vector<CharIdx> &map = dfa_.getEquivMap();
   switch (fmt) {
   case fmtDirect1:
-    appendStateImpl<fmtDirect1>(buf, ds, maxChar_, offsets_);
+    appendStateImpl<fmtDirect1>(buf, ds, maxChar_, map, offsets_, accel);
     break;
   case fmtDirect2:
-    appendStateImpl<fmtDirect2>(buf, ds, maxChar_, offsets_);
+    appendStateImpl<fmtDirect2>(buf, ds, maxChar_, map, offsets_, accel);
     break;
   case fmtDirect4:
-    appendStateImpl<fmtDirect4>(buf, ds, maxChar_, offsets_);
+    appendStateImpl<fmtDirect4>(buf, ds, maxChar_, map, offsets_, accel);
+    break;
+  case fmtDirect8:
+    appendStateImpl<fmtDirect8>(buf, ds, maxChar_, map, offsets_, accel);
+    break;
+  case fmtFlat2:
+    appendStateImpl<fmtFlat2>(buf, ds, maxChar_, map, offsets_, accel);
+    break;
+  case fmtFlat4:
+    appendStateImpl<fmtFlat4>(buf, ds, maxChar_, map, offsets_, accel);
     break;
   default:
     throw RedExceptSerialize("bad format in appendState");
@@ -219,13 +624,52 @@ void Serializer::appendState(Format fmt, string &buf, const DfaState &ds) {
 
 
 void Serializer::tabulateOffsets(Format fmt) {
-  offsets_.clear();
+  DfaId num = static_cast<DfaId>(dfa_.numStates());
+  order_.clear();
+  for (DfaId id = 0; id < num; ++id)
+    if (isSpecial(id))
+      order_.push_back(id);
+  size_t numSpecial = order_.size();
+  for (DfaId id = 0; id < num; ++id)
+    if (!isSpecial(id))
+      order_.push_back(id);
+  if (!visits_.empty())
+    orderByVisits(numSpecial);
+
+  offsets_.assign(static_cast<size_t>(num) + 1, 0);
   size_t off = 0;
-  for (const DfaState &ds : dfa_.getStates()) {
-    offsets_.push_back(off);
-    off += measureState(fmt, ds);
+  for (size_t ii = 0; ii < order_.size(); ++ii) {
+    if (ii == numSpecial)
+      plainOff_ = off;
+    DfaId id = order_[ii];
+    offsets_[id] = off;
+    off += measureState(fmt, dfa_[id]);
   }
-  offsets_.push_back(off); // just in case;
+  if (numSpecial == order_.size())
+    plainOff_ = off; // nothing is plain
+  offsets_.back() = off; // just in case;
+}
+
+
+// Sorts special and plain states separately, hottest first
+void Serializer::orderByVisits(size_t numSpecial) {
+  if (visits_.size() != order_.size())
+    throw RedExceptSerialize("visits do not match dfa");
+  vector<size_t> ranks = breadthFirstRanks(dfa_, maxChar_);
+  Hotter cmp{visits_, ranks};
+  auto mid = order_.begin() + static_cast<std::ptrdiff_t>(numSpecial);
+  std::sort(order_.begin(), mid, cmp);
+  std::sort(mid, order_.end(), cmp);
+}
+
+
+// True if matching must stop to look at the state when reaching it
+bool Serializer::isSpecial(DfaId id) const {
+  const DfaState &ds = dfa_[id];
+  if ((ds.result_ > 0) || ds.deadEnd_ || (id == gDfaInitialId))
+    return true;
+  uint8_t escapes[32];
+  return findEscapes(id, escapes);
 }
 
 
@@ -238,6 +682,14 @@ size_t Serializer::measureState(Format fmt, const DfaState &ds) const {
     return DfaProxy<fmtDirect2>::stateSize(maxChar_);
   case fmtDirect4:
     return DfaProxy<fmtDirect4>::stateSize(maxChar_);
+  case fmtDirect8:
+    return DfaProxy<fmtDirect8>::stateSize(maxChar_);
+  case fmtFlat2:
+    return DfaProxy<fmtFlat2>::stateSize(maxChar_);
+  case fmtFlat4:
+    return DfaProxy<fmtFlat4>::stateSize(maxChar_);
+  case fmtComb4:
+    return DfaProxy<fmtComb4>::stateSize(maxChar_);
   default:
     throw RedExceptSerialize("bad format in measureState");
   }
@@ -258,6 +710,8 @@ string loadFromFile(const char *path) {
   string str = readFileToString(path);
   if (str.empty())
     throw RedExceptApi("serialized dfa file is empty");
+  if (isVersion1(str.data(), str.size()))
+    str = upgradeFromV1(str);
 
   const char *msg = checkHeader(str.data(), str.size());
   if (msg)
@@ -267,7 +721,9 @@ string loadFromFile(const char *path) {
 }
 
 
-const char *checkHeader(const void *ptr, size_t len) {
+const char *checkHeader(const void *ptr, size_t len, bool sum) {
+  if (isVersion1(ptr, len))
+    return "Serialized DFA: version 1, see upgradeFromV1()";
   if (len < sizeof(FileHeader))
     return "Serialized DFA: header too short";
 
@@ -275,25 +731,180 @@ const char *checkHeader(const void *ptr, size_t len) {
   if ((hdr->magic_[0] != 'R') || (hdr->magic_[1] != 'E') ||
       (hdr->magic_[2] != 'D') || (hdr->magic_[3] != 'A'))
     return "Serialized DFA: bad magic number";
-  if ((hdr->majVer_ != 1) || (hdr->minVer_ != 0))
+  if ((hdr->majVer_ != gFileMajVer) || (hdr->minVer_ > gFileMinVer))
     return "Serialized DFA: unrecognized version";
 
-  uint32_t csum = calcChecksum(ptr, len);
-  if (hdr->checksum_ != csum) {
-    if (hdr->checksum_ == __builtin_bswap32(csum))
-      return "serialized DFA: foreign endian-ness";
-    return "serialized DFA: checksum mismatch";
+  if (sum) {
+    const char *msg = checkChecksum(ptr, len);
+    if (msg)
+      return msg;
   }
 
   switch (hdr->format_) {
   case fmtDirect1:
   case fmtDirect2:
   case fmtDirect4:
+  case fmtDirect8:
+  case fmtFlat2:
+  case fmtFlat4:
+  case fmtComb4:
     break;
   default:
     return "Serialized DFA: unsupported format";
   }
 
+  size_t avail = len - sizeof(FileHeader); // states start past this
+  if ((hdr->initialOff_ >= avail) || (hdr->leaderOff_ >= avail) ||
+      (hdr->plainOff_ > avail) || (hdr->sectionOff_ > len))
+    return "Serialized DFA: offset out of range";
+
+  return checkSections(static_cast<const char *>(ptr), len, hdr->sectionOff_);
+}
+
+
+bool isVersion1(const void *ptr, size_t len) {
+  const FileHeaderV1 *hdr = reinterpret_cast<const FileHeaderV1 *>(ptr);
+  return ((len >= sizeof(FileHeaderV1)) &&
+          (memcmp(hdr->magic_, "REDA", 4) == 0) && (hdr->majVer_ == 1));
+}
+
+
+// Widens the header and accel records, and any results that now collide
+// with the accel flag.  States before 1.4 weren't sorted, so they're all
+// taken as special; before 1.2, every byte may start a match.
+string upgradeFromV1(string_view old) {
+  if (!isVersion1(old.data(), old.size()))
+    throw RedExceptApi("Serialized DFA: not version 1");
+  const FileHeaderV1 *v1 = reinterpret_cast<const FileHeaderV1 *>(old.data());
+  unsigned minor = v1->minVer_;
+  if (minor > 4)
+    throw RedExceptApi("Serialized DFA: unrecognized version");
+  size_t mapOff = sizeof(FileHeaderV1) + ((minor >= 4) ? 8 : 0);
+  size_t setOff = mapOff + gAlphabetSize;
+  size_t hdrLen = setOff + ((minor >= 2) ? 32 : 0);
+  size_t end = (minor >= 1) ? v1->sectionOff_ : 0; // of the states
+  if (end == 0)
+    end = old.size();
+  if ((old.size() < hdrLen) || (end < hdrLen) || (end > old.size()))
+    throw RedExceptApi("Serialized DFA: header too short");
+  const char *beg = reinterpret_cast<const char *>(&v1->format_);
+  size_t num = static_cast<size_t>(old.data() + old.size() - beg);
+  if (v1->checksum_ != fnv1a<uint32_t>(beg, num))
+    throw RedExceptApi("serialized DFA: checksum mismatch");
+
+  FileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic_, "REDA", 4);
+  hdr.majVer_     = gFileMajVer;
+  hdr.minVer_     = gFileMinVer;
+  hdr.format_     = v1->format_;
+  hdr.maxChar_    = v1->maxChar_;
+  hdr.leaderLen_  = v1->leaderLen_;
+  hdr.stateCnt_   = v1->stateCnt_;
+  hdr.initialOff_ = v1->initialOff_;
+  hdr.leaderOff_  = v1->leaderOff_;
+  memcpy(hdr.equivMap_, old.data() + mapOff, sizeof(hdr.equivMap_));
+  if (minor >= 2)
+    memcpy(hdr.startSet_, old.data() + setOff, sizeof(hdr.startSet_));
+  else
+    memset(hdr.startSet_, 0xff, sizeof(hdr.startSet_));
+
+  string body(old.substr(hdrLen, end - hdrLen)); // leader, then states
+  if (minor < 3)
+    widenResults(hdr, body);
+  if (minor >= 4) {
+    uint32_t plain;
+    memcpy(&plain, old.data() + sizeof(FileHeaderV1), sizeof(plain));
+    hdr.plainOff_ = plain;
+  }
+  else
+    hdr.plainOff_ = body.size();
+
+  string rv;
+  append(rv, &hdr, sizeof(hdr));
+  rv.append(body);
+  appendPadding(rv);
+  for (size_t off = end; off < old.size(); ) {
+    SectionHeader sec;
+    if ((old.size() - off) < sizeof(sec))
+      throw RedExceptApi("Serialized DFA: section header too short");
+    memcpy(&sec, old.data() + off, sizeof(sec));
+    if (sec.len_ > (old.size() - off - sizeof(sec)))
+      throw RedExceptApi("Serialized DFA: section too long");
+    string_view sub = old.substr(off + sizeof(sec), sec.len_);
+    Section kind = static_cast<Section>(sec.kind_);
+    switch (kind) {
+    case secUnanchored:
+    case secReverse:
+    case secStarts:
+      appendSection(rv, kind, upgradeFromV1(sub));
+      break;
+    case secAccel:
+      appendSection(rv, kind, widenAccel(sub));
+      break;
+    default:
+      appendSection(rv, kind, string(sub));
+      break;
+    }
+    off += (sizeof(SectionHeader) + sec.len_ + 7) & ~7UL;
+  }
+
+  FileHeader *hdrp = reinterpret_cast<FileHeader *>(rv.data());
+  hdrp->checksum_ = calcChecksum(rv.data(), rv.size());
+  return rv;
+}
+
+
+// Appends sub as a section of prog, which must already be serialized
+void appendSection(string &prog, Section kind, const string &sub) {
+  if (prog.size() < sizeof(FileHeader))
+    throw RedExceptSerialize("cannot append section to bad program");
+  appendPadding(prog);
+  size_t off = prog.size();
+
+  SectionHeader sec;
+  memset(&sec, 0, sizeof(sec));
+  sec.kind_ = kind;
+  sec.len_  = sub.size();
+  append(prog, &sec, sizeof(sec));
+  prog.append(sub);
+  appendPadding(prog);
+
+  FileHeader *hdrp = reinterpret_cast<FileHeader *>(prog.data());
+  if (hdrp->sectionOff_ == 0)
+    hdrp->sectionOff_ = off;
+  hdrp->checksum_ = calcChecksum(prog.data(), prog.size());
+}
+
+
+// Returns the embedded program for the section kind, or empty if none
+string_view findSection(const void *ptr, size_t len, Section kind) {
+  const char *buf = static_cast<const char *>(ptr);
+  const FileHeader *hdr = reinterpret_cast<const FileHeader *>(ptr);
+  size_t off = hdr->sectionOff_;
+  if (off == 0)
+    return string_view();
+  while ((off + sizeof(SectionHeader)) <= len) {
+    const SectionHeader *sec =
+      reinterpret_cast<const SectionHeader *>(buf + off);
+    if (sec->kind_ == kind)
+      return string_view(reinterpret_cast<const char *>(sec->bytes_),
+                         sec->len_);
+    off += (sizeof(SectionHeader) + sec->len_ + 7) & ~7UL;
+  }
+  return string_view();
+}
+
+
+// Assumes the header has already been checked, apart from the checksum
+const char *checkChecksum(const void *ptr, size_t len) {
+  const FileHeader *hdr = reinterpret_cast<const FileHeader *>(ptr);
+  uint32_t csum = calcChecksum(ptr, len);
+  if (hdr->checksum_ != csum) {
+    if (hdr->checksum_ == __builtin_bswap32(csum))
+      return "serialized DFA: foreign endian-ness";
+    return "serialized DFA: checksum mismatch";
+  }
   return nullptr;
 }
 
@@ -302,7 +913,10 @@ uint32_t calcChecksum(const void *ptr, size_t len) {
   const FileHeader *hdr = reinterpret_cast<const FileHeader *>(ptr);
   const char *beg = reinterpret_cast<const char *>(&hdr->format_);
   const char *end = reinterpret_cast<const char *>(ptr) + len;
-  return fnv1a<uint32_t>(beg, end - beg);
+  size_t num = static_cast<size_t>(end - beg);
+  if (hdr->minVer_ == 0)
+    return fnv1a<uint32_t>(beg, num); // version 2.0
+  return crc32c(beg, num);
 }
 
 } // namespace zezax::red
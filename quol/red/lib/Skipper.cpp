@@ -0,0 +1,281 @@
+/* Skipper.cpp - fast skipping over uninteresting bytes - implementation
+
+   See general description in Skipper.h
+
+   The AVX2 approach is the one described by Wojciech Mula here:
+   http://0x80.pl/articles/simd-byte-lookup.html
+   Each byte is split into nibbles.  The low nibble selects a row from
+   one of two 16-entry tables, depending on the top bit of the high
+   nibble.  The rest of the high nibble selects a bit within that row.
+ */
+
+#include "Skipper.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Except.h"
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace zezax::red {
+
+using std::string;
+using std::string_view;
+
+namespace {
+
+#if defined(__AVX2__)
+
+const Byte *findAvx2(const uint8_t *loTab,
+                     const uint8_t *hiTab,
+                     const Byte    *ptr,
+                     const Byte    *end) {
+  const __m256i lo = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(loTab)));
+  const __m256i hi = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(hiTab)));
+  const __m256i bits = _mm256_setr_epi8(
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i seven = _mm256_set1_epi8(7);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (; (end - ptr) >= 32; ptr += 32) {
+    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+    __m256i lowNib = _mm256_and_si256(in, nibble);
+    __m256i highNib = _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble);
+    __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo, lowNib),
+                                     _mm256_shuffle_epi8(hi, lowNib),
+                                     _mm256_cmpgt_epi8(highNib, seven));
+    __m256i hit = _mm256_and_si256(row, _mm256_shuffle_epi8(bits, highNib));
+    uint32_t mask = ~static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, zero)));
+    if (mask)
+      return ptr + __builtin_ctz(mask);
+  }
+  return ptr;
+}
+
+#elif defined(__SSE4_2__)
+
+const Byte *findSse42(const uint8_t *needle,
+                      int            needleLen,
+                      const Byte    *ptr,
+                      const Byte    *end) {
+  const __m128i set = _mm_loadu_si128(reinterpret_cast<const __m128i *>(needle));
+  for (; (end - ptr) >= 16; ptr += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+    int idx = _mm_cmpestri(set, needleLen, in, 16,
+                           _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                           _SIDD_LEAST_SIGNIFICANT);
+    if (idx < 16)
+      return ptr + idx;
+  }
+  return ptr;
+}
+
+#endif
+
+// rough rank of how often a byte shows up in typical text; lower is rarer
+int commonness(Byte b) {
+  if (b == ' ')
+    return 9;
+  if (strchr("etaoinsrhl", b) && b)
+    return 8;
+  if ((b >= 'a') && (b <= 'z'))
+    return 7;
+  if ((b >= '0') && (b <= '9'))
+    return 6;
+  if ((b >= 'A') && (b <= 'Z'))
+    return 5;
+  if (strchr(".,:;-_/=\"'()[]", b) && b)
+    return 4;
+  if ((b > ' ') && (b < 0x7f))
+    return 3;
+  if ((b == '\n') || (b == '\t') || (b == '\r'))
+    return 2;
+  return 1;
+}
+
+} // anonymous
+
+Skipper::Skipper() : needleLen_(0), active_(false) {
+  memset(bitmap_, 0xff, sizeof(bitmap_));
+  memset(loTab_, 0xff, sizeof(loTab_));
+  memset(hiTab_, 0xff, sizeof(hiTab_));
+  memset(needle_, 0, sizeof(needle_));
+}
+
+
+Skipper::Skipper(const uint8_t *bitmap) : needleLen_(0), active_(false) {
+  memcpy(bitmap_, bitmap, sizeof(bitmap_));
+  memset(loTab_, 0, sizeof(loTab_));
+  memset(hiTab_, 0, sizeof(hiTab_));
+  memset(needle_, 0, sizeof(needle_));
+
+  int pop = 0;
+  for (unsigned uu = 0; uu < 256; ++uu) {
+    Byte b = static_cast<Byte>(uu);
+    if (!contains(b))
+      continue;
+    unsigned low = uu & 0x0f;
+    unsigned high = uu >> 4;
+    if (high < 8)
+      loTab_[low] = static_cast<uint8_t>(loTab_[low] | (1u << high));
+    else
+      hiTab_[low] = static_cast<uint8_t>(hiTab_[low] | (1u << (high - 8)));
+    if (pop < 16)
+      needle_[pop] = b;
+    ++pop;
+  }
+
+  needleLen_ = (pop <= 16) ? pop : 0;
+  active_ = (pop < 256);
+}
+
+
+const Byte *Skipper::find(const Byte *ptr, const Byte *end) const {
+#if defined(__AVX2__)
+  ptr = findAvx2(loTab_, hiTab_, ptr, end);
+#elif defined(__SSE4_2__)
+  if (needleLen_ > 0)
+    ptr = findSse42(needle_, needleLen_, ptr, end);
+#endif
+  for (; ptr < end; ++ptr)
+    if (contains(*ptr))
+      break;
+  return ptr;
+}
+
+
+const Byte *Skipper::find(const Byte *ptr) const {
+  for (; *ptr; ++ptr)
+    if (contains(*ptr))
+      break;
+  return ptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+LeaderFinder::LeaderFinder() : rareOff_(0), rare_(0), active_(false) {}
+
+
+LeaderFinder::LeaderFinder(const Byte *equivMap,
+                           const Byte *leader,
+                           size_t      leaderLen)
+  : rareOff_(0), rare_(0), active_(false) {
+  // count how many raw bytes map to each equivalence class
+  int count[256] = {};
+  Byte sample[256] = {};
+  for (unsigned uu = 0; uu < 256; ++uu) {
+    Byte cls = equivMap[uu];
+    ++count[cls];
+    sample[cls] = static_cast<Byte>(uu);
+  }
+
+  bool unique = true;
+  int best = 99;
+  for (size_t ii = 0; ii < leaderLen; ++ii) {
+    Byte cls = leader[ii];
+    if (count[cls] != 1) {
+      unique = false;
+      continue;
+    }
+    Byte b = sample[cls];
+    raw_.push_back(static_cast<char>(b));
+    int rank = commonness(b);
+    if (rank < best) {
+      best = rank;
+      rareOff_ = ii;
+      rare_ = b;
+    }
+  }
+
+  if (!unique || (leaderLen < 2))
+    raw_.clear(); // single bytes go faster via memchr
+  active_ = (best < 99);
+}
+
+
+const Byte *LeaderFinder::find(const Byte *ptr, const Byte *end) const {
+  if (ptr >= end)
+    return end;
+  const void *hit;
+  if (!raw_.empty()) {
+    hit = memmem(ptr, static_cast<size_t>(end - ptr), raw_.data(), raw_.size());
+    return hit ? static_cast<const Byte *>(hit) : end;
+  }
+  const Byte *from = ptr + rareOff_;
+  if (from >= end)
+    return end;
+  hit = memchr(from, rare_, static_cast<size_t>(end - from));
+  return hit ? (static_cast<const Byte *>(hit) - rareOff_) : end;
+}
+
+
+const Byte *LeaderFinder::find(const Byte *ptr) const {
+  const char *str = reinterpret_cast<const char *>(ptr);
+  if (!raw_.empty()) {
+    const char *hit = strstr(str, raw_.c_str());
+    if (hit)
+      return reinterpret_cast<const Byte *>(hit);
+  }
+  else {
+    for (const char *from = str; ; ++from) {
+      const char *hit = strchr(from, rare_);
+      if (!hit || (rare_ == 0))
+        break;
+      if (static_cast<size_t>(hit - str) >= rareOff_)
+        return reinterpret_cast<const Byte *>(hit) - rareOff_;
+      from = hit;
+    }
+  }
+  return ptr + strlen(str);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Accelerator::Accelerator() {}
+
+
+Accelerator::Accelerator(string_view section, const char *base, size_t limit) {
+  constexpr size_t recLen = recordLen_;
+  if ((section.size() % recLen) != 0)
+    throw RedExceptApi("accel section has bad length");
+  size_t num = section.size() / recLen;
+  states_.reserve(num);
+  skippers_.reserve(num);
+  for (size_t ii = 0; ii < num; ++ii) {
+    const char *rec = section.data() + (ii * recLen);
+    uint64_t off;
+    memcpy(&off, rec, sizeof(off));
+    if ((off >= limit) || (!states_.empty() && (base + off <= states_.back())))
+      throw RedExceptApi("accel section has bad offset");
+    uint8_t bitmap[32];
+    memcpy(bitmap, rec + sizeof(off), sizeof(bitmap));
+    states_.push_back(base + off);
+    skippers_.emplace_back(bitmap);
+  }
+}
+
+
+string Accelerator::record(uint64_t offset, const uint8_t *bitmap) {
+  string rv(reinterpret_cast<const char *>(&offset), sizeof(offset));
+  rv.append(reinterpret_cast<const char *>(bitmap), 32);
+  return rv;
+}
+
+
+const Skipper &Accelerator::find(const void *state) const {
+  const char *key = static_cast<const char *>(state);
+  auto it = std::lower_bound(states_.begin(), states_.end(), key);
+  if ((it == states_.end()) || (*it != key))
+    return none_;
+  return skippers_[static_cast<size_t>(it - states_.begin())];
+}
+
+} // namespace zezax::red
@@ -0,0 +1,288 @@
+/* Union.cpp - merges a small DFA into a big one - implementation
+
+   See general description in Union.h
+
+   Only "fresh" pairs, those whose second member isn't dead, are kept
+   in the product, as a flat table with a row of next states per pair.
+   Everywhere else a pair is named by its first member's base id, so
+   row entries below the number of base states are base states, and
+   the rest are fresh pairs.  A fresh pair (a,b) is taken to match
+   base state a unless their results differ, or it leads to a fresh
+   pair that doesn't match its own base state.  Those refutations
+   spread backward over the fresh pairs until none change, leaving the
+   largest set that holds up.
+
+   The fresh pairs not so merged are refined as in RefineMinimizer.
+   Their blocks start out by result.  Their transitions form cords,
+   which start out by class and, for those into base states, by that
+   state too, since base states are never split or merged.  Cords
+   split blocks and new blocks split cords until neither changes.
+   Finally, what's reachable is numbered breadth first into a new
+   DfaObj.
+ */
+
+#include "Union.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "Except.h"
+#include "Minimizer.h"
+
+namespace zezax::red {
+
+using std::vector;
+
+namespace {
+
+typedef std::pair<DfaId, DfaId> Pair;
+
+constexpr uint32_t gNoElem = std::numeric_limits<uint32_t>::max();
+
+CharIdx classOf(const DfaObj &dfa, CharIdx ch) {
+  const vector<CharIdx> &map = dfa.getEquivMap();
+  return (ch < map.size()) ? map[ch] : ch;
+}
+
+
+uint64_t pairKey(DfaId aa, DfaId bb) {
+  return ((static_cast<uint64_t>(static_cast<uint32_t>(aa)) << 32) |
+          static_cast<uint32_t>(bb));
+}
+
+
+Result lowest(Result aa, Result bb) {
+  if (aa <= 0)
+    return bb;
+  if ((bb <= 0) || (aa < bb))
+    return aa;
+  return bb;
+}
+
+} // anonymous
+
+///////////////////////////////////////////////////////////////////////////////
+
+DfaObj UnionBuilder::build() {
+  // classes of the union, one per pair of classes in the two
+  vector<CharIdx> map(gAlphabetSize);
+  vector<std::pair<CharIdx, CharIdx>> reps;
+  {
+    std::map<std::pair<CharIdx, CharIdx>, CharIdx> seen;
+    for (CharIdx ch = 0; ch < gAlphabetSize; ++ch) {
+      std::pair<CharIdx, CharIdx> key(classOf(base_, ch), classOf(more_, ch));
+      auto [it, novel] = seen.emplace(key, static_cast<CharIdx>(reps.size()));
+      if (novel)
+        reps.push_back(key);
+      map[ch] = it->second;
+    }
+  }
+  const size_t numClasses = reps.size();
+  const size_t numBase = base_.numStates();
+
+  // the fresh pairs, breadth first from the initial pair
+  vector<Pair>                         pairs;
+  vector<Result>                       results;
+  vector<size_t>                       table; // numClasses per fresh pair
+  std::unordered_map<uint64_t, size_t> ids;
+  auto intern = [&](DfaId aa, DfaId bb) -> size_t {
+    const DfaState &sb = more_[bb];
+    if ((bb == gDfaErrorId) || (sb.deadEnd_ && (sb.result_ <= 0)))
+      return aa; // just the base state
+    auto [it, novel] = ids.try_emplace(pairKey(aa, bb), numBase + pairs.size());
+    if (novel) {
+      if (it->second >= static_cast<size_t>(std::numeric_limits<DfaId>::max()))
+        throw RedExceptLimit("dfa state id overflow");
+      pairs.emplace_back(aa, bb);
+      results.push_back(lowest(base_[aa].result_, sb.result_));
+    }
+    return it->second;
+  };
+  const size_t init = intern(gDfaInitialId, gDfaInitialId);
+  for (size_t cur = 0; cur < pairs.size(); ++cur) {
+    const DfaState &sa = base_[pairs[cur].first];
+    const DfaState &sb = more_[pairs[cur].second];
+    for (const auto &[ca, cb] : reps)
+      table.push_back(intern(sa.transitions_[ca], sb.transitions_[cb]));
+  }
+  ids.clear();
+  const size_t numFresh = pairs.size();
+  auto at = [&](size_t ff, size_t cls) { return table[ff * numClasses + cls]; };
+
+  // fresh pairs that match their base states; see above
+  vector<bool> alive(numFresh, false);
+  {
+    vector<vector<size_t>> preds(numFresh); // among fresh
+    vector<size_t> dead;
+    for (size_t ff = 0; ff < numFresh; ++ff) {
+      DfaId aa = pairs[ff].first;
+      alive[ff] = ((aa != gDfaErrorId) && (results[ff] == base_[aa].result_));
+    }
+    for (size_t ff = 0; ff < numFresh; ++ff) {
+      if (!alive[ff])
+        continue;
+      for (size_t cls = 0; cls < numClasses; ++cls) {
+        size_t next = at(ff, cls);
+        if (next < numBase)
+          continue; // same as where the base state goes
+        if (!alive[next - numBase]) {
+          alive[ff] = false;
+          dead.push_back(ff);
+          break;
+        }
+        preds[next - numBase].push_back(ff);
+      }
+    }
+    while (!dead.empty()) {
+      size_t ff = dead.back();
+      dead.pop_back();
+      for (size_t prev : preds[ff])
+        if (alive[prev]) {
+          alive[prev] = false;
+          dead.push_back(prev);
+        }
+    }
+  }
+
+  // number the rest densely; each transition of theirs leads to a base
+  // state, or to numBase plus another of them
+  vector<size_t>   rest;
+  vector<uint32_t> local(numFresh, gNoElem);
+  for (size_t ff = 0; ff < numFresh; ++ff)
+    if (!alive[ff]) {
+      local[ff] = static_cast<uint32_t>(rest.size());
+      rest.push_back(ff);
+    }
+  auto resolve = [&](size_t ref) -> size_t {
+    if (ref < numBase)
+      return ref;
+    size_t ff = ref - numBase;
+    return alive[ff] ? static_cast<size_t>(pairs[ff].first)
+                     : (numBase + local[ff]);
+  };
+
+  const uint32_t numRest = static_cast<uint32_t>(rest.size());
+  if (numRest * numClasses >= gNoElem)
+    throw RedExceptMinimize("too many transitions to minimize");
+  const uint32_t numTrans = static_cast<uint32_t>(numRest * numClasses);
+  vector<size_t> heads(numTrans); // transition tt is from tt / numClasses
+  for (uint32_t rr = 0; rr < numRest; ++rr)
+    for (size_t cls = 0; cls < numClasses; ++cls)
+      heads[rr * numClasses + cls] = resolve(at(rest[rr], cls));
+
+  // transitions into each of the rest, for splitting cords by block
+  vector<uint32_t> inStarts(numRest + 1, 0);
+  vector<uint32_t> inTrans;
+  for (uint32_t tt = 0; tt < numTrans; ++tt)
+    if (heads[tt] >= numBase)
+      ++inStarts[heads[tt] - numBase + 1];
+  for (uint32_t rr = 1; rr <= numRest; ++rr)
+    inStarts[rr] += inStarts[rr - 1];
+  inTrans.resize(inStarts.back());
+  {
+    vector<uint32_t> fill(inStarts.begin(), inStarts.end() - 1);
+    for (uint32_t tt = 0; tt < numTrans; ++tt)
+      if (heads[tt] >= numBase)
+        inTrans[fill[heads[tt] - numBase]++] = tt;
+  }
+
+  Refinable blocks(numRest);
+  {
+    vector<uint32_t> order(numRest);
+    for (uint32_t rr = 0; rr < numRest; ++rr)
+      order[rr] = rr;
+    auto res = [&](uint32_t rr) { return results[rest[rr]]; };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t aa, uint32_t bb) {
+                       return res(aa) < res(bb);
+                     });
+    splitRuns(blocks, order, [&](uint32_t aa, uint32_t bb) {
+      return res(aa) == res(bb);
+    });
+  }
+
+  Refinable cords(numTrans);
+  {
+    auto key = [&](uint32_t tt) {
+      size_t head = (heads[tt] < numBase) ? heads[tt] : numBase;
+      return std::make_pair(tt % numClasses, head);
+    };
+    vector<uint32_t> order(numTrans);
+    for (uint32_t tt = 0; tt < numTrans; ++tt)
+      order[tt] = tt;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t aa, uint32_t bb) {
+                       return key(aa) < key(bb);
+                     });
+    splitRuns(cords, order, [&](uint32_t aa, uint32_t bb) {
+      return key(aa) == key(bb);
+    });
+  }
+
+  // block zero needn't split anything, as the others already do
+  uint32_t bb = 1;
+  for (uint32_t cc = 0; cc < cords.numSets(); ++cc) {
+    for (const uint32_t *tt = cords.begin(cc); tt != cords.end(cc); ++tt)
+      blocks.mark(static_cast<uint32_t>(*tt / numClasses));
+    blocks.split();
+    for (; bb < blocks.numSets(); ++bb) {
+      for (const uint32_t *rr = blocks.begin(bb); rr != blocks.end(bb); ++rr)
+        for (uint32_t ii = inStarts[*rr]; ii < inStarts[*rr + 1]; ++ii)
+          cords.mark(inTrans[ii]);
+      cords.split();
+    }
+  }
+
+  // states are base ids, then numBase plus a block; number what's
+  // reachable, keeping the error and initial ids
+  auto node = [&](size_t ref) -> size_t {
+    size_t res = resolve(ref);
+    return (res < numBase) ? res
+                           : (numBase + blocks.setOf(
+                                static_cast<uint32_t>(res - numBase)));
+  };
+  auto row = [&](size_t nd, size_t cls) -> size_t {
+    if (nd < numBase)
+      return base_[static_cast<DfaId>(nd)].transitions_[reps[cls].first];
+    uint32_t lead = *blocks.begin(static_cast<uint32_t>(nd - numBase));
+    return node(at(rest[lead], cls));
+  };
+
+  DfaObj out(budget_);
+  vector<DfaId> outIds(numBase + blocks.numSets(), gDfaErrorId);
+  vector<size_t> order;
+  {
+    DfaId errId  = out.newState();
+    DfaId initId = out.newState();
+    if ((errId != gDfaErrorId) || (initId != gDfaInitialId))
+      throw RedExceptCompile("dfa state ids not what was expected");
+    order.push_back(gDfaErrorId);
+    order.push_back(node(init));
+    outIds[order[1]] = initId;
+    for (size_t ii = 1; ii < order.size(); ++ii)
+      for (size_t cls = 0; cls < numClasses; ++cls) {
+        size_t next = row(order[ii], cls);
+        if ((next != gDfaErrorId) && (outIds[next] == gDfaErrorId)) {
+          outIds[next] = out.newState();
+          order.push_back(next);
+        }
+      }
+  }
+
+  for (size_t nd : order) {
+    DfaState &ds = out[outIds[nd]];
+    ds.result_ = (nd < numBase) ?
+      base_[static_cast<DfaId>(nd)].result_ :
+      results[rest[*blocks.begin(static_cast<uint32_t>(nd - numBase))]];
+    for (size_t cls = 0; cls < numClasses; ++cls)
+      ds.transitions_.set(static_cast<CharIdx>(cls), outIds[row(nd, cls)]);
+  }
+  out.setEquivMap(std::move(map));
+  flagDeadEnds(out.getMutStates(), static_cast<CharIdx>(numClasses - 1));
+  return out;
+}
+
+} // namespace zezax::red
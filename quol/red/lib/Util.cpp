@@ -18,6 +18,7 @@
 #endif
 
 #include <array>
+#include <cstdio>
 #include <limits>
 #include <system_error>
 
@@ -47,7 +48,12 @@ void writeStringToFile(string_view str, const char *path) {
   if (!path)
     throw RedExceptApi("write file path is null");
 
-  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  // written aside, then renamed over, so a mapping of the old file
+  // never sees it truncated or half written
+  string tmp(path);
+  tmp += ".tmp.";
+  tmp += std::to_string(getpid());
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
   if (fd < 0)
     throw system_error(errno, generic_category(),
                        "failed to open file for write");
@@ -59,13 +65,24 @@ void writeStringToFile(string_view str, const char *path) {
     if (did < 0) {
       if (errno == EINTR)
         continue;
+      int err = errno;
       close(fd);
-      throw system_error(errno, generic_category(), "failed to write file");
+      unlink(tmp.c_str());
+      throw system_error(err, generic_category(), "failed to write file");
     }
     str.remove_prefix(did);
   }
 
-  close(fd);
+  if (close(fd) < 0) {
+    int err = errno;
+    unlink(tmp.c_str());
+    throw system_error(err, generic_category(), "failed to close file");
+  }
+  if (rename(tmp.c_str(), path) < 0) {
+    int err = errno;
+    unlink(tmp.c_str());
+    throw system_error(err, generic_category(), "failed to rename file");
+  }
 }
 
 
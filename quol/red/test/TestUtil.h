@@ -0,0 +1,27 @@
+// helpers shared by unit tests
+
+#pragma once
+
+#include <string>
+#include <utility>
+
+#include "Executable.h"
+#include "Serializer.h"
+
+namespace zezax::red {
+
+// same program without any sections, so without the prefilter and the
+// companions; accel flags remain but go unused
+inline Executable stripped(const Executable &exec) {
+  std::string buf(exec.serialized());
+  FileHeader *hdr = reinterpret_cast<FileHeader *>(buf.data());
+  if (hdr->sectionOff_ > 0) {
+    buf.resize(hdr->sectionOff_);
+    hdr = reinterpret_cast<FileHeader *>(buf.data());
+    hdr->sectionOff_ = 0;
+    hdr->checksum_ = calcChecksum(buf.data(), buf.size());
+  }
+  return Executable(std::move(buf));
+}
+
+} // namespace zezax::red
@@ -0,0 +1,133 @@
+// unit tests for direct string-set dfa construction
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Acyclic.h"
+#include "Powerset.h"
+#include "Minimizer.h"
+#include "Compile.h"
+#include "Matcher.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const vector<ExactString> gWords = {
+  {"tap", 1}, {"taps", 2}, {"top", 1}, {"tops", 2}, {"stop", 3},
+  {"stops", 4}, {"step", 3}, {"steps", 4}, {"Tap", 5}, {"", 6},
+  {"a\xff\x01", 7}, {"top", 8}, {"zzz", 1},
+};
+
+const vector<string> gProbes = {
+  "", "t", "ta", "tap", "taps", "tapss", "top", "tops", "stop", "stops",
+  "step", "steps", "Tap", "TAP", "tAp", "STOPS", "a\xff\x01", "a\xff",
+  "zzz", "ZZZ", "zz", "x",
+};
+
+
+DfaObj viaNfa(const vector<ExactString> &words, Flags flags) {
+  Parser p;
+  for (const ExactString &es : words)
+    p.addExact(es.str_, es.result_, flags);
+  p.finish();
+  EXPECT_FALSE(p.exactOnly());
+  DfaObj dfa;
+  {
+    PowersetConverter psc(p.getNfa());
+    dfa = psc.convert();
+  }
+  DfaMinimizer dm(dfa);
+  dm.minimize();
+  return dfa;
+}
+
+} // anonymous
+
+
+TEST(Acyclic, same) {
+  for (bool ignoreCase : {false, true}) {
+    DfaObj want = viaNfa(gWords, ignoreCase ? Flags{fIgnoreCase} : Flags{0});
+    vector<ExactString> words = gWords;
+    AcyclicBuilder ab;
+    DfaObj got = ab.build(words, ignoreCase);
+    EXPECT_EQ(want.numStates(), got.numStates()) << ignoreCase;
+    for (const string &probe : gProbes)
+      EXPECT_EQ(want.matchFull(probe), got.matchFull(probe))
+        << ignoreCase << ' ' << probe;
+  }
+}
+
+
+TEST(Acyclic, results) {
+  vector<ExactString> words = gWords;
+  AcyclicBuilder ab;
+  DfaObj dfa = ab.build(words, false);
+  EXPECT_EQ(0, dfa.matchFull("")); // ignored, as by addExact()
+  EXPECT_EQ(1, dfa.matchFull("top")); // lowest of duplicates wins
+  EXPECT_EQ(2, dfa.matchFull("tops"));
+  EXPECT_EQ(5, dfa.matchFull("Tap"));
+  EXPECT_EQ(0, dfa.matchFull("TAP"));
+  EXPECT_EQ(7, dfa.matchFull("a\xff\x01"));
+  EXPECT_EQ(0, dfa.matchFull("st"));
+}
+
+
+TEST(Acyclic, compile) {
+  Parser p;
+  p.addExact("foo", 1, fIgnoreCase);
+  p.addExact("foobar", 2, fIgnoreCase);
+  p.addExact("bar", 3, fIgnoreCase);
+  EXPECT_TRUE(p.exactOnly());
+  EXPECT_TRUE(p.exactIgnoreCase());
+  Executable exec = compile(p);
+  EXPECT_EQ(1, check(exec, "FOO", styFull));
+  EXPECT_EQ(2, check(exec, "fooBar", styFull));
+  EXPECT_EQ(0, check(exec, "foob", styFull));
+  EXPECT_EQ(3, search(exec, "xxBARxx", styLast).result_);
+  Outcome oc = search(exec, "xxfOObaR", styLast);
+  EXPECT_EQ(2, oc.result_);
+  EXPECT_EQ(8U, oc.end_);
+}
+
+
+TEST(Acyclic, parser) {
+  {
+    Parser p;
+    EXPECT_FALSE(p.exactOnly());
+    p.addExact("foo", 1, 0);
+    EXPECT_TRUE(p.exactOnly());
+    p.addExact("bar", 2, fIgnoreCase); // different flags
+    EXPECT_FALSE(p.exactOnly());
+    p.finish();
+    DfaObj dfa;
+    {
+      PowersetConverter psc(p.getNfa());
+      dfa = psc.convert();
+    }
+    EXPECT_EQ(1, dfa.matchFull("foo"));
+    EXPECT_EQ(0, dfa.matchFull("FOO"));
+    EXPECT_EQ(2, dfa.matchFull("BAR"));
+  }
+  {
+    Parser p;
+    p.addExact("foo", 1, fLooseEnd);
+    EXPECT_FALSE(p.exactOnly());
+  }
+  {
+    Parser p;
+    p.addExact("foo", 1, 0);
+    p.add("ba+r", 2, 0);
+    EXPECT_FALSE(p.exactOnly());
+    p.addExact("baz", 3, 0);
+    Executable exec = compile(p);
+    EXPECT_EQ(1, check(exec, "foo", styFull));
+    EXPECT_EQ(2, check(exec, "baaar", styFull));
+    EXPECT_EQ(3, check(exec, "baz", styFull));
+  }
+}
@@ -0,0 +1,37 @@
+// unit tests for crc-32c checksum
+
+#include <cstdint>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "Crc.h"
+
+using namespace zezax::red;
+
+TEST(Crc, smoke) {
+  const char *check = "123456789";
+  EXPECT_EQ(0U, crc32c(check, 0));
+  EXPECT_EQ(0xe3069283U, crc32c(check, strlen(check)));
+  uint32_t c0 = crc32c(check, 4);
+  EXPECT_EQ(0xe3069283U, crc32cInc(c0, check + 4, 5));
+
+  uint8_t zeros[32] = {};
+  EXPECT_EQ(0x8a9136aaU, crc32c(zeros, sizeof(zeros)));
+}
+
+
+TEST(Crc, alignment) {
+  // every start and length around the 8-byte stride gives the same answer
+  uint8_t buf[64];
+  for (size_t ii = 0; ii < sizeof(buf); ++ii)
+    buf[ii] = static_cast<uint8_t>(ii * 37 + 11);
+  for (size_t beg = 0; beg < 9; ++beg)
+    for (size_t len = 0; (beg + len) <= sizeof(buf); ++len) {
+      uint32_t whole = crc32c(buf + beg, len);
+      uint32_t bytewise = 0;
+      for (size_t ii = 0; ii < len; ++ii)
+        bytewise = crc32cInc(bytewise, buf + beg + ii, 1);
+      ASSERT_EQ(whole, bytewise) << beg << ' ' << len;
+    }
+}
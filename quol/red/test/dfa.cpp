@@ -420,3 +420,29 @@ TEST(Dfa, constiter) {
   EXPECT_TRUE(it.seen().get(4));
   EXPECT_TRUE(it.seen().get(5));
 }
+
+
+TEST(Dfa, deadEnds) {
+  DfaObj dfa;
+  DfaId s0 = mkState(dfa, 0);
+  DfaId s1 = mkState(dfa, 0);
+  DfaId s2 = mkState(dfa, 1);
+  DfaId s3 = mkState(dfa, 1);
+  DfaId s4 = mkState(dfa, 1);
+  addTrans(dfa, s1, s2, 0);
+  addTrans(dfa, s1, s3, 1);
+  addTrans(dfa, s2, s2, 0);
+  addTrans(dfa, s2, s2, 1);
+  addTrans(dfa, s2, s2, 2); // loops on every class
+  addTrans(dfa, s3, s3, 0);
+  addTrans(dfa, s3, s3, 1); // class 2 leads to the error state
+  flagDeadEnds(dfa.getMutStates(), 2);
+  EXPECT_TRUE(dfa[s0].deadEnd_);
+  EXPECT_FALSE(dfa[s1].deadEnd_);
+  EXPECT_TRUE(dfa[s2].deadEnd_);
+  EXPECT_FALSE(dfa[s3].deadEnd_);
+  EXPECT_FALSE(dfa[s4].deadEnd_); // no exits at all
+  flagDeadEnds(dfa.getMutStates(), 0);
+  EXPECT_TRUE(dfa[s2].deadEnd_);
+  EXPECT_FALSE(dfa[s4].deadEnd_);
+}
@@ -2,15 +2,21 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
+#include <system_error>
+
 #include "Parser.h"
 #include "Compile.h"
 #include "Executable.h"
 #include "Matcher.h"
+#include "Util.h"
 
 using namespace zezax::red;
 
 using std::string;
 using std::string_view;
+using std::to_string;
 using testing::TestWithParam;
 using testing::Values;
 
@@ -61,9 +67,68 @@ TEST(Executable, memory) {
   EXPECT_EQ(1, execMatch(e0, "abbc"));
   EXPECT_EQ(1, execMatch(e3, "abbc"));
   EXPECT_EQ(1, execMatch(e7, "abbc"));
+
+  // the buffers being replaced are freed
+  e5 = std::move(e6);
+  e0 = std::move(e5);
+  EXPECT_EQ(1, execMatch(e0, "abbc"));
 };
 
 
+TEST(Executable, mapped) {
+  string fn = "/tmp/redm" + to_string(getpid());
+  {
+    Parser p;
+    p.addAuto("ab*c", 1, 0);
+    writeStringToFile(compileToSerialized(p, fmtDirectAuto, cfUnanchored),
+                      fn.c_str());
+  }
+
+  const Flags variants[] = {0, mfPopulate, mfWillNeed | mfHugePages};
+  for (Flags flags : variants) {
+    Executable e1(gPathTag, fn.c_str(), flags);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(e1.getHeader()) & 4095);
+    EXPECT_EQ(1, execMatch(e1, "abbc"));
+    EXPECT_NE(nullptr, e1.getUnanchored());
+    Executable e2(std::move(e1));
+    EXPECT_EQ(1, execMatch(e2, "abbbc"));
+    Executable e3;
+    e3 = std::move(e2);
+    EXPECT_EQ(0, execMatch(e3, "abbd"));
+  }
+  {
+    Executable lazy(gPathTag, fn.c_str(), mfLazyVerify);
+    EXPECT_EQ(1, execMatch(lazy, "abc"));
+    lazy.awaitVerified();
+  }
+
+  // corrupt the final byte, which only the checksum covers
+  {
+    string buf = readFileToString(fn.c_str());
+    buf.back() ^= 1;
+    writeStringToFile(buf, fn.c_str());
+  }
+  EXPECT_THROW(Executable(gPathTag, fn.c_str()), RedExcept);
+  {
+    Executable e1(gPathTag, fn.c_str(), mfNoVerify);
+    EXPECT_EQ(1, execMatch(e1, "abbc"));
+    e1.awaitVerified(); // nothing to wait for
+    Executable e2(gPathTag, fn.c_str(), mfLazyVerify);
+    EXPECT_EQ(1, execMatch(e2, "abbc"));
+    EXPECT_THROW(e2.awaitVerified(), RedExcept);
+    EXPECT_THROW(e2.awaitVerified(), RedExcept);
+    Executable e3(std::move(e2));
+    EXPECT_THROW(e3.awaitVerified(), RedExcept);
+  }
+
+  writeStringToFile("REDA but not really", fn.c_str());
+  EXPECT_THROW(Executable(gPathTag, fn.c_str()), RedExcept);
+  writeStringToFile("", fn.c_str());
+  EXPECT_THROW(Executable(gPathTag, fn.c_str()), RedExcept);
+  unlink(fn.c_str());
+  EXPECT_THROW(Executable(gPathTag, fn.c_str()), std::system_error);
+}
+
 class ExecTest : public TestWithParam<Format> {};
 
 TEST_P(ExecTest, smoke) {
@@ -85,7 +150,7 @@ TEST_P(ExecTest, smoke) {
   EXPECT_LT(0, stats.origNfaStates_);
   EXPECT_LT(0, stats.usefulNfaStates_);
   EXPECT_LT(0, stats.origDfaStates_);
-  EXPECT_EQ(7, stats.minimizedDfaStates_);
+  EXPECT_EQ(8, stats.minimizedDfaStates_);
   EXPECT_LT(0, stats.serializedBytes_);
   EXPECT_EQ(4, stats.numDistinguishedSymbols_);
   EXPECT_LT(0, stats.transitionTableRows_);
@@ -93,5 +158,38 @@ TEST_P(ExecTest, smoke) {
 }
 
 
+TEST_P(ExecTest, unanchored) {
+  Format fmt = GetParam();
+  Executable plain;
+  Executable rex;
+  {
+    Parser p;
+    Parser pu;
+    p.add("ab*c", 1, 0);
+    pu.add("ab*c", 1, 0);
+    plain = compile(p, fmt);
+    rex = compile(pu, fmt, cfUnanchored);
+  }
+  EXPECT_EQ(nullptr, plain.getUnanchored());
+  ASSERT_NE(nullptr, rex.getUnanchored());
+
+  const Executable &un = *rex.getUnanchored();
+  EXPECT_EQ(nullptr, un.getUnanchored());
+  EXPECT_EQ(0, execMatch(rex, "xxabbc"));
+  EXPECT_EQ(1, execMatch(un, "xxabbc"));
+  EXPECT_EQ(1, execMatch(un, "abc"));
+  EXPECT_EQ(0, execMatch(un, "xxabbcx"));
+
+  Executable moved(std::move(rex));
+  ASSERT_NE(nullptr, moved.getUnanchored());
+  EXPECT_EQ(1, execMatch(*moved.getUnanchored(), "xac"));
+
+  Executable copied(gCopyTag, moved.serialized());
+  ASSERT_NE(nullptr, copied.getUnanchored());
+  EXPECT_EQ(1, execMatch(*copied.getUnanchored(), "xac"));
+}
+
+
 INSTANTIATE_TEST_SUITE_P(A, ExecTest,
-  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4));
+  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4, fmtDirect8,
+         fmtFlat2, fmtFlat4, fmtComb4));
@@ -0,0 +1,162 @@
+// unit tests for on-demand dfa construction
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Parser.h"
+#include "Compile.h"
+#include "Matcher.h"
+#include "Lazy.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Case {
+  vector<string> regexes_;
+  Flags          flags_;
+  vector<string> texts_;
+};
+
+
+const Style gStyles[] = {styInstant, styFirst, styTangent, styLast, styFull};
+
+
+void fill(Parser &p, const Case &cc) {
+  Result res = 0;
+  for (const string &re : cc.regexes_)
+    p.add(re, ++res, cc.flags_);
+}
+
+
+// compares everything but start_, which is a heuristic for both
+void expectSame(const Executable &exec, const LazyDfa &lazy, const string &s) {
+  for (Style sty : gStyles) {
+    EXPECT_EQ(check(exec, s, sty), check(lazy, s, sty)) << s << ' ' << sty;
+    Outcome want = match(exec, s, sty);
+    Outcome got = match(lazy, s, sty);
+    EXPECT_EQ(want.result_, got.result_) << s << ' ' << sty;
+    EXPECT_EQ(want.end_, got.end_) << s << ' ' << sty;
+    want = search(exec, s, sty);
+    got = search(lazy, s, sty);
+    EXPECT_EQ(want.result_, got.result_) << s << ' ' << sty;
+    EXPECT_EQ(want.end_, got.end_) << s << ' ' << sty;
+  }
+}
+
+
+void checkMany(const LazyDfa        *lazy,
+               const vector<string> *texts,
+               vector<Result>       *out) {
+  for (int rep = 0; rep < 100; ++rep)
+    for (const string &s : *texts)
+      out->push_back(check(*lazy, s, styLast));
+}
+
+} // anonymous
+
+TEST(Lazy, agree) {
+  vector<Case> cases = {
+    {{"[0-9]+"}, 0, {"", "0123456789", "x12", "12x"}},
+    {{"abc", "abcd"}, 0, {"abcde", "abc", "ab", "xabcd"}},
+    {{"new", "new york"}, 0, {"new york", "new yor", "a new york"}},
+    {{"foo.*bar", "fo+"}, fLooseStart,
+     {"afoolsbarf", "foo", "xfoooo", "bar", ""}},
+    {{"[a-z]+", "cat", "c.t"}, 0, {"cat", "cut", "cattle", "c!t", "dog"}},
+    {{"(a|b)*a(a|b){5}"}, fLooseEnd,
+     {"abababa", "aaaaaa", "bbbbbbbbbb", "babbbbbaa"}},
+    {{"x*"}, 0, {"", "xxx", "xy", "yx", "y"}},
+    {{"c*", "(a|bc)b"}, 0,
+     {"", "ab", "xab", "cc", "d", "dabacdad", "bcbcc", "xxbcb", "ccab"}},
+  };
+  for (const Case &cc : cases) {
+    Parser p1;
+    Parser p2;
+    fill(p1, cc);
+    fill(p2, cc);
+    Executable exec = compile(p1);
+    LazyDfa lazy(p2);
+    for (const string &s : cc.texts_)
+      expectSame(exec, lazy, s);
+    EXPECT_LE(2U, lazy.cachedStates());
+    EXPECT_EQ(0U, lazy.cacheFlushes());
+  }
+}
+
+
+
+TEST(Lazy, nullable) {
+  // the empty match at each start only counts for empty input
+  Parser p;
+  p.add("c*",      1, 0);
+  p.add("(a|bc)b", 3, 0);
+  LazyDfa lazy(p);
+  EXPECT_EQ((Outcome{3, 0, 2}), search(lazy, "ab", styFirst));
+  EXPECT_EQ((Outcome{1, 0, 2}), search(lazy, "cc", styLast));
+  EXPECT_EQ((Outcome{3, 1, 3}), search(lazy, "dabacdad", styLast));
+  EXPECT_EQ((Outcome{1, 0, 0}), search(lazy, "", styLast));
+  for (Style sty : gStyles)
+    EXPECT_EQ(0, search(lazy, "d", sty).result_) << sty;
+}
+
+
+TEST(Lazy, evict) {
+  // the DFA needs 2^9 states to remember the last nine bytes
+  Case cc{{"(a|b)*a(a|b){8}"}, 0, {}};
+  string text;
+  for (int ii = 0; ii < 600; ++ii)
+    text += ((ii * 7) % 5 < 2) ? 'a' : 'b';
+  cc.texts_ = {text, text + "aaaaaaaa", text + "x"};
+
+  Parser p1;
+  Parser p2;
+  fill(p1, cc);
+  fill(p2, cc);
+  Executable exec = compile(p1);
+  LazyDfa lazy(p2, 20);
+  for (const string &s : cc.texts_)
+    expectSame(exec, lazy, s);
+  EXPECT_LT(0U, lazy.cacheFlushes());
+  EXPECT_GE(20U, lazy.cachedStates());
+
+  Parser p3;
+  fill(p3, cc);
+  EXPECT_THROW(LazyDfa(p3, 2), RedExceptApi);
+}
+
+
+TEST(Lazy, threads) {
+  Parser p1;
+  Parser p2;
+  p1.add("[a-z]+[0-9]", 1, fLooseStart);
+  p1.add("[0-9]+[a-z]", 2, fLooseStart);
+  p2.add("[a-z]+[0-9]", 1, fLooseStart);
+  p2.add("[0-9]+[a-z]", 2, fLooseStart);
+  Executable exec = compile(p1);
+  LazyDfa lazy(p2, 5);
+  vector<string> texts = {"abc1", "123x", "---", "a1b2c3", "9z", ""};
+
+  vector<Result> want;
+  for (const string &s : texts)
+    want.push_back(check(exec, s, styLast));
+
+  vector<vector<Result>> got(4);
+  vector<std::thread> pool;
+  for (vector<Result> &out : got)
+    pool.emplace_back(checkMany, &lazy, &texts, &out);
+  for (std::thread &thr : pool)
+    thr.join();
+
+  for (const vector<Result> &out : got) {
+    ASSERT_EQ(want.size() * 100, out.size());
+    for (size_t ii = 0; ii < out.size(); ++ii)
+      EXPECT_EQ(want[ii % want.size()], out[ii]) << ii;
+  }
+  EXPECT_EQ(2U, lazy.cachedStates()); // this thread's cache is untouched
+}
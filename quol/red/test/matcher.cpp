@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+
 #include "Parser.h"
 #include "Compile.h"
 #include "Executable.h"
@@ -124,6 +126,149 @@ TEST_P(MatcherTest, startEnd) {
   EXPECT_EQ(7, oc.end_);
 }
 
+TEST_P(MatcherTest, exactStart) {
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("a*", 1, 0);
+    rex = compile(p, fmt, cfReverse);
+  }
+  ASSERT_NE(nullptr, rex.getReverse());
+  EXPECT_EQ(nullptr, rex.getUnanchored());
+  Outcome oc = search<styLast, true>(rex, "123az");
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(3, oc.start_); // unlike the estimate in the start test
+  EXPECT_EQ(4, oc.end_);
+
+  {
+    Parser p;
+    p.add(".*[a-z]+", 1, 0);
+    rex = compile(p, fmt, cfReverse);
+  }
+  oc = search<styLast, true>(rex, "123az!");
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(0, oc.start_); // explicit .* is part of the match
+  EXPECT_EQ(5, oc.end_);
+
+  {
+    Parser p;
+    p.add("[a-z]+", 1, fLooseStart);
+    rex = compile(p, fmt, cfReverse | cfUnanchored);
+  }
+  oc = search<styLast, true>(rex, "123az!");
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(3, oc.start_); // flag-provided .* is not
+  EXPECT_EQ(5, oc.end_);
+  oc = match(rex, "123az!", styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(3, oc.start_);
+  EXPECT_EQ(5, oc.end_);
+
+  {
+    Parser p;
+    p.add("[^a]*ab*c", 1, 0);
+    rex = compile(p, fmt, cfReverse);
+  }
+  oc = match(rex, "xabbc", styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(0, oc.start_);
+  EXPECT_EQ(5, oc.end_);
+  oc = search(rex, "xyzabbcxyz", styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(0, oc.start_);
+  EXPECT_EQ(7, oc.end_);
+
+  {
+    Parser p;
+    p.add("new", 2, fLooseStart);
+    p.add("new york", 3, fLooseStart | fIgnoreCase);
+    rex = compile(p, fmt, cfReverse);
+  }
+  oc = match(rex, "I love New York.", styLast);
+  EXPECT_EQ(3, oc.result_);
+  EXPECT_EQ(7, oc.start_);
+  EXPECT_EQ(15, oc.end_);
+  oc = match(rex, "I love New York.", styFull);
+  EXPECT_EQ(0, oc.result_);
+  EXPECT_EQ(0, oc.start_);
+  EXPECT_EQ(0, oc.end_);
+}
+
+TEST_P(MatcherTest, exactStartRefine) {
+  // RefineMinimizer leaves states with no exits, which aren't dead ends
+  struct Case {
+    const char *regex_;
+    const char *text_;
+    size_t      start_;
+  };
+  Format fmt = GetParam();
+  for (const Case &cs : {Case{".{1,2}", "ddbdA", 3},
+                         Case{".?", "Abadcacb", 7},
+                         Case{"[ab]*[^a]", "addadbd", 5},
+                         Case{"b.?", "acadcbcad", 5}}) {
+    Executable plain;
+    Executable refine;
+    {
+      Parser p;
+      p.add(cs.regex_, 1, fLooseStart);
+      plain = compile(p, fmt, cfReverse);
+    }
+    {
+      Parser p;
+      p.add(cs.regex_, 1, fLooseStart);
+      refine = compile(p, fmt, cfReverse | cfRefine);
+    }
+    Executable marked[2]; // with starts companions
+    for (int ii = 0; ii < 2; ++ii) {
+      Flags opts = cfReverse | cfUnanchored;
+      if (ii)
+        opts |= cfRefine;
+      Parser p;
+      p.add(cs.regex_, 1, fLooseStart);
+      marked[ii] = compile(p, fmt, opts);
+      ASSERT_NE(nullptr, marked[ii].getStarts());
+    }
+    Outcome want = search<styLast, true>(plain, cs.text_);
+    Outcome got  = search<styLast, true>(refine, cs.text_);
+    EXPECT_EQ(1, got.result_) << cs.regex_;
+    EXPECT_EQ(cs.start_, got.start_) << cs.regex_;
+    EXPECT_EQ(want, got) << cs.regex_;
+    EXPECT_EQ(want, (search<styLast, true>(marked[1], cs.text_)))
+      << cs.regex_;
+    EXPECT_EQ(match(plain, cs.text_, styLast),
+              match(refine, cs.text_, styLast)) << cs.regex_;
+
+    string_view text = cs.text_;
+    const Byte *beg = reinterpret_cast<const Byte *>(text.data());
+    const Byte *end = beg + text.size();
+    vector<bool> wantMarks;
+    vector<bool> gotMarks;
+    findStarts(*marked[0].getStarts(), beg, end, wantMarks);
+    findStarts(*marked[1].getStarts(), beg, end, gotMarks);
+    EXPECT_EQ(wantMarks, gotMarks) << cs.regex_;
+  }
+}
+
+TEST_P(MatcherTest, loopToStart) {
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("(ab)*c", 1, 0);
+    p.add("xy",     2, 0);
+    EXPECT_EQ(2, p.getStarts().population());
+    rex = compile(p, fmt, cfReverse);
+  }
+  EXPECT_EQ(1, check(rex, "ababc", styFull));
+  EXPECT_EQ(2, check(rex, "xy", styFull));
+  EXPECT_EQ(0, check(rex, "abxy", styFull)); // loop must not reach "xy"
+  Outcome oc = search(rex, "zzababcz", styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(2, oc.start_);
+  EXPECT_EQ(7, oc.end_);
+}
+
 // check & match
 
 TEST_P(MatcherTest, matchTangent) {
@@ -643,6 +788,52 @@ TEST_P(MatcherTest, searchFull) {
   EXPECT_EQ(0, oc.end_);
 }
 
+namespace {
+
+Outcome searchNoLeader(const Executable &rex, string_view sv, Style sty) {
+  switch (sty) {
+  case styInstant: return search<styInstant, false>(rex, sv);
+  case styFirst:   return search<styFirst, false>(rex, sv);
+  case styTangent: return search<styTangent, false>(rex, sv);
+  case styLast:    return search<styLast, false>(rex, sv);
+  case styFull:    return search<styFull, false>(rex, sv);
+  default:         return Outcome::fail();
+  }
+}
+
+} // anonymous
+
+
+TEST_P(MatcherTest, searchNullable) {
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("c*",      1, 0);
+    p.add("(a|bc)b", 3, 0);
+    rex = compile(p, fmt);
+  }
+  ASSERT_EQ(0, rex.getLeaderLen());
+
+  // the empty match at each start only counts for empty input
+  EXPECT_EQ((Outcome{3, 0, 2}), search(rex, "ab", styFirst));
+  EXPECT_EQ((Outcome{3, 1, 3}), search(rex, "xab", styFirst));
+  EXPECT_EQ((Outcome{1, 0, 1}), search(rex, "cc", styInstant));
+  EXPECT_EQ((Outcome{1, 0, 2}), search(rex, "cc", styLast));
+  EXPECT_EQ((Outcome{3, 1, 3}), search(rex, "dabacdad", styLast));
+  EXPECT_EQ((Outcome{1, 0, 0}), search(rex, "", styLast));
+
+  for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+    EXPECT_EQ(0, search(rex, "d", sty).result_) << sty;
+    for (string_view in : {"", "ab", "xab", "cc", "d", "dabacdad", "bcbcc",
+                           "xxbcb", "abcc", "ccab"}) {
+      Outcome oc = search(rex, in, sty);
+      EXPECT_EQ(searchNoLeader(rex, in, sty), oc) << sty << ' ' << in;
+      EXPECT_EQ(oc.result_, scan(rex, in, sty)) << sty << ' ' << in;
+    }
+  }
+}
+
 // replace
 
 TEST_P(MatcherTest, replace) {
@@ -690,6 +881,192 @@ TEST_P(MatcherTest, replaceStyles) {
   EXPECT_EQ("#xyz", s);
 }
 
+// unanchored companion must not change any answers
+
+TEST_P(MatcherTest, unanchored) {
+  Format fmt = GetParam();
+  static const char *regexes[] = {
+    "ab*c", "[0-9]+", "x.*y", "(ab|cd)*e", "a?", "z",
+  };
+  static const char *texts[] = {
+    "", "abc", "xxabbbcyy", "xaxcd", "12ab345", "xxxxxxxxy", "yx",
+    "ababcde", "e", "qqqqqqq", "zzz",
+  };
+  for (const char *re : regexes) {
+    Executable plain;
+    Executable rex;
+    {
+      Parser p;
+      Parser pu;
+      p.add(re, 1, 0);
+      pu.add(re, 1, 0);
+      plain = compile(p, fmt);
+      rex = compile(pu, fmt, cfUnanchored);
+    }
+    ASSERT_NE(nullptr, rex.getUnanchored());
+    ASSERT_NE(nullptr, rex.getStarts());
+    for (const char *text : texts) {
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        EXPECT_EQ(scan(plain, text, sty), scan(rex, text, sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(search(plain, text, sty), search(rex, text, sty))
+          << re << " / " << text << " / " << sty;
+        string s1;
+        string s2;
+        EXPECT_EQ(replace(plain, text, "#", s1, 9999, sty),
+                  replace(rex, text, "#", s2, 9999, sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(s1, s2);
+      }
+    }
+  }
+}
+
+TEST_P(MatcherTest, unanchoredSets) {
+  // companions of loose and anchored sets, minimized as by default
+  Format fmt = GetParam();
+  auto build = [fmt](Flags opts) {
+    Parser p;
+    p.add("a(a)*d{1,2}", 1, fLooseEnd);
+    p.add("c*d", 2, 0);
+    return compile(p, fmt, opts);
+  };
+  Executable plain = build(0);
+  Executable rex = build(cfUnanchored);
+  ASSERT_NE(nullptr, rex.getUnanchored());
+  EXPECT_EQ((Outcome{1, 0, 4}), search(plain, "adbA", styFull));
+  for (const char *text : {"adbA", "xadd", "ccd", "cad", "aadbcd"})
+    for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+      EXPECT_EQ(search(plain, text, sty), search(rex, text, sty))
+        << text << " / " << sty;
+      EXPECT_EQ(scan(plain, text, sty), scan(rex, text, sty))
+        << text << " / " << sty;
+    }
+}
+
+// failed attempts that run long fall back on the starts companion
+
+TEST_P(MatcherTest, restartBudget) {
+  Format fmt = GetParam();
+  static const vector<vector<const char *>> sets = {
+    {"a(aa)*b", "c"}, {"a[^x]*b", "ca+"}, {"a*", "(aa)+b"}, {"x.*y|b"},
+  };
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<int> dist(0, 7);
+  const char alpha[] = "aaaaabcy";
+  vector<string> texts = {
+    string(3000, 'a'), string(3000, 'a') + "c", string(3000, 'a') + "ab",
+    "b" + string(3000, 'a'), string(1500, 'a') + "c" + string(1500, 'a'),
+  };
+  for (int ii = 0; ii < 6; ++ii) {
+    string s;
+    for (int jj = 0; jj < 2000; ++jj)
+      s.push_back(alpha[dist(gen)]);
+    texts.push_back(s);
+  }
+
+  for (const vector<const char *> &set : sets) {
+    Executable plain;
+    Executable rex;
+    {
+      Parser p;
+      Parser pu;
+      Result res = 0;
+      for (const char *re : set) {
+        ++res;
+        p.add(re, res, 0);
+        pu.add(re, res, 0);
+      }
+      plain = compile(p, fmt);
+      rex = compile(pu, fmt, cfUnanchored);
+    }
+    ASSERT_NE(nullptr, rex.getStarts());
+    for (const string &text : texts)
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        EXPECT_EQ(scan(plain, text, sty), scan(rex, text, sty))
+          << set[0] << " / " << text.size() << " / " << sty;
+        EXPECT_EQ(search(plain, text, sty), search(rex, text, sty))
+          << set[0] << " / " << text.size() << " / " << sty;
+        EXPECT_EQ(search(plain, text.c_str(), sty),
+                  search(rex, text.c_str(), sty))
+          << set[0] << " / " << text.size() << " / " << sty;
+        string s1;
+        string s2;
+        EXPECT_EQ(replace(plain, text, "#", s1, 9999, sty),
+                  replace(rex, text, "#", s2, 9999, sty))
+          << set[0] << " / " << text.size() << " / " << sty;
+        EXPECT_EQ(s1, s2);
+      }
+  }
+
+  // restarting at each of these would take quadratic time
+  Executable rex;
+  {
+    Parser p;
+    p.add("a(aa)*b", 1, 0);
+    p.add("c", 2, 0);
+    rex = compile(p, fmt, cfUnanchored);
+  }
+  string big(200000, 'a');
+  big += 'c';
+  EXPECT_EQ((Outcome{2, 200000, 200001}), search(rex, big, styLast));
+  EXPECT_EQ(2, scan(rex, big.c_str(), styFirst));
+  string s;
+  EXPECT_EQ(1, replace(rex, big, "#", s, 9999, styInstant));
+  EXPECT_EQ(string(200000, 'a') + "#", s);
+}
+
+// required literal must not change any answers
+
+TEST_P(MatcherTest, required) {
+  Format fmt = GetParam();
+  static const char *regexes[] = {
+    "ab.*wxyz", "a[0-9]+xyz", "(ab|cd)*efgh",
+  };
+  static const char *texts[] = {
+    "", "ab", "ab: wxyz ab", "wxyz", "ab wxy", "a1xyz", "a1xy z", "xyz",
+    "cdabefgh", "efgh", "efg",
+  };
+  for (const char *re : regexes) {
+    Executable rex;
+    {
+      Parser p;
+      p.add(re, 1, 0);
+      rex = compile(p, fmt);
+    }
+    ASSERT_FALSE(rex.getRequired().empty()) << re;
+
+    // same program without any sections, so without the literal
+    string buf(rex.serialized());
+    FileHeader *hdr = reinterpret_cast<FileHeader *>(buf.data());
+    buf.resize(hdr->sectionOff_);
+    hdr = reinterpret_cast<FileHeader *>(buf.data());
+    hdr->sectionOff_ = 0;
+    hdr->checksum_ = calcChecksum(buf.data(), buf.size());
+    Executable plain(std::move(buf));
+    ASSERT_TRUE(plain.getRequired().empty());
+
+    for (const char *text : texts) {
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        EXPECT_EQ(check(plain, text, sty), check(rex, text, sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(match(plain, text, sty), match(rex, text, sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(scan(plain, text, sty), scan(rex, string(text), sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(search(plain, text, sty), search(rex, string(text), sty))
+          << re << " / " << text << " / " << sty;
+        string s1;
+        string s2;
+        EXPECT_EQ(replace(plain, text, "#", s1, 9999, sty),
+                  replace(rex, text, "#", s2, 9999, sty))
+          << re << " / " << text << " / " << sty;
+        EXPECT_EQ(s1, s2);
+      }
+    }
+  }
+}
+
 // matchAll
 
 TEST_P(MatcherTest, matchAll) {
@@ -817,5 +1194,301 @@ TEST_P(MatcherTest, charByChar) {
 }
 
 
+// batched
+
+TEST_P(MatcherTest, leaderAccepts) {
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("abc", 1, 0);
+    p.add("abcde", 2, 0);
+    rex = compile(p, fmt);
+  }
+  ASSERT_EQ(3, rex.getLeaderLen());
+  EXPECT_EQ(1, (check<styInstant, true>(rex, "abcd")));
+  EXPECT_EQ(1, (check<styFirst, true>(rex, "abcd")));
+  EXPECT_EQ(1, (check<styTangent, true>(rex, "abcd")));
+  EXPECT_EQ(1, (check<styLast, true>(rex, "abcd")));
+  EXPECT_EQ(2, (check<styLast, true>(rex, "abcdef")));
+  EXPECT_EQ(0, (check<styFull, true>(rex, "abcd")));
+  EXPECT_EQ(1, (scan<styInstant, true>(rex, "xabcx")));
+  EXPECT_EQ(1, (scan<styLast, true>(rex, "xabcx")));
+  EXPECT_EQ((Outcome{1, 1, 4}), (search<styLast, true>(rex, "xabcx")));
+  EXPECT_EQ((Outcome{1, 1, 4}), (search<styInstant, true>(rex, "xabcdef")));
+
+  {
+    Parser p;
+    p.add("a*", 1, 0);
+    rex = compile(p, fmt);
+  }
+  ASSERT_EQ(0, rex.getLeaderLen());
+  EXPECT_EQ(0, (check<styLast, true>(rex, "b")));
+  EXPECT_EQ(0, (check<styFirst, true>(rex, "b")));
+}
+
+
+TEST_P(MatcherTest, batch) {
+  Format fmt = GetParam();
+  vector<Executable> progs;
+  {
+    Parser p;
+    p.add("ab+c", 1, 0);
+    p.add("[0-9]+", 2, 0);
+    p.add("x.*y", 3, 0);
+    progs.push_back(compile(p, fmt));
+  }
+  {
+    Parser p;
+    p.add("abc", 1, 0);
+    p.add("abcd+", 2, 0);
+    progs.push_back(compile(p, fmt, cfReverse));
+  }
+  {
+    Parser p;
+    p.add("[a-c]+y", 1, fLooseStart);
+    progs.push_back(compile(p, fmt, cfReverse));
+  }
+
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<int> dist(0, 7);
+  std::uniform_int_distribution<int> size(0, 12);
+  const char alpha[] = "abcdxy01";
+  vector<string> texts = {"", "abc", "abcddd", "x123y", "abbbc"};
+  for (int ii = 0; ii < 200; ++ii) {
+    string s;
+    for (int jj = size(gen); jj > 0; --jj)
+      s.push_back(alpha[dist(gen)]);
+    texts.push_back(s);
+  }
+  vector<string_view> views(texts.begin(), texts.end());
+
+  for (const Executable &rex : progs)
+    for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+      vector<Result> res(views.size());
+      vector<Outcome> ocs(views.size());
+      checkBatch(rex, views.data(), views.size(), res.data(), sty);
+      matchBatch(rex, views.data(), views.size(), ocs.data(), sty);
+      for (size_t ii = 0; ii < views.size(); ++ii) {
+        EXPECT_EQ(check(rex, views[ii], sty), res[ii]) << texts[ii];
+        EXPECT_EQ(match(rex, views[ii], sty), ocs[ii]) << texts[ii];
+      }
+      for (size_t count : {0, 1, 3}) { // fewer inputs than lanes
+        checkBatch(rex, views.data() + 1, count, res.data(), sty);
+        for (size_t ii = 0; ii < count; ++ii)
+          EXPECT_EQ(check(rex, views[ii + 1], sty), res[ii]);
+      }
+    }
+}
+
+
+// streaming
+
+namespace {
+
+// reference: search again from the end of each match
+vector<Outcome> searchEach(const Executable &rex, string_view sv, Style sty) {
+  vector<Outcome> rv;
+  for (size_t pos = 0; pos < sv.size(); ) {
+    Outcome oc = search(rex, sv.substr(pos), sty);
+    if (!oc || (oc.end_ == 0))
+      break;
+    oc.start_ += pos;
+    oc.end_ += pos;
+    pos = oc.end_;
+    rv.push_back(oc);
+  }
+  return rv;
+}
+
+
+vector<Outcome> streamEach(const Executable &rex,
+                           string_view       sv,
+                           Style             sty,
+                           size_t            chunk) {
+  StreamMatcher sm(rex, sty);
+  vector<Outcome> rv;
+  for (size_t pos = 0; pos < sv.size(); pos += chunk)
+    sm.feed(sv.substr(pos, chunk), rv);
+  sm.finish(rv);
+  return rv;
+}
+
+} // anonymous
+
+TEST_P(MatcherTest, streamBoundary) {
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("hello world", 1, 0);
+    p.add("[0-9]+", 2, 0);
+    rex = compile(p, fmt);
+  }
+  StreamMatcher sm(rex, styLast);
+  vector<Outcome> out;
+  EXPECT_EQ(0U, sm.feed("xx hel", out));
+  EXPECT_EQ(0U, sm.feed("lo wo", out));
+  EXPECT_EQ(1U, sm.feed("rld 12", out));
+  EXPECT_EQ(17U, sm.offset());
+  EXPECT_EQ(0U, sm.feed("34", out));
+  EXPECT_EQ(1U, sm.feed(" ", out));
+  EXPECT_EQ(0U, sm.finish(out));
+  ASSERT_EQ(2U, out.size());
+  EXPECT_EQ((Outcome{1, 3, 14}), out[0]);
+  EXPECT_EQ((Outcome{2, 15, 19}), out[1]);
+  EXPECT_EQ(0U, sm.offset());
+
+  out.clear();
+  EXPECT_EQ(0U, sm.feed("77", out));
+  EXPECT_EQ(1U, sm.finish(out));
+  ASSERT_EQ(1U, out.size());
+  EXPECT_EQ((Outcome{2, 0, 2}), out[0]);
+}
+
+
+TEST_P(MatcherTest, streamEquiv) {
+  Format fmt = GetParam();
+  vector<vector<string>> sets = {
+    {"ab+c", "[0-9]+", "x.*y"},
+    {"abc", "abcd", "bcd+"},
+    {"new", "new york", "york"},
+    {"a(bc)*", "c[ab]"},
+    {"[a-c]+y?"},
+    {"ab.*"},
+    {"x.*y", "b"},
+    {"a", "a.*y"},
+  };
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> dist(0, 11);
+  const char alpha[] = "abcdxy01 nwe";
+  vector<string> texts = {"", "a", "new york newyork", "abcdddd abbbc x1y"};
+  for (int ii = 0; ii < 30; ++ii) {
+    string s;
+    for (int jj = 0; jj < 60; ++jj)
+      s.push_back(alpha[dist(gen)]);
+    texts.push_back(s);
+  }
+
+  for (const vector<string> &set : sets) {
+    Executable rex;
+    {
+      Parser p;
+      Result res = 0;
+      for (const string &re : set)
+        p.add(re, ++res, 0);
+      rex = compile(p, fmt);
+    }
+    for (const string &s : texts)
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        vector<Outcome> want = searchEach(rex, s, sty);
+        for (size_t chunk : {1, 2, 5, 64})
+          EXPECT_EQ(want, streamEach(rex, s, sty, chunk))
+            << set[0] << ' ' << s << ' ' << sty << ' ' << chunk;
+      }
+  }
+}
+
+
+TEST_P(MatcherTest, streamChange) {
+  // the result changes while the attempt is still running
+  Format fmt = GetParam();
+  Executable rex;
+  {
+    Parser p;
+    p.add("[ab]", 1, fLooseStart);
+    p.add("[^a]", 2, fLooseStart);
+    rex = compile(p, fmt);
+  }
+  vector<Outcome> want = searchEach(rex, "dad", styFirst);
+  ASSERT_FALSE(want.empty());
+  EXPECT_EQ((Outcome{2, 0, 1}), want[0]);
+  for (size_t chunk : {1, 3})
+    EXPECT_EQ(want, streamEach(rex, "dad", styFirst, chunk)) << chunk;
+
+  vector<vector<string>> sets = {
+    {"[ab]", "[^a]"},
+    {"a+", "[ab]+c", "b"},
+    {"ab*", "[a-c]d", "d+"},
+  };
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<int> dist(0, 3);
+  const char alpha[] = "abcd";
+  vector<string> texts;
+  for (int ii = 0; ii < 40; ++ii) {
+    string s;
+    for (int jj = 0; jj < 12; ++jj)
+      s.push_back(alpha[dist(gen)]);
+    texts.push_back(s);
+  }
+  for (const vector<string> &set : sets) {
+    {
+      Parser p;
+      Result res = 0;
+      for (const string &re : set)
+        p.add(re, ++res, fLooseStart);
+      rex = compile(p, fmt);
+    }
+    for (const string &s : texts)
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        want = searchEach(rex, s, sty);
+        for (size_t chunk : {1, 5})
+          EXPECT_EQ(want, streamEach(rex, s, sty, chunk))
+            << set[0] << ' ' << s << ' ' << sty << ' ' << chunk;
+      }
+  }
+}
+
+
+TEST_P(MatcherTest, streamLong) {
+  Format fmt = GetParam();
+  constexpr size_t num = 100000;
+  string bees(num, 'b');
+  vector<Outcome> out;
+  {
+    Executable rex;
+    {
+      Parser p;
+      p.add("x.*y", 1, 0);
+      p.add("bz", 2, 0);
+      rex = compile(p, fmt);
+    }
+    StreamMatcher sm(rex, styLast);
+    sm.feed("x", out);
+    for (size_t pos = 0; pos < num; pos += 1000) {
+      sm.feed(string_view(bees).substr(pos, 1000), out);
+      EXPECT_GE(2U, sm.pending()); // failed attempts don't pile up
+    }
+    EXPECT_EQ(0U, sm.finish(out));
+  }
+
+  Executable rex;
+  {
+    Parser p;
+    p.add("x.*y", 1, 0);
+    p.add("b", 2, 0);
+    rex = compile(p, fmt);
+  }
+  StreamMatcher sm(rex, styLast);
+  sm.feed("x", out);
+  sm.feed(bees, out);
+  EXPECT_EQ(0U, out.size()); // held back by the attempt at x
+  EXPECT_EQ(num, sm.finish(out));
+  ASSERT_EQ(num, out.size());
+  EXPECT_EQ((Outcome{2, 1, 2}), out.front());
+  EXPECT_EQ((Outcome{2, num, num + 1}), out.back());
+
+  out.clear();
+  sm.feed("x", out);
+  sm.feed(bees, out);
+  EXPECT_EQ(num + 1, sm.pending());
+  EXPECT_EQ(0U, sm.feed("y", out));
+  EXPECT_EQ(1U, sm.pending()); // the y discarded what it covers
+  EXPECT_EQ(1U, sm.finish(out));
+  ASSERT_EQ(1U, out.size());
+  EXPECT_EQ((Outcome{1, 0, num + 2}), out[0]);
+}
+
 INSTANTIATE_TEST_SUITE_P(A, MatcherTest,
-  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4));
+  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4, fmtDirect8,
+         fmtFlat2, fmtFlat4, fmtComb4));
@@ -2,14 +2,21 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <string>
 #include <vector>
 
 #include "Util.h"
+#include "Parser.h"
+#include "Powerset.h"
+#include "Compile.h"
+#include "Matcher.h"
 #include "Minimizer.h"
 #include "Debug.h" // FIXME
 
 using namespace zezax::red;
 
+using std::string;
 using std::vector;
 
 namespace {
@@ -189,7 +196,134 @@ TEST(Minimizer, deadEnds) {
     else
       ++live;
   }
-  EXPECT_EQ(2, live);
-  EXPECT_EQ(2, dead);
+  EXPECT_EQ(3, live); // s3 still errors on bytes past 3
+  EXPECT_EQ(1, dead);
   EXPECT_TRUE(dfa[0].deadEnd_);
 }
+
+
+TEST(Minimizer, refine) {
+  // s4 can never accept, so it's the same as the error state
+  DfaObj dfa;
+  /* s0 = */ mkState(dfa, 0);
+  DfaId s1 = mkState(dfa, 0);
+  DfaId s2 = mkState(dfa, 0);
+  DfaId s3 = mkState(dfa, 0);
+  DfaId s4 = mkState(dfa, 0);
+  DfaId s5 = mkState(dfa, 1);
+  addTrans(dfa, s1, s2, 'a');
+  addTrans(dfa, s1, s3, 'b');
+  addTrans(dfa, s1, s4, 'c');
+  addTrans(dfa, s2, s5, 'x');
+  addTrans(dfa, s3, s5, 'x');
+  addTrans(dfa, s4, s4, 'x');
+  {
+    RefineMinimizer rm(dfa);
+    rm.minimize();
+  }
+  EXPECT_EQ(4, dfa.numStates());
+  EXPECT_EQ(0, dfa.matchFull(""));
+  EXPECT_EQ(1, dfa.matchFull("ax"));
+  EXPECT_EQ(1, dfa.matchFull("bx"));
+  EXPECT_EQ(0, dfa.matchFull("cx"));
+  EXPECT_EQ(0, dfa.matchFull("axx"));
+  EXPECT_TRUE(dfa[0].deadEnd_);
+}
+
+
+TEST(Minimizer, refineSame) {
+  Parser p;
+  p.add("(a|b)*a(a|b){5}", 1, 0);
+  p.add("[a-c]*c[0-9]+", 2, fLooseStart);
+  p.add("x.*y.*z", 3, fLooseEnd);
+  p.add("abc|abd|xbc|xbd", 4, 0);
+  p.finish();
+
+  DfaObj gries;
+  DfaObj refine;
+  {
+    PowersetConverter psc(p.getNfa());
+    gries = psc.convert();
+  }
+  {
+    PowersetConverter psc(p.getNfa());
+    refine = psc.convert();
+  }
+  size_t orig = gries.numStates();
+  {
+    DfaMinimizer dm(gries);
+    dm.minimize();
+  }
+  {
+    RefineMinimizer rm(refine);
+    rm.minimize();
+  }
+  EXPECT_GT(orig, refine.numStates());
+  EXPECT_EQ(gries.numStates(), refine.numStates());
+  for (const char *str : {"", "ababbb", "aabbbb", "cc7", "abcc01", "xyz",
+                          "x--y--z--", "abd", "xbc", "xbe", "bbbbbabbbbb"})
+    EXPECT_EQ(gries.matchFull(str), refine.matchFull(str)) << str;
+
+  Parser p2;
+  p2.add("[0-9]+", 1, 0);
+  p2.add("[a-z]+[0-9]", 2, fLooseStart);
+  Executable exec = compile(p2, fmtDirectAuto,
+                            cfRefine | cfUnanchored | cfReverse);
+  EXPECT_EQ(1, check(exec, "12345", styFull));
+  EXPECT_EQ(2, check(exec, "--ab7", styFull));
+  EXPECT_EQ(0, check(exec, "--ab", styFull));
+}
+
+
+TEST(Minimizer, mixedSame) {
+  // loose and anchored patterns with several results, checked against
+  // the unminimized dfa
+  const vector<const char *> pool = {
+    "[0-9]+x", "[a-f]+x", ".*ad", ".*cd", "a(a)*d{1,2}", "c*d", "ab|cd",
+    "x+y", "[^a]", "b.?", "(a|b)*c",
+  };
+  const vector<Flags> flags = {
+    0, fLooseStart, fLooseEnd, fLooseStart | fLooseEnd,
+  };
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+  std::uniform_int_distribution<size_t> pickFlags(0, flags.size() - 1);
+  std::uniform_int_distribution<int> pickChar(0, 6);
+  const char alpha[] = "abcdfxy09";
+  vector<string> texts;
+  for (int ii = 0; ii < 100; ++ii) {
+    string s;
+    for (int jj = pickChar(gen); jj >= 0; --jj)
+      s.push_back(alpha[pickChar(gen)]);
+    texts.push_back(s);
+  }
+
+  for (int round = 0; round < 40; ++round) {
+    Parser p;
+    for (Result res = 1; res <= 5; ++res)
+      p.add(pool[pick(gen)], res, flags[pickFlags(gen)]);
+    p.finish();
+
+    auto convert = [&p]() {
+      PowersetConverter psc(p.getNfa());
+      return psc.convert();
+    };
+    DfaObj orig = convert();
+    DfaObj gries = convert();
+    DfaObj refine = convert();
+    {
+      DfaMinimizer dm(gries);
+      dm.minimize();
+    }
+    {
+      RefineMinimizer rm(refine);
+      rm.minimize();
+    }
+    EXPECT_EQ(gries.numStates(), refine.numStates()) << round;
+    for (const string &s : texts) {
+      Result want = orig.matchFull(s);
+      EXPECT_EQ(want, gries.matchFull(s)) << round << ' ' << s;
+      EXPECT_EQ(want, refine.matchFull(s)) << round << ' ' << s;
+    }
+  }
+}
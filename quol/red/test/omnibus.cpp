@@ -552,4 +552,5 @@ TEST_P(OmnibusFmt, matcher) {
 
 INSTANTIATE_TEST_SUITE_P(A, OmnibusFmt, Combine(
   ValuesIn(testRecs),
-  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4)));
+  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4, fmtDirect8,
+         fmtFlat2, fmtFlat4, fmtComb4)));
@@ -0,0 +1,96 @@
+// unit tests for multi-threaded matching
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Parallel.h"
+#include "Parser.h"
+#include "Compile.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+Executable build(const vector<string> &regexes, Flags flags) {
+  Parser p;
+  Result res = 0;
+  for (const string &re : regexes)
+    p.add(re, ++res, flags);
+  return compile(p);
+}
+
+
+string randomText(std::mt19937 &gen, const char *alpha, size_t len) {
+  size_t num = strlen(alpha);
+  std::uniform_int_distribution<size_t> dist(0, num - 1);
+  string rv;
+  for (size_t ii = 0; ii < len; ++ii)
+    rv.push_back(alpha[dist(gen)]);
+  return rv;
+}
+
+} // anonymous
+
+TEST(Parallel, serial) {
+  Executable rex = build({"a.*z"}, 0);
+  string s = "abcz";
+  EXPECT_EQ(1, checkParallel(rex, s, styFull));
+  EXPECT_EQ(1, checkParallel(rex, s, styLast, 4, 1 << 20));
+  EXPECT_EQ(1, checkParallel(rex, s, styInstant, 4, 1));
+  EXPECT_EQ(0, checkParallel(rex, "", styFull, 4, 1));
+  vector<Outcome> out;
+  EXPECT_EQ(1U, matchAllParallel(rex, s, out));
+  EXPECT_EQ((Outcome{1, 0, 4}), out[0]);
+}
+
+
+TEST(Parallel, check) {
+  vector<Executable> progs;
+  progs.push_back(build({"a.*z"}, 0));
+  progs.push_back(build({"(ab|ba)*", "[a-c]*z"}, 0)); // small dfa
+  progs.push_back(build({"abc", "bca", "zz", "c[ab]c"}, fLooseStart));
+  progs.push_back(build({"[ab]*c[ab][ab][ab][ab][ab][ab]"}, 0)); // many states
+  progs.push_back(build({"a[abz]*", "b[ab]*c[abc]{5}z"}, fLooseEnd));
+
+  std::mt19937 gen(3);
+  for (const Executable &rex : progs)
+    for (int ii = 0; ii < 40; ++ii) {
+      string s = randomText(gen, (ii & 1) ? "abcz" : "ab", 50 + 37 * ii);
+      if (ii % 5 == 0)
+        s = "a" + s + "z";
+      for (Style sty : {styFull, styLast})
+        for (unsigned threads : {2, 3, 7}) {
+          ASSERT_EQ(check(rex, s, sty),
+                    checkParallel(rex, s, sty, threads, 16))
+            << s << ' ' << sty << ' ' << threads;
+        }
+    }
+}
+
+
+TEST(Parallel, matchAll) {
+  vector<Executable> progs;
+  progs.push_back(build({"a+", "b+", "ab"}, fLooseStart));
+  progs.push_back(build({"abc", "bc", "cz*"}, fLooseStart));
+  progs.push_back(build({"[ab]*c[ab][ab][ab][ab][ab][ab]"}, fLooseStart));
+  progs.push_back(build({"a[abc]*"}, 0));
+
+  std::mt19937 gen(4);
+  for (const Executable &rex : progs)
+    for (int ii = 0; ii < 40; ++ii) {
+      string s = randomText(gen, (ii & 1) ? "abcz" : "abc", 40 + 29 * ii);
+      vector<Outcome> want;
+      matchAll(rex, s, want);
+      for (unsigned threads : {2, 3, 7}) {
+        vector<Outcome> got;
+        EXPECT_EQ(want.size(), matchAllParallel(rex, s, got, threads, 8));
+        ASSERT_EQ(want, got) << s << ' ' << threads;
+      }
+    }
+}
@@ -16,13 +16,7 @@ TEST(Parser, smoke) {
   NfaObj &nfa = p.getNfa();
   EXPECT_NE(gNfaNullId, nfa.getInitial());
   EXPECT_EQ(toString(nfa),
-            R"raw(1 NfaState -> 0
-  3 <- a
-  15 <- ^@-$ff
-  17 <- ^@-$ff
-  19 <- Mm
-
-3 NfaState -> 0
+            R"raw(3 NfaState -> 0
   7 <- l
   7 <- e
   13 <- l
@@ -46,52 +40,58 @@ TEST(Parser, smoke) {
 14 NfaState -> 1
 
 15 NfaState -> 0
-  15 <- ^@-$ff
-  17 <- ^@-$ff
-  19 <- Mm
+  3 <- a
+  16 <- ^@-$ff
+  18 <- ^@-$ff
+  20 <- Mm
 
-17 NfaState -> 0
-  19 <- Mm
+16 NfaState -> 0
+  16 <- ^@-$ff
+  18 <- ^@-$ff
+  20 <- Mm
 
-19 NfaState -> 0
-  21 <- Ee
+18 NfaState -> 0
+  20 <- Mm
 
-21 NfaState -> 0
-  23 <- Yy
+20 NfaState -> 0
+  22 <- Ee
 
-23 NfaState -> 0
-  25 <- Ee
+22 NfaState -> 0
+  24 <- Yy
 
-25 NfaState -> 0
-  27 <- Rr
-  37 <- Rr
-  39 <- Rr
+24 NfaState -> 0
+  26 <- Ee
 
-27 NfaState -> 0
-  29 <- Mm
+26 NfaState -> 0
+  28 <- Rr
+  38 <- Rr
+  40 <- Rr
 
-29 NfaState -> 0
-  31 <- Ee
+28 NfaState -> 0
+  30 <- Mm
 
-31 NfaState -> 0
-  33 <- Yy
+30 NfaState -> 0
+  32 <- Ee
 
-33 NfaState -> 0
-  35 <- Ee
+32 NfaState -> 0
+  34 <- Yy
 
-35 NfaState -> 0
-  27 <- Rr
-  37 <- Rr
-  39 <- Rr
+34 NfaState -> 0
+  36 <- Ee
 
-37 NfaState -> 0
-  37 <- ^@-$ff
-  39 <- ^@-$ff
+36 NfaState -> 0
+  28 <- Rr
+  38 <- Rr
+  40 <- Rr
 
-39 NfaState -> 0
-  40 <- [2]
+38 NfaState -> 0
+  38 <- ^@-$ff
+  40 <- ^@-$ff
 
-40 NfaState -> 2
+40 NfaState -> 0
+  41 <- [2]
+
+41 NfaState -> 2
 
 )raw");
 }
@@ -105,9 +105,53 @@ TEST(Parser, statebudget) {
 }
 
 
+TEST(Parser, exactBudget) {
+  Budget b;
+  b.initStates(10);
+  {
+    Parser p(&b);
+    p.addExact("abc", 1, 0); // held back, but still charged
+    EXPECT_TRUE(p.exactOnly());
+    EXPECT_THROW(p.addExact("defgh", 2, 0), RedExceptLimit);
+  }
+  {
+    Parser p(&b); // the first one gave its states back
+    p.addExact("defgh", 2, 0);
+    p.finish();
+    EXPECT_FALSE(p.exactOnly());
+  }
+}
+
+
 TEST(Parser, parenbudget) {
   Budget b;
   b.initParens(2);
   Parser p(&b);
   EXPECT_THROW(p.add("a(b(c(d)))", 1, 0), RedExceptLimit);
 }
+
+
+TEST(Parser, requiredLiteral) {
+  auto required = [](const char *re, Flags flags) {
+    Parser p;
+    p.add(re, 1, flags);
+    p.finish();
+    return p.getNfa().requiredLiteral();
+  };
+  EXPECT_EQ("Failed password for",
+            required("sshd.*Failed password for", fLooseStart | fLooseEnd));
+  EXPECT_EQ("Failed password for", required("sshd.*Failed password for", 0));
+  EXPECT_EQ("sshd", required("sshd", fLooseStart)); // not at start
+  EXPECT_EQ("", required("sshd", 0)); // that's the leader
+  EXPECT_EQ("xyz", required("a(b|c)xyz", 0));
+  EXPECT_EQ("bd", required("a+b*c?bd+", 0));
+  EXPECT_EQ("", required("ab|cd", fLooseStart));
+  EXPECT_EQ("", required("a(xyz)?", 0)); // optional
+  EXPECT_EQ("", required("a.*X", fIgnoreCase)); // two-byte classes
+
+  Parser p; // one regex among many isn't required
+  p.add("foo.*barbaz", 1, 0);
+  p.add("qux", 2, 0);
+  p.finish();
+  EXPECT_EQ("", p.getNfa().requiredLiteral());
+}
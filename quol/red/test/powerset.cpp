@@ -2,14 +2,19 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
 #include <vector>
 
 #include "Util.h"
+#include "Parser.h"
 #include "Powerset.h"
+#include "Compile.h"
+#include "Matcher.h"
 #include "Debug.h" // FIXME
 
 using namespace zezax::red;
 
+using std::string;
 using std::vector;
 
 namespace {
@@ -136,20 +141,13 @@ TEST(Powerset, stepwise) {
   EXPECT_TRUE(contains(v, nis1));
   EXPECT_TRUE(contains(v, nis12));
 
-  NfaIdToCount counts = countAcceptingStates(tbl, nfa);
-  EXPECT_EQ(1, counts.size());
-  ASSERT_TRUE(counts.contains(s3));
-  EXPECT_EQ(1, counts[s3]);
-
   DfaObj dfa;
   DfaId id = dfa.newState();
   EXPECT_EQ(gDfaErrorId, id);
-  {
-    NfaStatesToId map;
-    id = dfaFromNfaRecurse(chars, tbl, counts, nis1, map, nfa, dfa);
-  }
+  id = dfaFromTable(chars, tbl, s1, nfa, dfa);
   EXPECT_EQ(gDfaInitialId, id);
   EXPECT_EQ(4, dfa.numStates());
+  EXPECT_TRUE(tbl.empty()); // rows are released as they're used
   //      +---+     +---+
   //      | b |     | a |
   //      v   | a   v   | b
@@ -157,6 +155,55 @@ TEST(Powerset, stepwise) {
 }
 
 
+TEST(Powerset, notBasis) {
+  // S1 -a,b-> S2 -b-> S3 accept
+  NfaObj nfa;
+  NfaId s1 = nfa.newState(0);
+  NfaId s2 = nfa.newState(0);
+  NfaId s3 = nfa.newState(1);
+  addTrans(nfa, s1, s2, 'a');
+  nfa[s1].transitions_.back().multiChar_.insert('b');
+  addTrans(nfa, s2, s3, 'b');
+  nfa.setInitial(s1);
+
+  MultiChar a;
+  a.insert('a');
+  MultiChar b;
+  b.insert('b');
+  MultiChar ab = a;
+  ab.insert('b');
+  vector<MultiChar> overlap = {ab, b};
+  EXPECT_THROW(makeTable(s1, nfa, overlap), RedExceptCompile);
+  vector<MultiChar> coarse = {ab};
+  EXPECT_THROW(makeTable(s1, nfa, coarse), RedExceptCompile);
+  vector<MultiChar> exact = {a, b};
+  EXPECT_EQ(3, makeTable(s1, nfa, exact).size());
+}
+
+
+TEST(Powerset, unreachedSplits) {
+  // case folding leaves states the basis isn't built from
+  struct Case {
+    const char *regex_;
+    Flags       flags_;
+    const char *yes_;
+    const char *no_;
+  };
+  for (const Case &cs : {Case{"ab|cd", fIgnoreCase, "cD", "ad"},
+                         Case{"a|bc", fIgnoreCase, "Bc", "ac"},
+                         Case{"a+.*|b[ab]+", 0, "bab", "b"}})
+    for (unsigned threads : {1U, 2U}) {
+      Parser p;
+      p.add(cs.regex_, 1, cs.flags_);
+      p.setThreads(threads);
+      Executable exec;
+      ASSERT_NO_THROW(exec = compile(p)) << cs.regex_ << ' ' << threads;
+      EXPECT_EQ(1, check(exec, cs.yes_, styFull)) << cs.regex_;
+      EXPECT_EQ(0, check(exec, cs.no_, styFull)) << cs.regex_;
+    }
+}
+
+
 TEST(Powerset, convert) {
   // +---+
   // |a,b|
@@ -189,3 +236,104 @@ TEST(Powerset, convert) {
   //      v   | a   v   | b
   // S0   S1 -+---> S2 -+---> S3 -+---> S4 accept
 }
+
+
+TEST(Powerset, deep) {
+  // one DFA state per repetition, which once meant a stack frame each
+  for (unsigned threads : {1U, 2U}) {
+    Parser p;
+    p.add("a{5000}", 1, 0);
+    p.finish();
+    PowersetConverter psc(p.getNfa(), nullptr, nullptr, threads);
+    DfaObj dfa = psc.convert();
+    EXPECT_EQ(5003, dfa.numStates()) << threads; // 5001 prefixes, error, end
+    EXPECT_EQ(1, dfa.matchFull(string(5000, 'a'))) << threads;
+    EXPECT_EQ(0, dfa.matchFull(string(4999, 'a'))) << threads;
+  }
+}
+
+
+TEST(Powerset, threads) {
+  Parser p;
+  p.add("(a|b)*a(a|b){6}", 1, 0);
+  p.add("[a-c]*c[0-9]+", 2, fLooseStart);
+  p.add("x.*y.*z", 3, fLooseEnd);
+  p.finish();
+  const NfaObj &nfa = p.getNfa();
+  NfaId initial = nfa.getInitial();
+  MultiCharSet basis = basisMultiChars(nfa.allMultiChars(initial));
+  vector<MultiChar> chars(basis.begin(), basis.end());
+
+  NfaStatesToTransitions want = makeTable(initial, nfa, chars);
+  EXPECT_LT(100U, want.size());
+  for (unsigned threads : {0U, 2U, 5U}) {
+    NfaStatesToTransitions got = makeTable(initial, nfa, chars, threads);
+    ASSERT_EQ(want.size(), got.size()) << threads;
+    for (const auto &[nis, row] : want) {
+      auto it = got.find(nis);
+      ASSERT_NE(got.end(), it) << threads;
+      EXPECT_EQ(row, it->second) << threads;
+    }
+  }
+
+  DfaObj serial;
+  DfaObj parallel;
+  {
+    PowersetConverter psc(nfa);
+    serial = psc.convert();
+  }
+  {
+    PowersetConverter psc(nfa, nullptr, nullptr, 4);
+    parallel = psc.convert();
+  }
+  EXPECT_EQ(toString(serial), toString(parallel));
+}
+
+
+TEST(Powerset, compileThreads) {
+  Parser p;
+  p.setThreads(3);
+  EXPECT_EQ(3U, p.getThreads());
+  p.add("[0-9]+", 1, 0);
+  p.add("[a-z]+[0-9]", 2, fLooseStart);
+  Executable exec = compile(p, fmtDirectAuto, cfUnanchored | cfReverse);
+  EXPECT_EQ(1, check(exec, "12345", styFull));
+  EXPECT_EQ(2, check(exec, "--ab7", styFull));
+  EXPECT_EQ(0, check(exec, "--ab", styFull));
+}
+
+
+TEST(Powerset, setStore) {
+  NfaSetStore store;
+  NfaIdSet aa;
+  aa.insert(3);
+  aa.insert(70000);
+  NfaIdSet bb;
+  bb.insert(3);
+  NfaIdSet none;
+
+  auto [ida, novela] = store.intern(aa);
+  EXPECT_EQ(0U, ida);
+  EXPECT_TRUE(novela);
+  auto [idb, novelb] = store.intern(bb);
+  EXPECT_EQ(1U, idb);
+  EXPECT_TRUE(novelb);
+  auto [idn, noveln] = store.intern(none);
+  EXPECT_EQ(2U, idn);
+  EXPECT_TRUE(noveln);
+
+  NfaIdSet again;
+  again.insert(70000);
+  again.insert(3);
+  auto [idx, novelx] = store.intern(again);
+  EXPECT_EQ(ida, idx);
+  EXPECT_FALSE(novelx);
+  EXPECT_EQ(3U, store.size());
+
+  EXPECT_EQ(2, store.end(ida) - store.begin(ida));
+  EXPECT_EQ(3, store.begin(ida)[0]);
+  EXPECT_EQ(70000, store.begin(ida)[1]);
+  EXPECT_EQ(aa, store.get(ida));
+  EXPECT_EQ(bb, store.get(idb));
+  EXPECT_TRUE(store.get(idn).empty());
+}
@@ -0,0 +1,196 @@
+// unit tests for multi-literal prefilter
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Prefilter.h"
+#include "Parser.h"
+#include "Powerset.h"
+#include "Minimizer.h"
+#include "Compile.h"
+#include "Matcher.h"
+#include "TestUtil.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const Byte *slowFind(const vector<string> &lits,
+                     const Byte           *ptr,
+                     const Byte           *end) {
+  size_t width = lits[0].size();
+  for (; ptr + width <= end; ++ptr)
+    for (const string &lit : lits)
+      if (memcmp(ptr, lit.data(), width) == 0)
+        return ptr;
+  return end;
+}
+
+
+vector<string> literalsOf(const char *const *regexes) {
+  Parser p;
+  Result res = 0;
+  for (const char *const *re = regexes; *re; ++re)
+    p.add(*re, ++res, 0);
+  p.finish();
+  DfaObj dfa;
+  {
+    PowersetConverter psc(p.getNfa());
+    dfa = psc.convert();
+  }
+  DfaMinimizer dm(dfa);
+  dm.minimize();
+  vector<string> rv = dfa.prefixLiterals(3, 256);
+  std::sort(rv.begin(), rv.end());
+  return rv;
+}
+
+} // anonymous
+
+TEST(Prefilter, inactive) {
+  Prefilter pf;
+  EXPECT_FALSE(pf.active());
+  Prefilter empty((std::string_view()));
+  EXPECT_FALSE(empty.active());
+  const Byte buf[] = "abc";
+  EXPECT_EQ(buf, pf.find(buf, buf + 3));
+  EXPECT_EQ(buf, pf.find(buf));
+}
+
+
+TEST(Prefilter, encode) {
+  vector<string> lits = {"xyz", "abc", "q\0r"};
+  lits[2] = string("q\0r", 3);
+  string sec = Prefilter::encode(lits);
+  EXPECT_EQ(8U + 9U, sec.size());
+  Prefilter pf(sec);
+  EXPECT_TRUE(pf.active());
+  EXPECT_EQ(3U, pf.width());
+  EXPECT_EQ(3U, pf.size());
+
+  EXPECT_THROW(Prefilter::encode(vector<string>()), RedExcept);
+  EXPECT_THROW(Prefilter::encode({"ab", "abc"}), RedExcept);
+  EXPECT_THROW(Prefilter::encode({"abcd"}), RedExcept);
+  EXPECT_THROW(Prefilter(sec.substr(0, 5)), RedExcept);
+  EXPECT_THROW(Prefilter(sec.substr(0, 12)), RedExcept);
+  string bad = sec;
+  bad[0] = 9; // width
+  EXPECT_THROW(Prefilter{bad}, RedExcept);
+}
+
+
+TEST(Prefilter, random) {
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<int> small(0, 7);
+  std::uniform_int_distribution<int> dist(0, 255);
+  string buf;
+  for (int ii = 0; ii < 4000; ++ii)
+    buf.push_back(static_cast<char>('a' + small(gen)));
+  const Byte *beg = reinterpret_cast<const Byte *>(buf.data());
+  const Byte *end = beg + buf.size();
+
+  for (size_t width : {1, 2, 3})
+    for (size_t count : {1, 2, 5, 9, 40, 200}) {
+      vector<string> lits;
+      while (lits.size() < count) {
+        string lit;
+        for (size_t jj = 0; jj < width; ++jj) // mostly plausible bytes
+          lit.push_back(static_cast<char>((dist(gen) < 32) ? dist(gen)
+                                                           : 'a' + small(gen)));
+        if (std::find(lits.begin(), lits.end(), lit) == lits.end())
+          lits.push_back(lit);
+        if ((width == 1) && (lits.size() >= 8))
+          break;
+      }
+      Prefilter pf(Prefilter::encode(lits));
+      for (const Byte *ptr = beg; ptr < end; ) {
+        const Byte *want = slowFind(lits, ptr, end);
+        ASSERT_EQ(want, pf.find(ptr, end)) << width << ' ' << count;
+        ASSERT_EQ(want, pf.find(ptr)) << width << ' ' << count;
+        ptr = want + 1;
+      }
+      for (size_t off = 0; off < 40; ++off) { // exercise short tails
+        const Byte *stop = beg + 40;
+        ASSERT_EQ(slowFind(lits, beg + off, stop),
+                  pf.find(beg + off, stop));
+      }
+    }
+}
+
+
+TEST(Prefilter, literals) {
+  const char *set1[] = {"abc", "xyz1", "qq[0-9]", nullptr};
+  vector<string> lits = literalsOf(set1);
+  ASSERT_EQ(12U, lits.size());
+  EXPECT_EQ("abc", lits[0]);
+  EXPECT_EQ("qq0", lits[1]);
+  EXPECT_EQ("xyz", lits[11]);
+
+  const char *set2[] = {"ab", "xyz", nullptr}; // shortest match limits width
+  lits = literalsOf(set2);
+  ASSERT_EQ(2U, lits.size());
+  EXPECT_EQ("ab", lits[0]);
+  EXPECT_EQ("xy", lits[1]);
+
+  const char *set3[] = {"a", "xyz", nullptr}; // too short to bother
+  EXPECT_TRUE(literalsOf(set3).empty());
+
+  const char *set4[] = {".*foo", nullptr}; // loose start, too many
+  EXPECT_TRUE(literalsOf(set4).empty());
+
+  const char *set5[] = {"[a-c][a-z][a-z]x", nullptr}; // too many at three
+  lits = literalsOf(set5);
+  ASSERT_EQ(3U * 26U, lits.size());
+  EXPECT_EQ("aa", lits[0]);
+}
+
+
+TEST(Prefilter, search) {
+  Executable rex;
+  {
+    Parser p;
+    p.add("error [0-9]+", 1, 0);
+    p.add("warn(ing)?", 2, 0);
+    p.add("fatal", 3, 0);
+    p.add("panic: .*", 4, 0);
+    rex = compile(p);
+  }
+  EXPECT_EQ(0, rex.getLeaderLen());
+  ASSERT_TRUE(rex.getPrefilter().active());
+  EXPECT_EQ(3U, rex.getPrefilter().width());
+  EXPECT_EQ(4U, rex.getPrefilter().size());
+  Executable plain = stripped(rex);
+  EXPECT_FALSE(plain.getPrefilter().active());
+
+  vector<string> texts = {
+    "", "e", "err", "nothing to see here",
+    string(300, 'w') + "warning",
+    string(300, 'e') + "error 42 and more",
+    "this is fatal, then panic: now",
+    "warn", "war", "eror 1 error x error 7",
+  };
+  for (const string &s : texts)
+    for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+      Outcome want = search(plain, s, sty);
+      Outcome got = search(rex, s, sty);
+      EXPECT_EQ(want.result_, got.result_) << s << ' ' << sty;
+      EXPECT_EQ(want.start_, got.start_) << s << ' ' << sty;
+      EXPECT_EQ(want.end_, got.end_) << s << ' ' << sty;
+      got = search(rex, s.c_str(), sty);
+      EXPECT_EQ(want.result_, got.result_) << s << ' ' << sty;
+      EXPECT_EQ(want.end_, got.end_) << s << ' ' << sty;
+      EXPECT_EQ(scan(plain, s, sty), scan(rex, s, sty)) << s << ' ' << sty;
+      string outWant, outGot;
+      EXPECT_EQ(replace(plain, s, "#", outWant, 99, sty),
+                replace(rex, s, "#", outGot, 99, sty));
+      EXPECT_EQ(outWant, outGot) << s << ' ' << sty;
+    }
+}
@@ -0,0 +1,143 @@
+// unit tests for profiling state visits
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Parser.h"
+#include "Powerset.h"
+#include "Minimizer.h"
+#include "Serializer.h"
+#include "Compile.h"
+#include "Matcher.h"
+#include "Profile.h"
+#include "Proxy.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+DfaObj build(const vector<string> &regexes) {
+  Parser p;
+  Result res = 0;
+  for (const string &re : regexes)
+    p.add(re, ++res, 0);
+  p.finish();
+  DfaObj dfa;
+  {
+    PowersetConverter psc(p.getNfa());
+    dfa = psc.convert();
+  }
+  DfaMinimizer dm(dfa);
+  dm.minimize();
+  return dfa;
+}
+
+
+size_t stateSize(Format fmt, CharIdx maxChar) {
+  switch (fmt) {
+  case fmtDirect1:
+    return DfaProxy<fmtDirect1>::stateSize(maxChar);
+  case fmtDirect2:
+    return DfaProxy<fmtDirect2>::stateSize(maxChar);
+  case fmtFlat4:
+    return DfaProxy<fmtFlat4>::stateSize(maxChar);
+  case fmtComb4:
+    return DfaProxy<fmtComb4>::stateSize(maxChar);
+  default:
+    ADD_FAILURE() << "untested format " << fmt;
+    return 1;
+  }
+}
+
+
+uint64_t total(const vector<uint64_t> &visits) {
+  uint64_t rv = 0;
+  for (uint64_t vv : visits)
+    rv += vv;
+  return rv;
+}
+
+} // anonymous
+
+TEST(Profiler, counts) {
+  DfaObj dfa = build({"abc", "abd"});
+  Serializer ser(dfa);
+  Executable exec(ser.serializeToString(fmtDirect1));
+  Profiler prof(exec);
+  EXPECT_EQ(exec.getHeader()->stateCnt_, prof.visits().size());
+  EXPECT_EQ(0U, total(prof.visits()));
+
+  prof.run("");
+  EXPECT_EQ(1U, total(prof.visits())); // just the initial state
+  prof.run("abc");
+  EXPECT_EQ(5U, total(prof.visits()));
+  prof.run("xbcdef"); // stops upon reaching the error state
+  EXPECT_EQ(7U, total(prof.visits()));
+
+  size_t init = exec.getHeader()->initialOff_ /
+    DfaProxy<fmtDirect1>::stateSize(exec.getHeader()->maxChar_);
+  EXPECT_EQ(3U, prof.visits()[init]);
+}
+
+
+TEST(Profiler, reorder) {
+  // many plain states, of which the corpus only wanders a few
+  DfaObj dfa = build({"[a-h]*x[a-h][a-h][a-h][a-h]y", "h[gh]*z"});
+  vector<string> corpus;
+  for (int ii = 0; ii < 50; ++ii)
+    corpus.push_back("hghghhhhgggz" + string(static_cast<size_t>(ii), 'g'));
+  corpus.push_back("abcxabcdy");
+
+  for (Format fmt : {fmtDirect1, fmtDirect2, fmtFlat4, fmtComb4}) {
+    Serializer ser(dfa);
+    Executable plain(ser.serializeToString(fmt));
+    EXPECT_THROW(ser.setVisits(vector<uint64_t>(3, 0)), RedExcept);
+    Profiler before(plain);
+    for (const string &text : corpus)
+      before.run(text);
+    ser.setVisits(before.visits());
+    Executable hot(ser.serializeToString(fmt));
+
+    Profiler after(hot);
+    for (const string &text : corpus)
+      after.run(text);
+    const vector<uint64_t> &vv = after.visits();
+    EXPECT_EQ(total(before.visits()), total(vv));
+
+    // special states, then plain ones, each hottest first
+    const FileHeader *hdr = hot.getHeader();
+    size_t firstPlain = hdr->plainOff_ / stateSize(fmt, hdr->maxChar_);
+    EXPECT_LT(firstPlain, vv.size());
+    for (size_t ii = 1; ii < vv.size(); ++ii) {
+      if (ii != firstPlain) {
+        EXPECT_GE(vv[ii - 1], vv[ii]) << fmt << ' ' << ii;
+      }
+    }
+
+    for (const string &text : corpus)
+      EXPECT_EQ(check(plain, text, styFull), check(hot, text, styFull))
+        << text;
+  }
+}
+
+
+TEST(Profiler, compile) {
+  vector<string> corpus = {"foo", "fooo", "bar", "xfooy", "qux"};
+  Parser p1;
+  Parser p2;
+  p1.add("fo+", 1, fLooseStart);
+  p1.add("[a-r]+", 2, 0);
+  p2.add("fo+", 1, fLooseStart);
+  p2.add("[a-r]+", 2, 0);
+  Executable plain = compile(p1);
+  Executable hot = compile(p2, corpus, fmtDirectAuto, cfUnanchored);
+  EXPECT_NE(nullptr, hot.getUnanchored());
+  for (const string &text : corpus)
+    for (Style sty : {styInstant, styFirst, styLast, styFull})
+      EXPECT_EQ(check(plain, text, sty), check(hot, text, sty)) << text;
+}
@@ -120,6 +120,19 @@ TEST(Red, save) {
     Red r1(gPathTag, fn.c_str());
     EXPECT_TRUE(r1.matchFull("abbbc"));
     EXPECT_FALSE(r1.matchFull("abe"));
+
+    // saving over the mapped file leaves the mapping intact
+    Red r2("x[0-9]+y");
+    r2.save(fn.c_str());
+    EXPECT_TRUE(r1.matchFull("abbbc"));
+    r1.save(fn.c_str());
+    EXPECT_TRUE(r1.matchFull("abbbc"));
+    Red r3(gPathTag, fn.c_str());
+    EXPECT_TRUE(r3.matchFull("abc"));
+    r2.save(fn.c_str());
+    EXPECT_TRUE(r3.matchFull("abc"));
+    Red r4(gPathTag, fn.c_str());
+    EXPECT_TRUE(r4.matchFull("x12y"));
   }
   unlink(fn.c_str());
 }
@@ -3,20 +3,110 @@
 #include <gtest/gtest.h>
 
 #include <array>
+#include <random>
 
 #include "Parser.h"
 #include "Powerset.h"
 #include "Minimizer.h"
 #include "Serializer.h"
+#include "Executable.h"
+#include "Proxy.h"
+#include "Compile.h"
+#include "Matcher.h"
+#include "Fnv.h"
+#include "Util.h"
 
 using namespace zezax::red;
 
 using std::string;
+using std::string_view;
 using std::to_string;
 using testing::TestWithParam;
 using testing::Values;
 
 
+namespace {
+
+// counts states out of place relative to plainOff_
+template <Format fmt>
+int misplaced(const Executable &exec) {
+  const FileHeader *hdr = exec.getHeader();
+  size_t size = DfaProxy<fmt>::stateSize(hdr->maxChar_);
+  int rv = (hdr->plainOff_ < hdr->stateCnt_ * size) ? 0 : 1; // some plain
+  for (size_t off = 0; off < hdr->stateCnt_ * size; off += size) {
+    DfaProxy<fmt> dfap;
+    dfap.init(exec.getBase(), off);
+    bool special = ((dfap.result() > 0) || dfap.deadEnd() || dfap.accel() ||
+                    (off == hdr->initialOff_));
+    if (special != (off < hdr->plainOff_))
+      ++rv;
+  }
+  return rv;
+}
+
+
+// rewrites a current buffer in the version 1.4 layout, standing in for
+// one saved back then: 32-bit header fields and accel offsets, FNV-1a
+string toVersion14(string_view buf) {
+  const FileHeader *hdr = reinterpret_cast<const FileHeader *>(buf.data());
+  string rv;
+  auto put = [&rv](auto val) {
+    rv.append(reinterpret_cast<const char *>(&val), sizeof(val));
+  };
+  auto pad = [&rv]() { rv.resize((rv.size() + 7) & ~7UL, '\0'); };
+  rv.append("REDA", 4);
+  put(uint16_t{1});
+  put(uint16_t{4});
+  put(uint32_t{0}); // checksum, last
+  rv.append(reinterpret_cast<const char *>(&hdr->format_), 4);
+  put(static_cast<uint32_t>(hdr->stateCnt_));
+  put(static_cast<uint32_t>(hdr->initialOff_));
+  put(static_cast<uint32_t>(hdr->leaderOff_));
+  put(uint32_t{0}); // sectionOff_, filled in below
+  put(static_cast<uint32_t>(hdr->plainOff_));
+  put(uint32_t{0});
+  rv.append(reinterpret_cast<const char *>(hdr->equivMap_), 256);
+  rv.append(reinterpret_cast<const char *>(hdr->startSet_), 32);
+  size_t off = hdr->sectionOff_ ? hdr->sectionOff_ : buf.size();
+  rv.append(buf.substr(sizeof(FileHeader), off - sizeof(FileHeader)));
+
+  uint32_t first = 0;
+  while (off < buf.size()) {
+    SectionHeader sec;
+    memcpy(&sec, buf.data() + off, sizeof(sec));
+    string_view sub = buf.substr(off + sizeof(sec), sec.len_);
+    off += (sizeof(sec) + sec.len_ + 7) & ~7UL;
+    string part;
+    if (sec.kind_ == secAccel)
+      for (size_t ii = 0; ii < sub.size(); ii += Accelerator::recordLen_) {
+        uint64_t state;
+        memcpy(&state, sub.data() + ii, sizeof(state));
+        uint32_t narrow = static_cast<uint32_t>(state);
+        part.append(reinterpret_cast<const char *>(&narrow), sizeof(narrow));
+        part.append(sub.substr(ii + sizeof(state), 32));
+      }
+    else if ((sec.kind_ == secPrefilter) || (sec.kind_ == secRequired))
+      part = sub;
+    else
+      part = toVersion14(sub);
+    pad();
+    if (first == 0) {
+      first = static_cast<uint32_t>(rv.size());
+      memcpy(rv.data() + 28, &first, sizeof(first)); // sectionOff_
+    }
+    sec.len_ = part.size();
+    put(sec);
+    rv.append(part);
+    pad();
+  }
+
+  uint32_t sum = fnv1a<uint32_t>(rv.data() + 12, rv.size() - 12);
+  memcpy(rv.data() + 8, &sum, sizeof(sum));
+  return rv;
+}
+
+} // anonymous
+
 TEST(Serializer, header) {
   std::array<char, 1024> buf;
   buf.fill(0);
@@ -24,6 +114,179 @@ TEST(Serializer, header) {
 }
 
 
+TEST(Serializer, checksum) {
+  Parser p;
+  p.add("ab*c", 1, 0);
+  string buf = compileToSerialized(p, fmtDirectAuto, cfUnanchored);
+  EXPECT_EQ(nullptr, checkHeader(buf.data(), buf.size()));
+
+  // a corrupt byte in a section is caught, unless the checksum is skipped
+  buf.back() ^= 1;
+  EXPECT_STREQ("serialized DFA: checksum mismatch",
+               checkHeader(buf.data(), buf.size()));
+  EXPECT_EQ(nullptr, checkHeader(buf.data(), buf.size(), false));
+  EXPECT_NE(nullptr, checkChecksum(buf.data(), buf.size()));
+  buf.back() ^= 1;
+
+  // version 2.0 used fnv-1a
+  FileHeader *hdr = reinterpret_cast<FileHeader *>(buf.data());
+  uint32_t crc = hdr->checksum_;
+  hdr->minVer_ = 0;
+  EXPECT_NE(nullptr, checkHeader(buf.data(), buf.size()));
+  hdr->checksum_ = calcChecksum(buf.data(), buf.size());
+  EXPECT_NE(crc, hdr->checksum_);
+  EXPECT_EQ(nullptr, checkHeader(buf.data(), buf.size()));
+  hdr->minVer_ = gFileMinVer + 1;
+  EXPECT_STREQ("Serialized DFA: unrecognized version",
+               checkHeader(buf.data(), buf.size()));
+}
+
+
+TEST(Serializer, version1) {
+  // "ab*c" returning 100, byte for byte as version 1.0 serialized it;
+  // fmtDirect1 had 7-bit results then, so this one must widen
+  const uint8_t head[] = {
+    'R', 'E', 'D', 'A', 1, 0, 0, 0, 0xbe, 0xa7, 0x41, 0xcd, // checksum
+    1, 3, 1, 0, 4, 0, 0, 0, 5, 0, 0, 0, 15, 0, 0, 0, 0, 0, 0, 0,
+  };
+  const uint8_t body[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, // leader, padded
+    0x80, 0, 0, 0, 0,  0, 15, 0, 0, 0,  100, 0, 0, 0, 0,  0, 0, 15, 10, 0,
+  };
+  string old(reinterpret_cast<const char *>(head), sizeof(head));
+  for (int ii = 0; ii < 256; ++ii)
+    old.push_back(static_cast<char>(((ii >= 'a') && (ii <= 'c')) ?
+                                    (ii - 'a') : 3));
+  old.append(reinterpret_cast<const char *>(body), sizeof(body));
+  EXPECT_STREQ("Serialized DFA: version 1, see upgradeFromV1()",
+               checkHeader(old.data(), old.size()));
+
+  string buf = upgradeFromV1(old);
+  EXPECT_EQ(nullptr, checkHeader(buf.data(), buf.size()));
+  Executable exec(gCopyTag, old);
+  EXPECT_EQ(fmtDirect2, exec.getFormat());
+  EXPECT_EQ(100, check(exec, "abbc", styFull));
+  EXPECT_EQ(100, check(exec, "ac", styFull));
+  EXPECT_EQ(0, check(exec, "ab", styFull));
+  EXPECT_EQ(0, check(exec, "acc", styFull));
+  EXPECT_EQ(0, check(exec, "", styFull));
+  EXPECT_EQ((Outcome{100, 2, 6}), search(exec, "xxabbc", styFirst));
+
+  string fn = "/tmp/reda" + to_string(getpid());
+  writeStringToFile(old, fn.c_str());
+  EXPECT_THROW(Executable(gPathTag, fn.c_str()), RedExceptApi); // in place
+  string loaded = loadFromFile(fn.c_str());
+  unlink(fn.c_str());
+  EXPECT_EQ(buf, loaded);
+
+  old.back() ^= 1;
+  EXPECT_THROW(upgradeFromV1(old), RedExceptApi);
+}
+
+
+TEST(Serializer, resultLimit) {
+  // the top two bits of each result word flag accel and dead ends
+  auto build = [](Result res) {
+    Parser p;
+    p.add("ab*c", res, 0);
+    return compileToDfa(p);
+  };
+  struct { Format fmt_; Result max_; } cases[] = {
+    {fmtDirect1, 0x3f}, {fmtDirect2, 0x3fff}, {fmtFlat2, 0x3fff},
+    {fmtDirect4, 0x3fffffff}, {fmtFlat4, 0x3fffffff}, {fmtComb4, 0x3fffffff},
+  };
+  for (const auto &cs : cases) {
+    DfaObj ok = build(cs.max_);
+    Serializer good(ok);
+    Executable exec(good.serializeToString(cs.fmt_));
+    EXPECT_EQ(cs.max_, check(exec, "abbc", styFull));
+
+    DfaObj big = build(cs.max_ + 1);
+    Serializer bad(big);
+    EXPECT_THROW(bad.serializeToString(cs.fmt_), RedExceptLimit) << cs.fmt_;
+  }
+
+  // auto widens instead
+  DfaObj big = build(0x40);
+  Serializer ser(big);
+  Executable exec(ser.serializeToString(fmtDirectAuto));
+  EXPECT_NE(fmtDirect1, exec.getFormat());
+  EXPECT_EQ(0x40, check(exec, "abbc", styFull));
+}
+
+
+TEST(Serializer, autoFlat) {
+  // few classes: the map is cheaper than a column per byte
+  {
+    Parser p;
+    p.add("ab*c", 1, 0);
+    Executable exec = compile(p);
+    EXPECT_EQ(fmtDirect1, exec.getFormat());
+  }
+
+  // a class per byte: flat rows are hardly bigger
+  Parser p;
+  for (int ch = 1; ch < 200; ++ch) {
+    static const char hex[] = "0123456789abcdef";
+    string esc = "\\x";
+    esc += hex[ch >> 4];
+    esc += hex[ch & 15];
+    p.add(esc + esc, 1, 0);
+  }
+  Executable exec = compile(p);
+  Format fmt = exec.getFormat();
+  EXPECT_TRUE((fmt == fmtFlat2) || (fmt == fmtFlat4)) << static_cast<int>(fmt);
+  EXPECT_EQ(1, check(exec, "\x96\x96", styFull));
+  EXPECT_EQ(0, check(exec, "\x96\x97", styFull));
+}
+
+
+TEST(Serializer, comb) {
+  // a blocklist: wide alphabet, but few live transitions per state
+  const char *words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+    "hotel", "india", "juliet", "kilo", "lima", "mike", "november",
+    "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+    "victor", "whiskey", "xray", "yankee", "zulu", nullptr
+  };
+  Executable full;
+  Executable comb;
+  {
+    Parser p;
+    Parser pc;
+    Result res = 0;
+    for (const char **ww = words; *ww; ++ww) {
+      string re = string(*ww) + "[0-9]?[A-Z][a-z]" + *ww;
+      p.add(re, ++res, 0);
+      pc.add(re, res, 0);
+    }
+    full = compile(p, fmtDirect4);
+    comb = compile(pc, fmtComb4);
+  }
+  EXPECT_EQ(fmtComb4, comb.getFormat());
+  EXPECT_GT(full.serialized().size() / 3, comb.serialized().size());
+
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<int> pick(0, 25);
+  std::uniform_int_distribution<int> dist(0, 9);
+  for (int ii = 0; ii < 300; ++ii) {
+    string word = words[pick(gen)];
+    string s = word;
+    if (dist(gen) > 2)
+      s.push_back(static_cast<char>('0' + dist(gen)));
+    s.push_back(static_cast<char>('A' + pick(gen)));
+    s.push_back(static_cast<char>('a' + pick(gen)));
+    s += (dist(gen) > 3) ? word : words[pick(gen)];
+    if (dist(gen) > 5)
+      s.resize(s.size() - 1);
+    for (Style sty : {styInstant, styFirst, styLast, styFull}) {
+      ASSERT_EQ(check(full, s, sty), check(comb, s, sty)) << s;
+      ASSERT_EQ(search(full, s, sty), search(comb, s, sty)) << s;
+    }
+  }
+}
+
+
 class SerializerTest : public TestWithParam<Format> {};
 
 TEST_P(SerializerTest, smoke) {
@@ -51,6 +314,12 @@ TEST_P(SerializerTest, smoke) {
     }
   }
   EXPECT_EQ(nullptr, checkHeader(buf.data(), buf.size()));
+
+  FileHeader *hdr = reinterpret_cast<FileHeader *>(buf.data());
+  hdr->initialOff_ = uint64_t{1} << 40; // representable, but not in buf
+  hdr->checksum_ = calcChecksum(buf.data(), buf.size());
+  EXPECT_STREQ("Serialized DFA: offset out of range",
+               checkHeader(buf.data(), buf.size()));
 }
 
 
@@ -84,5 +353,85 @@ TEST_P(SerializerTest, file) {
 }
 
 
+TEST_P(SerializerTest, special) {
+  Format fmt = GetParam();
+  string buf;
+  {
+    Parser p;
+    p.addAuto("ab*c", 1, 0);
+    p.addAuto("x[^y]*y[0-9][0-9][0-9]q", 2, 0);
+    p.finish();
+    DfaObj dfa;
+    {
+      PowersetConverter psc(p.getNfa());
+      dfa = psc.convert();
+      p.freeAll();
+    }
+    {
+      DfaMinimizer dm(dfa);
+      dm.minimize();
+    }
+    Serializer ser(dfa);
+    buf = ser.serializeToString(fmt);
+  }
+  Executable exec(std::move(buf));
+  const FileHeader *hdr = exec.getHeader();
+  EXPECT_LT(0U, hdr->plainOff_);
+  switch (exec.getFormat()) {
+  case fmtDirect1:
+    EXPECT_EQ(0, misplaced<fmtDirect1>(exec));
+    break;
+  case fmtDirect2:
+    EXPECT_EQ(0, misplaced<fmtDirect2>(exec));
+    break;
+  case fmtDirect4:
+    EXPECT_EQ(0, misplaced<fmtDirect4>(exec));
+    break;
+  case fmtDirect8:
+    EXPECT_EQ(0, misplaced<fmtDirect8>(exec));
+    break;
+  case fmtFlat2:
+    EXPECT_EQ(0, misplaced<fmtFlat2>(exec));
+    break;
+  case fmtFlat4:
+    EXPECT_EQ(0, misplaced<fmtFlat4>(exec));
+    break;
+  case fmtComb4:
+    EXPECT_EQ(0, misplaced<fmtComb4>(exec));
+    break;
+  default:
+    FAIL();
+  }
+}
+
+
+TEST_P(SerializerTest, version14) {
+  Format fmt = GetParam();
+  Parser p;
+  p.add("ab*c", 1, 0);
+  p.add("x[^y]*y", 2, fLooseStart);
+  p.add("hello", 3, fLooseEnd);
+  string buf = compileToSerialized(p, fmt, cfUnanchored | cfReverse);
+  string old = toVersion14(buf);
+  EXPECT_STREQ("Serialized DFA: version 1, see upgradeFromV1()",
+               checkHeader(old.data(), old.size()));
+  EXPECT_EQ(buf, upgradeFromV1(old));
+
+  Executable now(std::move(buf));
+  Executable then(std::move(old));
+  ASSERT_NE(nullptr, then.getUnanchored());
+  ASSERT_NE(nullptr, then.getReverse());
+  EXPECT_LT(0U, then.getAccel().size());
+  EXPECT_EQ(now.getAccel().size(), then.getAccel().size());
+  for (const char *text : {"abbc", "zzxqqqy", "xyhello there", "ac hello",
+                           "", "xx", "abcxy"})
+    for (Style sty : {styInstant, styFirst, styLast, styFull}) {
+      EXPECT_EQ(check(now, text, sty), check(then, text, sty)) << text;
+      EXPECT_EQ(search(now, text, sty), search(then, text, sty)) << text;
+    }
+}
+
+
 INSTANTIATE_TEST_SUITE_P(A, SerializerTest,
-  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4));
+  Values(fmtDirectAuto, fmtDirect1, fmtDirect2, fmtDirect4, fmtDirect8,
+         fmtFlat2, fmtFlat4, fmtComb4));
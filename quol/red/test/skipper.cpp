@@ -0,0 +1,303 @@
+// unit tests for skipping uninteresting bytes
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Skipper.h"
+#include "Parser.h"
+#include "Compile.h"
+#include "Matcher.h"
+#include "TestUtil.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+void setBit(uint8_t *bitmap, Byte b) {
+  bitmap[b >> 3] = static_cast<uint8_t>(bitmap[b >> 3] | (1u << (b & 7)));
+}
+
+
+const Byte *slowFind(const uint8_t *bitmap, const Byte *ptr, const Byte *end) {
+  for (; ptr < end; ++ptr)
+    if ((bitmap[*ptr >> 3] >> (*ptr & 7)) & 1)
+      break;
+  return ptr;
+}
+
+} // anonymous
+
+TEST(Skipper, inactive) {
+  Skipper sk;
+  EXPECT_FALSE(sk.active());
+  EXPECT_TRUE(sk.contains('x'));
+
+  uint8_t bitmap[32];
+  memset(bitmap, 0xff, sizeof(bitmap));
+  Skipper full(bitmap);
+  EXPECT_FALSE(full.active());
+}
+
+
+TEST(Skipper, empty) {
+  uint8_t bitmap[32];
+  memset(bitmap, 0, sizeof(bitmap));
+  Skipper sk(bitmap);
+  EXPECT_TRUE(sk.active());
+  string s(100, 'a');
+  const Byte *beg = reinterpret_cast<const Byte *>(s.data());
+  EXPECT_EQ(beg + s.size(), sk.find(beg, beg + s.size()));
+  EXPECT_EQ(beg + s.size(), sk.find(beg)); // stops at terminator
+}
+
+
+TEST(Skipper, random) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(0, 255);
+  string buf;
+  for (int ii = 0; ii < 5000; ++ii)
+    buf.push_back(static_cast<char>(dist(gen)));
+  const Byte *beg = reinterpret_cast<const Byte *>(buf.data());
+  const Byte *end = beg + buf.size();
+
+  for (int members : {1, 2, 3, 16, 17, 100, 255}) {
+    uint8_t bitmap[32];
+    memset(bitmap, 0, sizeof(bitmap));
+    for (int ii = 0; ii < members; ++ii)
+      setBit(bitmap, static_cast<Byte>(dist(gen)));
+    Skipper sk(bitmap);
+    EXPECT_TRUE(sk.active());
+    for (const Byte *ptr = beg; ptr < end; ) {
+      const Byte *want = slowFind(bitmap, ptr, end);
+      ASSERT_EQ(want, sk.find(ptr, end)) << members;
+      ptr = want + 1;
+    }
+    for (size_t off = 0; off < 40; ++off) { // exercise short tails
+      const Byte *stop = beg + 40;
+      ASSERT_EQ(slowFind(bitmap, beg + off, stop), sk.find(beg + off, stop));
+    }
+  }
+}
+
+
+TEST(Skipper, search) {
+  Executable rex;
+  {
+    Parser p;
+    p.add("needle[0-9]", 1, 0);
+    rex = compile(p);
+  }
+  EXPECT_TRUE(rex.getSkipper().active());
+  EXPECT_TRUE(rex.getSkipper().contains('n'));
+  EXPECT_FALSE(rex.getSkipper().contains('x'));
+
+  string hay(1000, 'x');
+  hay += "needle";
+  hay += string(1000, 'x');
+  hay += "needle7";
+  Outcome oc = search(rex, hay, styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(2006, oc.start_);
+  EXPECT_EQ(2013, oc.end_);
+  oc = search(rex, hay.c_str(), styLast);
+  EXPECT_EQ(1, oc.result_);
+  EXPECT_EQ(2006, oc.start_);
+  EXPECT_EQ(1, scan(rex, hay, styInstant));
+  EXPECT_EQ(0, scan(rex, string(1000, 'x'), styInstant));
+  string out;
+  EXPECT_EQ(1, replace(rex, hay, "!", out, 9999, styLast));
+  EXPECT_EQ(string(1000, 'x') + "needle" + string(1000, 'x') + "!", out);
+}
+
+
+TEST(LeaderFinder, inactive) {
+  LeaderFinder lf;
+  EXPECT_FALSE(lf.active());
+
+  Byte equivMap[256];
+  memset(equivMap, 1, sizeof(equivMap)); // everything ambiguous
+  Byte leader[2] = {1, 1};
+  LeaderFinder amb(equivMap, leader, sizeof(leader));
+  EXPECT_FALSE(amb.active());
+}
+
+
+TEST(LeaderFinder, random) {
+  Byte equivMap[256];
+  for (unsigned uu = 0; uu < 256; ++uu)
+    equivMap[uu] = 1;
+  equivMap['a'] = 2;
+  equivMap['b'] = 3;
+  equivMap['Q'] = 4;
+  const Byte exact[] = {2, 3, 4};   // "abQ" unambiguously
+  const Byte partial[] = {2, 1, 4}; // "a?Q", only the ends are known
+
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> dist(0, 3);
+  const char alpha[] = "abQx";
+  string buf;
+  for (int ii = 0; ii < 3000; ++ii)
+    buf.push_back(alpha[dist(gen)]);
+  const Byte *beg = reinterpret_cast<const Byte *>(buf.data());
+  const Byte *end = beg + buf.size();
+
+  for (const Byte *leader : {exact, partial}) {
+    LeaderFinder lf(equivMap, leader, 3);
+    EXPECT_TRUE(lf.active());
+    for (const Byte *ptr = beg; ptr < end; ++ptr) {
+      const Byte *got = lf.find(ptr, end);
+      ASSERT_LE(ptr, got);
+      ASSERT_GE(end, got);
+      for (const Byte *pp = ptr; pp < got; ++pp) // nothing skipped over
+        ASSERT_FALSE((pp + 3 <= end) &&
+                     (equivMap[pp[0]] == leader[0]) &&
+                     (equivMap[pp[1]] == leader[1]) &&
+                     (equivMap[pp[2]] == leader[2]));
+      ASSERT_EQ(lf.find(ptr) - beg, got - beg);
+    }
+  }
+}
+
+
+TEST(LeaderFinder, search) {
+  Executable rex;
+  {
+    Parser p;
+    p.add("hello[0-9]+", 1, 0);
+    p.add("hello[a-c]", 2, 0);
+    rex = compile(p);
+  }
+  ASSERT_EQ(5, rex.getLeaderLen());
+  EXPECT_TRUE(rex.getLeaderFinder().active());
+
+  string hay(500, 'h');
+  hay += "hellx hello hello42 hellob";
+  string tail = hay.substr(500);
+  for (const string &s : {hay, tail}) {
+    Outcome with = search<styLast, true>(rex, s);
+    Outcome sans = search<styLast, false>(rex, s);
+    EXPECT_EQ(1, with.result_);
+    EXPECT_EQ(sans.result_, with.result_);
+    EXPECT_EQ(sans.start_, with.start_);
+    EXPECT_EQ(sans.end_, with.end_);
+    with = search<styFirst, true>(rex, s.c_str());
+    sans = search<styFirst, false>(rex, s.c_str());
+    EXPECT_EQ(sans.result_, with.result_);
+    EXPECT_EQ(sans.start_, with.start_);
+    EXPECT_EQ(sans.end_, with.end_);
+    EXPECT_EQ((scan<styLast, false>(rex, s)), (scan<styLast, true>(rex, s)));
+  }
+  EXPECT_EQ(0, (scan<styInstant, true>(rex, hay.substr(0, 505))));
+  string shortHay = hay.substr(0, 505);
+  EXPECT_EQ(0, (search<styInstant, true>(rex, shortHay.c_str()).result_));
+}
+
+
+TEST(LeaderFinder, acceptingLeader) {
+  Executable rex;
+  {
+    Parser p;
+    p.add("needle", 1, 0);
+    rex = compile(p);
+  }
+  string hay = string(100, 'n') + "needle";
+  for (Style sty : {styInstant, styFirst, styTangent, styLast}) {
+    Outcome oc = search(rex, hay, sty);
+    EXPECT_EQ(1, oc.result_) << sty;
+    EXPECT_EQ(100, oc.start_) << sty;
+    EXPECT_EQ(106, oc.end_) << sty;
+  }
+  EXPECT_EQ(1, search(rex, hay, styFull).result_);
+  EXPECT_EQ(0, search(rex, hay + "x", styFull).result_);
+}
+
+
+TEST(Accelerator, section) {
+  Accelerator none;
+  EXPECT_EQ(0U, none.size());
+  EXPECT_FALSE(none.find("x").active());
+
+  const char states[64] = {};
+  uint8_t bitmap[32] = {};
+  setBit(bitmap, 'q');
+  string sec = Accelerator::record(8, bitmap);
+  EXPECT_EQ(40U, sec.size());
+  setBit(bitmap, 'z');
+  sec += Accelerator::record(40, bitmap);
+
+  Accelerator acc(sec, states, sizeof(states));
+  EXPECT_EQ(2U, acc.size());
+  EXPECT_FALSE(acc.find(states).active());
+  EXPECT_FALSE(acc.find(states + 9).active());
+  const Skipper &sk = acc.find(states + 8);
+  EXPECT_TRUE(sk.active());
+  EXPECT_TRUE(sk.contains('q'));
+  EXPECT_FALSE(sk.contains('z'));
+  EXPECT_TRUE(acc.find(states + 40).contains('z'));
+
+  EXPECT_THROW(Accelerator(sec.substr(0, 39), states, 64), RedExcept);
+  EXPECT_THROW(Accelerator(sec, states, 40), RedExcept); // beyond limit
+  string swapped = sec.substr(40) + sec.substr(0, 40);
+  EXPECT_THROW(Accelerator(swapped, states, 64), RedExcept); // out of order
+}
+
+
+TEST(Accelerator, match) {
+  vector<vector<string>> sets = {
+    {"foo.*bar"},
+    {".*foo.*bar.*baz"},
+    {"a[^x]*x", "a[^y]*yz"},
+    {"[a-z]*\\.", "q[^q]*q"},
+  };
+  vector<string> texts = {
+    "", "foo", "foobar", "xxfooxxxxxxxxxxbar", "foo" + string(200, 'x'),
+    "foo" + string(100, '-') + "bar" + string(77, '-') + "baz",
+    "foo" + string(100, '-') + "ba" + string(77, '-') + "baz--",
+    "a" + string(300, 'b') + "x", "a" + string(90, 'b') + "yzx" + "bbb",
+    string(150, 'k') + ".q" + string(60, 'r') + "q",
+  };
+
+  for (const vector<string> &set : sets) {
+    Executable rex;
+    {
+      Parser p;
+      Result res = 0;
+      for (const string &re : set)
+        p.add(re, ++res, 0);
+      rex = compile(p);
+    }
+    EXPECT_LT(0U, rex.getAccel().size()) << set[0];
+    Executable plain = stripped(rex);
+    EXPECT_EQ(0U, plain.getAccel().size());
+
+    for (const string &s : texts)
+      for (Style sty : {styInstant, styFirst, styTangent, styLast, styFull}) {
+        EXPECT_EQ(check(plain, s, sty), check(rex, s, sty)) << s << sty;
+        EXPECT_EQ(check(plain, s.c_str(), sty), check(rex, s.c_str(), sty));
+        Outcome want = match(plain, s, sty);
+        Outcome got = match(rex, s, sty);
+        EXPECT_EQ(want, got) << s << ' ' << sty;
+        want = search(plain, s, sty);
+        got = search(rex, s, sty);
+        EXPECT_EQ(want, got) << s << ' ' << sty;
+        EXPECT_EQ(want, search(rex, s.c_str(), sty)) << s << ' ' << sty;
+        EXPECT_EQ(scan(plain, s, sty), scan(rex, s, sty)) << s << ' ' << sty;
+        string outWant, outGot;
+        EXPECT_EQ(replace(plain, s, "#", outWant, 99, sty),
+                  replace(rex, s, "#", outGot, 99, sty));
+        EXPECT_EQ(outWant, outGot) << s << ' ' << sty;
+      }
+    for (const string &s : texts) {
+      vector<Outcome> want, got;
+      EXPECT_EQ(matchAll(plain, s, want), matchAll(rex, s, got));
+      EXPECT_EQ(want, got) << s;
+    }
+  }
+}
@@ -0,0 +1,199 @@
+// unit tests for adding patterns to a compiled dfa
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Union.h"
+#include "Compile.h"
+#include "Matcher.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Pat {
+  const char *regex_;
+  Result      result_;
+};
+
+const vector<Pat> gBase = {
+  {"foo", 1}, {"ba[rz]+", 2}, {"[0-9]+x", 3}, {"a.*b", 4}, {"hello", 5},
+};
+
+const vector<Pat> gMore = {
+  {"fox", 6}, {"bar", 7}, {"hel+o", 2}, {"[a-f]+x", 8}, {"foo", 9},
+};
+
+const vector<string> gProbes = {
+  "", "foo", "fox", "fo", "bar", "baz", "barz", "bazzz", "12x", "abx",
+  "ax", "aab", "ab", "axxxb", "hello", "helllo", "helo", "xxfoo",
+  "fooxx", "x", "b", "ffx", "a1b", "123", "cafe babe",
+};
+
+
+void addAll(Parser &p, const vector<Pat> &pats, Flags flags = 0) {
+  for (const Pat &pat : pats)
+    p.add(pat.regex_, pat.result_, flags);
+}
+
+} // anonymous
+
+
+TEST(Union, build) {
+  for (Flags opts : {Flags{0}, Flags{cfRefine}}) {
+    DfaObj base;
+    {
+      Parser p;
+      addAll(p, gBase);
+      base = compileToDfa(p, opts);
+    }
+    DfaObj more;
+    {
+      Parser p;
+      addAll(p, gMore);
+      more = compileToDfa(p, opts);
+    }
+    DfaObj whole;
+    {
+      Parser p;
+      addAll(p, gBase);
+      addAll(p, gMore);
+      whole = compileToDfa(p, opts);
+    }
+    UnionBuilder ub(base, more);
+    DfaObj both = ub.build();
+    EXPECT_LE(whole.numStates(), both.numStates());
+    for (const string &probe : gProbes)
+      EXPECT_EQ(whole.matchFull(probe), both.matchFull(probe)) << probe;
+  }
+}
+
+
+TEST(Union, loose) {
+  for (Flags opts : {Flags{0}, Flags{cfRefine}})
+    for (Flags flags : {Flags{fLooseStart}, Flags{fLooseEnd},
+                        Flags{fLooseStart | fLooseEnd}}) {
+      DfaObj base;
+      {
+        Parser p;
+        addAll(p, gBase, flags);
+        base = compileToDfa(p, opts);
+      }
+      DfaObj more;
+      {
+        Parser p;
+        addAll(p, gMore, flags);
+        p.add("x+y", 10, 0); // one anchored among the loose
+        more = compileToDfa(p, opts);
+      }
+      DfaObj whole;
+      {
+        Parser p;
+        addAll(p, gBase, flags);
+        addAll(p, gMore, flags);
+        p.add("x+y", 10, 0);
+        whole = compileToDfa(p, opts);
+      }
+      UnionBuilder ub(base, more);
+      DfaObj both = ub.build();
+      EXPECT_LE(whole.numStates(), both.numStates()) << flags;
+      for (const string &probe : gProbes)
+        for (const string &text : {probe, "zz" + probe, probe + "zz",
+                                   "xy" + probe + "xxy"})
+          EXPECT_EQ(whole.matchFull(text), both.matchFull(text))
+            << opts << ' ' << flags << ' ' << text;
+    }
+}
+
+
+TEST(Union, nothingNew) {
+  DfaObj base;
+  {
+    Parser p;
+    addAll(p, gBase);
+    base = compileToDfa(p);
+  }
+  DfaObj more;
+  {
+    Parser p;
+    p.add("foo", 7, 0); // already matched, with a lower result
+    p.add("hello", 5, 0);
+    more = compileToDfa(p);
+  }
+  UnionBuilder ub(base, more);
+  DfaObj both = ub.build();
+  EXPECT_EQ(base.numStates(), both.numStates());
+  for (const string &probe : gProbes)
+    EXPECT_EQ(base.matchFull(probe), both.matchFull(probe)) << probe;
+}
+
+
+TEST(Union, compile) {
+  Executable whole;
+  {
+    Parser p;
+    addAll(p, gBase);
+    addAll(p, gMore);
+    p.add("x+y", 10, 0);
+    whole = compile(p);
+  }
+
+  DfaObj base;
+  {
+    Parser p;
+    addAll(p, gBase);
+    base = compileToDfa(p);
+  }
+  Executable exec;
+  {
+    Parser p;
+    addAll(p, gMore);
+    exec = compileUnion(base, p);
+  }
+  {
+    Parser p;
+    p.add("x+y", 10, 0);
+    exec = compileUnion(base, p); // again, onto the last union
+  }
+
+  for (const string &probe : gProbes) {
+    string text = probe + "xxy";
+    EXPECT_EQ(check(whole, probe, styFull), check(exec, probe, styFull))
+      << probe;
+    EXPECT_EQ(check(whole, text, styFull), check(exec, text, styFull))
+      << text;
+    Outcome want = search(whole, text, styLast);
+    Outcome got  = search(exec, text, styLast);
+    EXPECT_EQ(want.result_, got.result_) << text;
+    EXPECT_EQ(want.end_, got.end_) << text;
+  }
+}
+
+
+TEST(Union, exact) {
+  DfaObj base;
+  {
+    Parser p;
+    p.addExact("apple", 1, 0);
+    p.addExact("banana", 2, 0);
+    base = compileToDfa(p);
+  }
+  Executable exec;
+  {
+    Parser p;
+    p.addExact("apricot", 3, 0);
+    p.addExact("banana", 1, 0); // lower result wins
+    exec = compileUnion(base, p);
+  }
+  EXPECT_EQ(1, check(exec, "apple", styFull));
+  EXPECT_EQ(1, check(exec, "banana", styFull));
+  EXPECT_EQ(3, check(exec, "apricot", styFull));
+  EXPECT_EQ(0, check(exec, "apric", styFull));
+  EXPECT_EQ(3, search(exec, "an apricot", styLast).result_);
+}
@@ -0,0 +1,97 @@
+// red tool to serialize regexes with hot states laid out together
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "Parser.h"
+#include "Compile.h"
+#include "Profile.h"
+#include "Util.h"
+
+using namespace zezax::red;
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+// fraction of visits landing in the first tenth of the states
+double topShare(const vector<uint64_t> &visits) {
+  uint64_t all = 0;
+  uint64_t top = 0;
+  size_t cut = (visits.size() + 9) / 10;
+  for (size_t ii = 0; ii < visits.size(); ++ii) {
+    all += visits[ii];
+    if (ii < cut)
+      top += visits[ii];
+  }
+  return all ? (static_cast<double>(top) / static_cast<double>(all)) : 0.0;
+}
+
+
+double profiledShare(const Executable &exec, const vector<string> &corpus) {
+  Profiler prof(exec);
+  for (const string &text : corpus)
+    prof.run(text);
+  return topShare(prof.visits());
+}
+
+} // anonymous
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " [-r] corpus-file output-file regex..." << std::endl;
+    return 1;
+  }
+  try {
+    bool raw = false;
+    int ii = 1;
+    if (string_view(argv[ii]) == "-r") {
+      raw = true;
+      ++ii;
+    }
+    const char *corpusPath = argv[ii++];
+    const char *outPath = argv[ii++];
+
+    vector<string> corpus;
+    {
+      std::ifstream in(corpusPath);
+      if (!in)
+        throw std::runtime_error(string("cannot read ") + corpusPath);
+      string line;
+      while (std::getline(in, line))
+        corpus.push_back(line);
+    }
+
+    Parser plain;
+    Parser hot;
+    for (int cur = 1; ii < argc; ++ii, ++cur) {
+      if (raw) {
+        plain.add(argv[ii], cur, 0);
+        hot.add(argv[ii], cur, 0);
+      }
+      else {
+        plain.addAuto(argv[ii], cur, 0);
+        hot.addAuto(argv[ii], cur, 0);
+      }
+    }
+
+    Executable before = compile(plain);
+    string buf = compileToSerialized(hot, corpus);
+    writeStringToFile(buf, outPath);
+    Executable after(std::move(buf));
+
+    std::cout << "states=" << after.getHeader()->stateCnt_
+              << " bytes=" << after.serialized().size()
+              << " top10%: by id=" << profiledShare(before, corpus)
+              << " by visits=" << profiledShare(after, corpus) << std::endl;
+    return 0;
+  }
+  catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+}
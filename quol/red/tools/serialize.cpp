@@ -34,6 +34,14 @@ int main(int argc, char **argv) {
           fmt = fmtDirect2;
         else if (sv == "-4")
           fmt = fmtDirect4;
+        else if (sv == "-8")
+          fmt = fmtDirect8;
+        else if (sv == "-f2")
+          fmt = fmtFlat2;
+        else if (sv == "-f4")
+          fmt = fmtFlat4;
+        else if (sv == "-c4")
+          fmt = fmtComb4;
         else if (raw)
           p.add(sv, ++cur, 0);
         else